@@ -2,20 +2,32 @@
 
 #include <plog/Log.h>
 
+#include <algorithm>
 #include <chrono>
+#include <map>
 
+#include "asyncAppender.h"
 #include "engine.h"
 #include "filter.h"
-#include "plog/Formatters/TxtFormatter.h"
-#include "plog/Initializers/ConsoleInitializer.h"
+#include "patchTable.h"
+#include "realtime.h"
+#include "renderCache.h"
 #include "resource.h"
+#include "resourceWatcher.h"
+#include "router.h"
+#include "rtCheck.h"
 #include "server.h"
+#include "shmTransport.h"
 #include "simEngine.h"
 
 namespace beak
 {
 constexpr auto stopThreadTimeoutMs =
-    std::chrono::milliseconds(100);  //!< Interval after which to terminate the thread
+    std::chrono::milliseconds(100);            //!< Interval after which to terminate the thread
+constexpr int defaultAudioPriority = 80;       //!< SCHED_FIFO priority of the audio thread
+constexpr int defaultNetworkPriority = 70;     //!< SCHED_FIFO priority of the network thread
+constexpr int defaultRecordMinutes = 30;       //!< Output kept on disk by the recorder
+constexpr int realtimeReportTimeoutMs = 1000;  //!< Time to wait for the audio thread to harden
 /**
  * @brief Construct a new Main App:: Main App object
  *
@@ -39,6 +51,14 @@ MainApp::MainApp() : Thread("beak")
       "",
       [this](juce::ArgumentList const &args) { playCmd(args); },
   });
+  addCommand({
+      "router",
+      "router --routes <first>-<last>@<host>:<port>[/<channel>],...",
+      "Forwards events to other instances of beak by channel",
+      "This command listens on the public port and forwards every event to the instance of beak "
+      "that owns its channel, so the channels can be spread over several devices or hosts.",
+      [this](juce::ArgumentList const &args) { routerCmd(args); },
+  });
   addDefaultCommand({
       "server",
       "server",
@@ -65,8 +85,9 @@ MainApp::~MainApp()
  */
 void MainApp::initialise(const juce::String &args)
 {
-  static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
-  plog::init(plog::debug, &consoleAppender);
+  // the log is written from a thread of its own, so logging never blocks the network thread
+  static AsyncAppender asyncAppender;
+  plog::init(plog::debug, &asyncAppender);
   PLOGI << "Starting " << getApplicationName() << "v" << getApplicationVersion();
   m_args = args;
   startThread(juce::Thread::Priority::highest);
@@ -80,6 +101,13 @@ void MainApp::shutdown()
 {
   PLOGI << "shutting down...";
   signalThreadShouldExit();
+#ifdef BEAK_RT_CHECK
+  // fail the run, so scripted test runs notice
+  if (rtcheck::report() > 0)
+  {
+    setApplicationReturnValue(1);
+  }
+#endif
 }
 
 /**
@@ -154,14 +182,68 @@ void MainApp::serverCmd(juce::ArgumentList const &args)
   const juce::String device = args.getValueForOption("--device|-d");
   juce::String cacheDir = args.getValueForOption("--cache|-c");
   const bool isSimulation = args.containsOption("--sim|-s");
+  const juce::String simLayout = args.getValueForOption("--sim-layout|-l");
+  const juce::String streamTarget = args.getValueForOption("--stream|-t");
+  const juce::String bufferSizeArg = args.getValueForOption("--buffer-size|-b");
   juce::String resourceDir = args.getValueForOption("--resource-dir|-r");
+  const int renderCacheMb = args.getValueForOption("--render-cache|-m").getIntValue();
+  const int sampleCacheMb = args.getValueForOption("--sample-cache").getIntValue();
+  const bool isRealtime = args.containsOption("--realtime");
+  const bool hasPriorityThreshold = args.containsOption("--priority-threshold");
+  const int priorityThreshold = args.getValueForOption("--priority-threshold").getIntValue();
+  const bool keepLeadingSilence = args.containsOption("--keep-leading-silence");
+  const juce::String shmSocket = args.getValueForOption("--shm");
+  const juce::String recordDir = args.getValueForOption("--record");
+  const int recordMinutes = args.getValueForOption("--record-minutes").getIntValue();
+  const auto threadConfig = [&args](const juce::String &name, int defaultPriority)
+  {
+    rt::ThreadConfig config{defaultPriority, -1};
+    if (args.containsOption("--rt-" + name + "-priority"))
+    {
+      config.priority = args.getValueForOption("--rt-" + name + "-priority").getIntValue();
+    }
+    if (args.containsOption("--rt-" + name + "-core"))
+    {
+      config.core = args.getValueForOption("--rt-" + name + "-core").getIntValue();
+    }
+    return config;
+  };
+  const rt::ThreadConfig audioThread = threadConfig("audio", defaultAudioPriority);
+  const rt::ThreadConfig networkThread = threadConfig("network", defaultNetworkPriority);
 
   port = port != 0 ? port : defaultPort;                   // default port
   cacheDir = cacheDir.isEmpty() ? "/tmp/beak" : cacheDir;  // default cache dir
   resourceDir = resourceDir.isEmpty() ? "./resources" : resourceDir;
+  const int bufferSize =
+      bufferSizeArg == "auto" ? Engine::Config::autoBufferSize : bufferSizeArg.getIntValue();
+
+  // lock memory first, so everything allocated from here on stays resident
+  if (isRealtime)
+  {
+    if (Error err = rt::lockMemory())
+    {
+      PLOGW << "realtime: " << err.what();
+    }
+    else
+    {
+      PLOGI << "realtime: memory locked";
+    }
+  }
 
   // setup chaching
   Cache cache(cacheDir, resourceDir);
+  cache.keepLeadingSilence(keepLeadingSilence);
+  if (sampleCacheMb > 0)
+  {
+    cache.setDecodedBudget(static_cast<size_t>(sampleCacheMb) << 20);
+  }
+
+  // replaced resources are reloaded without a restart
+  ResourceWatcher resourceWatcher(cache, cache.resourceDirectory());
+  if (auto err = resourceWatcher.start())
+  {
+    PLOGW << err.what();
+  }
   if (auto err = cache.configure())
   {
     PLOGF << err.what();
@@ -172,12 +254,27 @@ void MainApp::serverCmd(juce::ArgumentList const &args)
   std::unique_ptr<Engine> engine;
   if (isSimulation)
   {
-    engine = std::make_unique<sim::SimulationEngine>(outputs);
+    auto layout = DownmixLayout::Stereo;
+    if (simLayout == "5.1")
+    {
+      layout = DownmixLayout::Surround51;
+    }
+    else if (simLayout == "headphones")
+    {
+      layout = DownmixLayout::Headphones;
+    }
+    else if (simLayout.isNotEmpty() && simLayout != "stereo")
+    {
+      PLOGF << "unknown simulation layout " << simLayout << ", use stereo, 5.1 or headphones";
+      std::terminate();
+    }
+    engine = std::make_unique<sim::SimulationEngine>(outputs, layout, streamTarget);
     if (auto err = engine->configure(Engine::Config()
                                          .WithDeviceName(device)
                                          .WithInputs(inputs)
-                                         .WithOutputs(2)
-                                         .WithSampleRate(Engine::Config::defaultSampleRate)))
+                                         .WithOutputs(DownmixProcessor::channelSet(layout).size())
+                                         .WithSampleRate(Engine::Config::defaultSampleRate)
+                                         .WithBufferSize(bufferSize)))
     {
       PLOGF << err.what();
       std::terminate();
@@ -190,100 +287,246 @@ void MainApp::serverCmd(juce::ArgumentList const &args)
                                          .WithDeviceName(device)
                                          .WithInputs(inputs)
                                          .WithOutputs(outputs)
-                                         .WithSampleRate(Engine::Config::defaultSampleRate)))
+                                         .WithSampleRate(Engine::Config::defaultSampleRate)
+                                         .WithBufferSize(bufferSize)))
     {
       PLOGF << err.what();
       std::terminate();
     }
   }
+  if (hasPriorityThreshold)
+  {
+    engine->setPriorityThreshold(priorityThreshold);
+  }
+  if (recordDir.isNotEmpty())
+  {
+    const int minutes = recordMinutes > 0 ? recordMinutes : defaultRecordMinutes;
+    if (auto err = engine->startRecorder(juce::File(recordDir), minutes * 60.0))
+    {
+      PLOGE << err.what();
+    }
+  }
+  if (isRealtime)
+  {
+    cache.prefault();
+    engine->enableRealtime(audioThread);
+    PLOGI << "realtime: " << rt::describe("network", networkThread,
+                                          rt::hardenCurrentThread(networkThread));
+    // the audio thread hardens itself with its first callback
+    for (int i = 0; i < realtimeReportTimeoutMs / 10 && !engine->audioThreadReport(); ++i)
+    {
+      juce::Thread::sleep(10);
+    }
+    if (const auto report = engine->audioThreadReport())
+    {
+      PLOGI << "realtime: " << rt::describe("audio", audioThread, report.value());
+    }
+    else
+    {
+      PLOGW << "realtime: audio thread did not start";
+    }
+  }
+
+  // notes of polyphonic channels that repeat are rendered once and played back as samples
+  std::unique_ptr<RenderCache> renderCache;
+  if (renderCacheMb > 0)
+  {
+    renderCache = std::make_unique<RenderCache>(static_cast<size_t>(renderCacheMb) << 20);
+    renderCache->prepare(engine->getSampleRate());
+  }
+
   try
   {
     asio::io_context ioCtx;
     net::Server server(ioCtx, port);
+    PatchTable patches;
+    std::map<int, Patch> channelPatches;
+    const auto applyPatch = [&engine, &channelPatches](int channel, const Patch &patch)
+    {
+      channelPatches.insert_or_assign(channel, patch);
+      auto osc = patch.osc;
+      if (Error err = engine->configureSynth(channel, osc, patch.adsr, patch.filter,
+                                             patch.filterAdsr, patch.polyphony))
+      {
+        PLOGE << err.what();
+      }
+      if (patch.hasReverb)
+      {
+        if (Error err = engine->configureReverb(channel, patch.reverb, patch.reverbSpread))
+        {
+          PLOGE << err.what();
+        }
+      }
+    };
+
+    // decoded samples are kept by the cache until their file changes
+    const Cache::Decoder decodeSample = [&engine](const juce::File &file,
+                                                  const SampleMetadata &metadata)
+    { return engine->loadSample(file, metadata); };
+
+    // plays a sample on several channels, it is decoded once for all of them
+    const auto playFanOut = [&engine, &cache, &decodeSample](const AudioFrame &frame)
+    {
+      const auto &fanOutFrame = frame.fan_out();
+      if (frame.stop())
+      {
+        if (Error err = engine->stopFanOuts())
+        {
+          PLOGE << err.what();
+        }
+        return;
+      }
+      auto [sample, err] = cache.decoded(frame.uri(), engine->getSampleRate(), decodeSample);
+      if (err)
+      {
+        PLOGE << err.what();
+        return;
+      }
+
+      FanOut fanOut;
+      fanOut.sample = std::move(sample);
+      fanOut.positional = fanOutFrame.positional();
+      fanOut.position = fanOutFrame.position();
+      fanOut.endPosition = fanOutFrame.end_position();
+      fanOut.spread = fanOutFrame.spread();
+      fanOut.moveSamples =
+          static_cast<int>(fanOutFrame.move_ms() * engine->getSampleRate() / 1000.0);
+      fanOut.priority = frame.priority();
+      for (int i = 0; i < fanOutFrame.channels_size(); ++i)
+      {
+        // checked before the gains grow, the channel comes straight from the wire
+        const auto channel = static_cast<size_t>(fanOutFrame.channels(i));
+        if (channel < 1 || channel > static_cast<size_t>(Engine::maxChannel))
+        {
+          continue;
+        }
+        if (fanOut.gains.size() < channel)
+        {
+          fanOut.gains.resize(channel, 0.0f);
+        }
+        fanOut.gains[channel - 1] = i < fanOutFrame.gains_size() ? fanOutFrame.gains(i) : 1.0f;
+      }
+      if (Error err = engine->playFanOut(std::move(fanOut)))
+      {
+        PLOGE << err.what();
+      }
+    };
+
+    // plays a sample on one channel, used by both transports
+    const auto playSound = [&engine, &cache](const std::string &uri, int channel, int priority)
+    {
+      if (auto [file, err] = cache.get(uri); !err)
+      {
+        if (auto err = engine->playSound(file.value(), channel, priority, cache.metadata(uri)))
+        {
+          PLOGE << err.what();
+        }
+      }
+      else
+      {
+        PLOGE << err.what();
+      }
+    };
+    const auto stopSound = [&engine](int channel)
+    {
+      if (auto err = engine->stopPlayback(channel))
+      {
+        PLOGE << err.what();
+      }
+    };
 
     // register callback to play a sample
     server.registerCallback(Packet::kAudioFrame,
-                            [&engine, &cache](std::shared_ptr<Packet> packet)
+                            [&playSound, &stopSound, &playFanOut](std::shared_ptr<Packet> packet)
                             {
-                              auto uri = packet->audio_frame().uri();
-                              auto channel = static_cast<int>(packet->audio_frame().channel());
-                              if (packet->audio_frame().stop())
+                              if (packet->audio_frame().has_fan_out())
                               {
-                                if (auto err = engine->stopPlayback(channel))
-                                {
-                                  PLOGE << err.what();
-                                }
+                                playFanOut(packet->audio_frame());
                                 return;
                               }
-
-                              if (auto [file, err] = cache.get(uri); !err)
-                              {
-                                if (auto err = engine->playSound(file.value(), channel))
-                                {
-                                  PLOGE << err.what();
-                                }
-                              }
-                              else
+                              auto channel = static_cast<int>(packet->audio_frame().channel());
+                              if (packet->audio_frame().stop())
                               {
-                                PLOGE << err.what();
+                                stopSound(channel);
+                                return;
                               }
+                              playSound(packet->audio_frame().uri(), channel,
+                                        packet->audio_frame().priority());
                             });
 
+    // plays or releases a note of a channel, used by both transports
+    const auto playNote = [&engine, &channelPatches, &renderCache](int channel, int note,
+                                                                   float velocity, float durationMs,
+                                                                   int priority, bool isNoteOn)
+    {
+      // a monophonic channel cuts the previous note, so only polyphonic notes are cached, and
+      // cached notes follow the patch only, not the ramps of the channel
+      const auto patch = channelPatches.find(channel);
+      if (renderCache && isNoteOn && patch != channelPatches.end() && patch->second.polyphony > 1 &&
+          !engine->isSynthAutomated(channel))
+      {
+        if (auto rendered = renderCache->get(patch->second, note, velocity, durationMs))
+        {
+          if (Error err = engine->playRendered(channel, std::move(rendered), priority))
+          {
+            PLOGE << err.what();
+          }
+          return;
+        }
+      }
+      const auto msg = isNoteOn ? juce::MidiMessage::noteOn(channel, note, velocity)
+                                : juce::MidiMessage::noteOff(channel, note);
+      if (Error err = engine->playSynth(msg, durationMs, priority))
+      {
+        PLOGE << err.what();
+      }
+    };
+
     server.registerCallback(
         Packet::kSynthFrame,
-        [&engine](std::shared_ptr<Packet> packet)
+        [&patches, &channelPatches, &applyPatch, &playNote](std::shared_ptr<Packet> packet)
         {
-          static auto translateProtoWaveform =
-              [](const SynthWaveform &in) -> synth::Oscillator::Type
+          const auto &synthFrame = packet->synth_frame();
+          // aliases of a channel share its state, like they share its synth
+          const auto channel = Engine::clampChannel(static_cast<int>(synthFrame.channel()));
+          if (synthFrame.event_type() == REGISTER_PATCH)
           {
-            static const std::unordered_map<SynthWaveform, synth::Oscillator::Type>
-                translationTable{
-                    {SynthWaveform::SINE, synth::Oscillator::Type::Sine},
-                    {SynthWaveform::SAW, synth::Oscillator::Type::Saw},
-                    {SynthWaveform::SQUARE, synth::Oscillator::Type::Square},
-
-                };
-            return translationTable.at(in);
-          };
-
-          static auto translateProtoFilterType =
-              [](const SynthFilterType &in) -> synth::Filter::Type
-          {
-            static const std::unordered_map<SynthFilterType, synth::Filter::Type> translationTable{
-                {SynthFilterType::LOWPASS, synth::Filter::Type::Lowpass},
-                {SynthFilterType::HIGHPASS, synth::Filter::Type::Highpass},
-                {SynthFilterType::BANDPASS, synth::Filter::Type::Bandpass},
-            };
-            return translationTable.at(in);
-          };
-
-          const auto synthFrame = packet->synth_frame();
-          // we only want to set the config if it is a config frame or a
+            if (Error err = patches.registerPatch(synthFrame.patch_id(), synthFrame.config()))
+            {
+              PLOGE << err.what();
+            }
+            return;
+          }
+
+          // we only want to set the config if it is a config frame or a note on
           if (synthFrame.event_type() == CONFIG || synthFrame.event_type() == NOTE_ON)
           {
-            const auto config = synthFrame.config();
-
-            // oscillator config
-            synth::Oscillator::Parameters oscParams(translateProtoWaveform(config.wave_form()),
-                                                    config.gain());
-
-            // adsr config
-            const auto adsrConfig = config.adsr_config();
-            juce::ADSR::Parameters adsrParams(adsrConfig.attack(), adsrConfig.decay(),
-                                              adsrConfig.sustain(), adsrConfig.release());
-            // filter config
-            synth::Filter::Parameters filterParams(translateProtoFilterType(config.filter_type()),
-                                                   config.cutoff(), config.resonance());
-            const auto filterAdsrConfig = config.filter_adsr_config();
-            juce::ADSR::Parameters filterAdsrParams(
-                filterAdsrConfig.attack(), filterAdsrConfig.decay(), filterAdsrConfig.sustain(),
-                filterAdsrConfig.release());
-
-            // configure the channel
-            if (Error err = engine->configureSynth(synthFrame.channel(), oscParams, adsrParams,
-                                                   filterParams, filterAdsrParams))
+            if (synthFrame.patch_id() != 0)
             {
-              PLOGE << err.what();
+              // registered patch, only reconfigure the channel if it changes
+              auto [patch, err] =
+                  patches.select(channel, synthFrame.patch_id(), synthFrame.overrides());
+              if (err)
+              {
+                PLOGE << err.what();
+              }
+              else if (patch)
+              {
+                applyPatch(channel, patch.value());
+              }
+            }
+            else
+            {
+              // notes without a patch repeat the config of their channel, only a config frame or
+              // a changed config reconfigures it, which ends the ramps of the channel
+              const Patch patch = Patch::fromConfig(synthFrame.config());
+              const auto current = channelPatches.find(channel);
+              if (synthFrame.event_type() == CONFIG || current == channelPatches.end() ||
+                  !(current->second == patch))
+              {
+                applyPatch(channel, patch);
+              }
+              patches.invalidate(channel);
             }
           }
           // we only need the config here
@@ -291,29 +534,222 @@ void MainApp::serverCmd(juce::ArgumentList const &args)
           {
             return;
           }
-          juce::MidiMessage msg{};
-          switch (synthFrame.event_type())
+          if (synthFrame.event_type() != NOTE_ON && synthFrame.event_type() != NOTE_OFF)
           {
-            case SynthEventType::NOTE_ON:
-              msg = juce::MidiMessage::noteOn(synthFrame.channel(), synthFrame.note(),
-                                              synthFrame.velocity());
-              // PLOGD << "note on, channel " << synthFrame.channel() << ", note "
-              //       << synthFrame.note();
+            PLOGE << "unkown event type";
+            return;
+          }
+          playNote(channel, static_cast<int>(synthFrame.note()), synthFrame.velocity(),
+                   synthFrame.duration_ms(), synthFrame.priority(),
+                   synthFrame.event_type() == NOTE_ON);
+        });
+
+    // sweeps of a parameter, one packet instead of a stream of configs
+    server.registerCallback(
+        Packet::kSynthRamp,
+        [&engine](std::shared_ptr<Packet> packet)
+        {
+          const auto &ramp = packet->synth_ramp();
+          synth::Parameter parameter = synth::Parameter::Cutoff;
+          switch (ramp.parameter())
+          {
+            case SynthParameter::SYNTH_CUTOFF:
+              parameter = synth::Parameter::Cutoff;
+              break;
+            case SynthParameter::SYNTH_RESONANCE:
+              parameter = synth::Parameter::Resonance;
               break;
-            case SynthEventType::NOTE_OFF:
-              msg = juce::MidiMessage::noteOff(synthFrame.channel(), synthFrame.note());
-              // PLOGD << "note off, channel " << synthFrame.channel() << ", note "
-              //       << synthFrame.note();
+            case SynthParameter::SYNTH_GAIN:
+              parameter = synth::Parameter::Gain;
+              break;
+            case SynthParameter::SYNTH_REVERB_SEND:
+              parameter = synth::Parameter::ReverbSend;
               break;
             default:
-              PLOGE << "unkown event type";
+              PLOGE << "unknown synth parameter";
+              return;
+          }
+          // the curves are in the order of EasingMode
+          const auto easing = EasingMode_IsValid(ramp.easing())
+                                  ? static_cast<synth::Easing>(ramp.easing())
+                                  : synth::Easing::Linear;
+          if (Error err = engine->rampSynth(static_cast<int>(ramp.channel()), parameter,
+                                            ramp.target(), ramp.duration_ms(), easing))
+          {
+            PLOGE << err.what();
+          }
+        });
+
+    server.registerCallback(
+        Packet::kSynthSequence,
+        [&engine, &cache, &patches, &applyPatch, &decodeSample](std::shared_ptr<Packet> packet)
+        {
+          const auto &synthSequence = packet->synth_sequence();
+          auto sequence = std::make_shared<Sequence>();
+          sequence->bpm = synthSequence.bpm();
+          sequence->ticksPerBeat =
+              synthSequence.ticks_per_beat() == 0 ? 4.0 : synthSequence.ticks_per_beat();
+          sequence->length = synthSequence.length_ticks();
+          sequence->loop = synthSequence.loop();
+          sequence->loopStart = synthSequence.loop_start_ticks();
+
+          // samples used by several steps are only decoded once
+          std::map<std::string, std::shared_ptr<const SampleBuffer>> samples;
+          for (const auto &track : synthSequence.tracks())
+          {
+            const auto channel = static_cast<int>(track.channel());
+            if (track.patch_id() != 0)
+            {
+              // aliases of a channel share its state, like they share its synth
+              const auto synthChannel = Engine::clampChannel(channel);
+              auto [patch, err] = patches.select(synthChannel, track.patch_id(), {});
+              if (err)
+              {
+                PLOGE << err.what();
+                return;
+              }
+              if (patch)
+              {
+                applyPatch(synthChannel, patch.value());
+              }
+            }
+
+            for (const auto &step : track.steps())
+            {
+              SequenceEvent event;
+              event.tick = step.tick();
+              event.channel = channel;
+              event.note = static_cast<int>(step.note());
+              event.velocity = step.velocity() > 0.0f ? step.velocity() : 1.0f;
+              event.durationTicks = step.duration_ticks();
+              if (!step.uri().empty())
+              {
+                auto &sample = samples[step.uri()];
+                if (!sample)
+                {
+                  auto [decoded, err] =
+                      cache.decoded(step.uri(), engine->getSampleRate(), decodeSample);
+                  if (err)
+                  {
+                    PLOGE << err.what();
+                    return;
+                  }
+                  sample = decoded;
+                }
+                event.sample = sample;
+              }
+              sequence->events.push_back(std::move(event));
+            }
           }
-          if (Error err = engine->playSynth(msg, synthFrame.duration_ms()))
+          std::stable_sort(sequence->events.begin(), sequence->events.end(),
+                           [](const SequenceEvent &a, const SequenceEvent &b)
+                           { return a.tick < b.tick; });
+
+          if (Error err = engine->setSequence(std::move(sequence)))
           {
             PLOGE << err.what();
           }
         });
 
+    server.registerCallback(Packet::kSequenceControl,
+                            [&engine](std::shared_ptr<Packet> packet)
+                            {
+                              const auto &control = packet->sequence_control();
+                              Error err;
+                              switch (control.command())
+                              {
+                                case SequenceCommand::SEQUENCE_START:
+                                  err = engine->startSequence();
+                                  break;
+                                case SequenceCommand::SEQUENCE_STOP:
+                                  err = engine->stopSequence();
+                                  break;
+                                case SequenceCommand::SEQUENCE_SET_TEMPO:
+                                  err = engine->setSequenceTempo(control.bpm());
+                                  break;
+                                default:
+                                  err = Error("unknown sequence command");
+                              }
+                              if (err)
+                              {
+                                PLOGE << err.what();
+                              }
+                            });
+
+    server.registerCallback(Packet::kRecorderControl,
+                            [&engine](std::shared_ptr<Packet> packet)
+                            {
+                              const auto &control = packet->recorder_control();
+                              if (auto err = engine->saveRecording(control.save_seconds()))
+                              {
+                                PLOGE << err.what();
+                              }
+                            });
+
+    // a router asks for the load of the engine, the reply goes back to it
+    server.registerCallback(Packet::kBeakStatus,
+                            [&engine, &server](std::shared_ptr<Packet> packet)
+                            {
+                              const auto stats = engine->overloadStats();
+                              auto *status = packet->mutable_beak_status();
+                              status->set_load(static_cast<float>(stats.load));
+                              status->set_peak_load(static_cast<float>(stats.peakLoad));
+                              status->set_degradation(static_cast<uint32_t>(stats.level));
+                              status->set_overruns(static_cast<uint32_t>(stats.overruns));
+                              status->set_shed_voices(static_cast<uint32_t>(stats.shedVoices));
+                              status->set_refused_triggers(
+                                  static_cast<uint32_t>(stats.refusedTriggers));
+                              status->set_coalesced_configs(engine->coalescedSynthConfigs());
+                              server.send(packet, packet->ByteSizeLong());
+                            });
+
+    // local senders write fixed records into shared memory, without protobuf and UDP
+    std::unique_ptr<net::ShmTransport> shmTransport;
+    if (shmSocket.isNotEmpty())
+    {
+      shmTransport = std::make_unique<net::ShmTransport>(ioCtx, shmSocket.toStdString());
+      shmTransport->registerCallback(shm::EventType::PlaySound,
+                                     [&playSound](const shm::Event &event) {
+                                       playSound(event.uri, static_cast<int>(event.channel),
+                                                 event.priority);
+                                     });
+      shmTransport->registerCallback(shm::EventType::StopSound,
+                                     [&stopSound](const shm::Event &event)
+                                     { stopSound(static_cast<int>(event.channel)); });
+      shmTransport->registerCallback(
+          shm::EventType::NoteOn,
+          [&patches, &applyPatch, &playNote](const shm::Event &event)
+          {
+            const auto channel = Engine::clampChannel(static_cast<int>(event.channel));
+            if (event.patchId != 0)
+            {
+              auto [patch, err] = patches.select(channel, event.patchId,
+                                                 SynthPatchOverrides::default_instance());
+              if (err)
+              {
+                PLOGE << err.what();
+              }
+              else if (patch)
+              {
+                applyPatch(channel, patch.value());
+              }
+            }
+            playNote(channel, static_cast<int>(event.note), event.velocity, event.durationMs,
+                     event.priority, true);
+          });
+      shmTransport->registerCallback(shm::EventType::NoteOff,
+                                     [&playNote](const shm::Event &event)
+                                     {
+                                       playNote(
+                                           Engine::clampChannel(static_cast<int>(event.channel)),
+                                           static_cast<int>(event.note), 0.0f, 0.0f, 0, false);
+                                     });
+      if (auto err = shmTransport->start())
+      {
+        PLOGE << err.what();
+      }
+    }
+
     // run the server
     while (true)
     {
@@ -331,6 +767,58 @@ void MainApp::serverCmd(juce::ArgumentList const &args)
     std::terminate();
   }
 }
+
+/**
+ * @brief Command to forward events to backend instances of beak
+ *
+ * @param args
+ */
+void MainApp::routerCmd(juce::ArgumentList const &args)
+{
+  // parse arguments
+  uint32_t port = args.getValueForOption("--port|-p").getIntValue();
+  const juce::String routes = args.getValueForOption("--routes");
+  port = port != 0 ? port : defaultPort;  // default port
+
+  try
+  {
+    asio::io_context ioCtx;
+    net::Router router(ioCtx, port);
+    for (const auto &route : juce::StringArray::fromTokens(routes, ",", ""))
+    {
+      if (route.trim().isEmpty())
+      {
+        continue;
+      }
+      if (auto err = router.addRoute(route.trim().toStdString()))
+      {
+        PLOGF << err.what();
+        std::terminate();
+      }
+    }
+    if (auto err = router.start())
+    {
+      PLOGF << err.what();
+      std::terminate();
+    }
+
+    // run the router
+    while (true)
+    {
+      ioCtx.run_one_for(stopThreadTimeoutMs);
+      if (threadShouldExit())
+      {
+        PLOGI << "stopping router...";
+        return;
+      }
+    }
+  }
+  catch (std::exception &e)
+  {
+    PLOGF << e.what();
+    std::terminate();
+  }
+}
 }  // namespace beak
 
 /**
@@ -30,6 +30,7 @@ class MainApp : public juce::ConsoleApplication, public juce::JUCEApplication, p
   void listCmd(juce::ArgumentList const &args);
   void playCmd(juce::ArgumentList const &args);
   void serverCmd(juce::ArgumentList const &args);
+  void routerCmd(juce::ArgumentList const &args);
 
  private:
   juce::String m_args;
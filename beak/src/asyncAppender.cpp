@@ -0,0 +1,266 @@
+#include "asyncAppender.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace beak
+{
+constexpr int fatalWaitMs = 100;  //!< Time a fatal record waits to be written, beak terminates next
+
+/**
+ * @brief Construct a new Async Appender:: Async Appender object and starts the writer.
+ *
+ */
+AsyncAppender::AsyncAppender() : juce::Thread("beak log")
+{
+  for (size_t i = 0; i < ringSize; ++i)
+  {
+    m_ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  startThread(juce::Thread::Priority::low);
+}
+
+/**
+ * @brief Destroy the Async Appender:: Async Appender object, writes the records that are left.
+ *
+ */
+AsyncAppender::~AsyncAppender()
+{
+  stopThread(1000);
+  drain();
+  reportDropped();
+}
+
+/**
+ * @brief Reimplemented to queue a record for the writer, may be called from any thread.
+ *
+ * The record is dropped if its log statement exceeds the rate limit or the ring is full. Fatal
+ * records wait until they have been written, beak terminates after them.
+ *
+ * @param record The record
+ */
+void AsyncAppender::write(const plog::Record &record)
+{
+  int suppressed = 0;
+  if (!admit(record, suppressed))
+  {
+    return;
+  }
+
+  // bounded multi producer queue, every cell carries the position it is ready for
+  size_t position = m_enqueuePos.load(std::memory_order_relaxed);
+  Cell *cell = nullptr;
+  while (true)
+  {
+    cell = &m_ring[position % ringSize];
+    const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    const auto difference =
+        static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+    if (difference == 0)
+    {
+      if (m_enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (difference < 0)
+    {
+      m_droppedFull.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else
+    {
+      position = m_enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  Entry &entry = cell->entry;
+  entry.severity = record.getSeverity();
+  entry.time = record.getTime().time;
+  entry.millis = record.getTime().millitm;
+  entry.tid = record.getTid();
+  entry.line = record.getLine();
+  entry.suppressed = suppressed;
+  std::strncpy(entry.func.data(), record.getFunc(), maxFuncLength - 1);
+  entry.func.back() = '\0';
+  std::strncpy(entry.message.data(), record.getMessage(), maxMessageLength - 1);
+  entry.message.back() = '\0';
+  cell->sequence.store(position + 1, std::memory_order_release);
+
+  if (entry.severity == plog::fatal)
+  {
+    for (int i = 0; i < fatalWaitMs && m_dequeuePos.load() <= position; ++i)
+    {
+      juce::Thread::sleep(1);
+    }
+  }
+}
+
+/**
+ * @brief Number of records that have been dropped so far.
+ *
+ * @return int Records dropped by the rate limit or because the ring was full
+ */
+int AsyncAppender::droppedRecords() const
+{
+  return m_droppedFull.load(std::memory_order_relaxed) +
+         m_droppedLimited.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Writes the records until the thread is stopped.
+ *
+ */
+void AsyncAppender::run()
+{
+  while (!threadShouldExit())
+  {
+    drain();
+    reportDropped();
+    wait(writerPollMs);
+  }
+  drain();
+}
+
+/**
+ * @brief Applies the rate limit of the log statement of a record.
+ *
+ * Every statement may log maxRecordsPerSecond records per second. Statements beyond numSites are
+ * not limited.
+ *
+ * @param record      The record
+ * @param suppressed  Receives the records of the statement dropped in the previous second
+ * @return true       The record may be logged
+ */
+bool AsyncAppender::admit(const plog::Record &record, int &suppressed)
+{
+  size_t key = reinterpret_cast<size_t>(record.getFile()) * 31 + record.getLine();
+  key = key == 0 ? 1 : key;
+
+  Site *site = nullptr;
+  for (size_t i = 0; i < numSites && site == nullptr; ++i)
+  {
+    Site &candidate = m_sites[(key + i) % numSites];
+    size_t current = candidate.key.load(std::memory_order_acquire);
+    if (current == key ||
+        (current == 0 && (candidate.key.compare_exchange_strong(current, key) || current == key)))
+    {
+      site = &candidate;
+    }
+  }
+  if (site == nullptr)
+  {
+    return true;
+  }
+
+  const juce::uint32 now = juce::Time::getMillisecondCounter();
+  juce::uint32 windowStart = site->windowStart.load(std::memory_order_relaxed);
+  if (now - windowStart >= 1000 && site->windowStart.compare_exchange_strong(windowStart, now))
+  {
+    suppressed = site->suppressed.exchange(0);
+    site->count.store(0);
+  }
+  if (site->count.fetch_add(1) >= maxRecordsPerSecond)
+  {
+    site->suppressed.fetch_add(1);
+    m_droppedLimited.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Takes the next record from the ring, only called by the writer.
+ *
+ * @param entry Receives the record
+ * @return true The ring was not empty
+ */
+bool AsyncAppender::pop(Entry &entry)
+{
+  const size_t position = m_dequeuePos.load(std::memory_order_relaxed);
+  Cell &cell = m_ring[position % ringSize];
+  if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+  {
+    return false;
+  }
+  entry = cell.entry;
+  cell.sequence.store(position + ringSize, std::memory_order_release);
+  m_dequeuePos.store(position + 1);
+  return true;
+}
+
+/**
+ * @brief Formats a record like the plog text formatter and writes it to stdout.
+ *
+ * @param entry The record
+ */
+void AsyncAppender::writeEntry(const Entry &entry)
+{
+  tm time{};
+  localtime_r(&entry.time, &time);
+  std::fprintf(stdout, "%04d-%02d-%02d %02d:%02d:%02d.%03u %-5s [%u] [%s@%zu] %s",
+               time.tm_year + 1900, time.tm_mon + 1, time.tm_mday, time.tm_hour, time.tm_min,
+               time.tm_sec, static_cast<unsigned>(entry.millis),
+               plog::severityToString(entry.severity), entry.tid, entry.func.data(), entry.line,
+               entry.message.data());
+  if (entry.suppressed > 0)
+  {
+    std::fprintf(stdout, " (%d more dropped by the rate limit)", entry.suppressed);
+  }
+  std::fputc('\n', stdout);
+}
+
+/**
+ * @brief Writes all records of the ring.
+ *
+ */
+void AsyncAppender::drain()
+{
+  Entry entry;
+  bool hasWritten = false;
+  while (pop(entry))
+  {
+    writeEntry(entry);
+    hasWritten = true;
+  }
+  if (hasWritten)
+  {
+    std::fflush(stdout);
+  }
+}
+
+/**
+ * @brief Logs how many records have been dropped since the last report, at most once per interval.
+ *
+ */
+void AsyncAppender::reportDropped()
+{
+  const juce::uint32 now = juce::Time::getMillisecondCounter();
+  if (now - m_lastReport < reportIntervalMs)
+  {
+    return;
+  }
+  m_lastReport = now;
+  const int full = m_droppedFull.load(std::memory_order_relaxed);
+  const int limited = m_droppedLimited.load(std::memory_order_relaxed);
+  if (full == m_reportedFull && limited == m_reportedLimited)
+  {
+    return;
+  }
+
+  Entry entry;
+  entry.severity = plog::warning;
+  entry.time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+  std::strncpy(entry.func.data(), "beak::AsyncAppender::reportDropped", maxFuncLength - 1);
+  entry.line = __LINE__;
+  std::snprintf(entry.message.data(), maxMessageLength,
+                "log dropped %d records, %d with the ring full and %d by the rate limit",
+                (full - m_reportedFull) + (limited - m_reportedLimited), full - m_reportedFull,
+                limited - m_reportedLimited);
+  writeEntry(entry);
+  std::fflush(stdout);
+  m_reportedFull = full;
+  m_reportedLimited = limited;
+}
+}  // namespace beak
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <plog/Log.h>
+
+#include <array>
+#include <atomic>
+#include <ctime>
+
+namespace beak
+{
+/**
+ * @brief Plog appender that writes the log from a background thread.
+ *
+ * Records are copied into a fixed-size lock-free ring, so logging from the network thread never
+ * waits for the console or journald. A thread of its own formats and writes them. Every log
+ * statement is rate limited on its own, records beyond the limit and records that do not fit into
+ * the ring are dropped and counted. Enqueueing does not allocate and does not lock.
+ */
+class AsyncAppender : public plog::IAppender, private juce::Thread
+{
+ public:
+  static constexpr size_t ringSize{1024};                //!< Records that can wait for the writer
+  static constexpr size_t maxMessageLength{256};         //!< Longer messages are truncated
+  static constexpr size_t maxFuncLength{128};            //!< Longer function names are truncated
+  static constexpr size_t numSites{256};                 //!< Log statements that are rate limited
+  static constexpr int maxRecordsPerSecond{20};          //!< Per log statement
+  static constexpr int writerPollMs{10};                 //!< Interval of the writer
+  static constexpr juce::uint32 reportIntervalMs{1000};  //!< Interval of the dropped records report
+
+ public:
+  AsyncAppender();
+  ~AsyncAppender() override;
+  AsyncAppender(const AsyncAppender &) = delete;
+  AsyncAppender &operator=(const AsyncAppender &) = delete;
+
+  void write(const plog::Record &record) override;
+  int droppedRecords() const;
+
+ private:
+  struct Entry
+  {
+    plog::Severity severity{plog::none};
+    time_t time{0};
+    unsigned short millis{0};
+    unsigned int tid{0};
+    size_t line{0};
+    int suppressed{0};  //!< Records of the same statement dropped by the rate limit before this one
+    std::array<char, maxFuncLength> func{};  //!< As printed by plog, the record owns the original
+    std::array<char, maxMessageLength> message{};
+  };
+
+  struct Cell
+  {
+    std::atomic<size_t> sequence{0};
+    Entry entry;
+  };
+
+  struct Site
+  {
+    std::atomic<size_t> key{0};  //!< Identifies the log statement, 0 if the site is free
+    std::atomic<juce::uint32> windowStart{0};
+    std::atomic<int> count{0};       //!< Records within the current window
+    std::atomic<int> suppressed{0};  //!< Records dropped within the current window
+  };
+
+  void run() override;
+  [[nodiscard]] bool admit(const plog::Record &record, int &suppressed);
+  [[nodiscard]] bool pop(Entry &entry);
+  void writeEntry(const Entry &entry);
+  void drain();
+  void reportDropped();
+
+ private:
+  std::array<Cell, ringSize> m_ring;
+  std::atomic<size_t> m_enqueuePos{0};
+  std::atomic<size_t> m_dequeuePos{0};  //!< Only advanced by the writer
+  std::array<Site, numSites> m_sites;
+
+  std::atomic<int> m_droppedFull{0};     //!< Records that did not fit into the ring
+  std::atomic<int> m_droppedLimited{0};  //!< Records dropped by the rate limit
+  int m_reportedFull{0};                 //!< Writer thread
+  int m_reportedLimited{0};              //!< Writer thread
+  juce::uint32 m_lastReport{0};          //!< Writer thread
+};
+}  // namespace beak
@@ -0,0 +1,98 @@
+#include "automation.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace beak::synth
+{
+/**
+ * @brief Sets the sample rate the durations of ramps are converted with.
+ *
+ * @param sampleRate The sample rate
+ */
+void Automation::prepareToPlay(double sampleRate) { m_sampleRate = sampleRate; }
+
+/**
+ * @brief Starts a ramp from the current value of the parameter.
+ *
+ * @param parameter   The parameter
+ * @param base        Configured value of the parameter, the start if it is not ramped yet
+ * @param target      Value at the end of the ramp
+ * @param durationMs  Length of the ramp, 0 jumps to the target
+ * @param easing      Curve of the ramp
+ */
+void Automation::start(Parameter parameter, float base, float target, float durationMs,
+                       Easing easing)
+{
+  auto &ramp = m_ramps[static_cast<size_t>(parameter)];
+  ramp.start = value(parameter, base, 0);
+  ramp.target = target;
+  ramp.length = static_cast<int>(std::lround(std::max(durationMs, 0.0f) * m_sampleRate / 1000.0));
+  ramp.position = 0;
+  ramp.easing = easing;
+  ramp.isSet = true;
+}
+
+/**
+ * @brief Value of a parameter at a position of the current block.
+ *
+ * @param parameter   The parameter
+ * @param base        Configured value of the parameter, returned if it is not ramped
+ * @param offset      Samples into the current block
+ * @return float      The value
+ */
+float Automation::value(Parameter parameter, float base, int offset) const
+{
+  const auto &ramp = m_ramps[static_cast<size_t>(parameter)];
+  if (!ramp.isSet)
+  {
+    return base;
+  }
+  const int position = ramp.position + offset;
+  if (position >= ramp.length)
+  {
+    return ramp.target;
+  }
+  const float progress = static_cast<float>(position) / static_cast<float>(ramp.length);
+  return ramp.start + (ramp.target - ramp.start) * ease(ramp.easing, progress);
+}
+
+/**
+ * @brief Checks if a parameter has been ramped since the last reset.
+ *
+ * @param parameter The parameter
+ * @return true     The parameter follows its ramp instead of the configured value
+ */
+bool Automation::isSet(Parameter parameter) const
+{
+  return m_ramps[static_cast<size_t>(parameter)].isSet;
+}
+
+/**
+ * @brief Moves all ramps to the start of the next block.
+ *
+ * @param numSamples Number of samples of the current block
+ */
+void Automation::advance(int numSamples)
+{
+  for (auto &ramp : m_ramps)
+  {
+    if (ramp.isSet && ramp.position < ramp.length)
+    {
+      ramp.position = std::min(ramp.position + numSamples, ramp.length);
+    }
+  }
+}
+
+/**
+ * @brief Ends all ramps, the parameters go back to their configured values.
+ *
+ */
+void Automation::reset()
+{
+  for (auto &ramp : m_ramps)
+  {
+    ramp.isSet = false;
+  }
+}
+}  // namespace beak::synth
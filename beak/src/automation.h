@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+
+#include "easing.h"
+
+namespace beak::synth
+{
+/**
+ * @brief Parameters of a synth channel that can be ramped.
+ *
+ */
+enum class Parameter
+{
+  Cutoff,
+  Resonance,
+  Gain,        //!< In decibels, like the gain of the oscillator
+  ReverbSend,  //!< Linear send level to the shared reverb
+};
+
+/**
+ * @brief Ramps of the parameters of one synth channel, owned by the audio thread.
+ *
+ * A ramp moves a parameter from its current value to a target along an easing curve and keeps the
+ * target once it is done. Values are looked up by their offset into the current block, so every
+ * control point of the voices gets the exact value of its position. Parameters that were never
+ * ramped keep the value they were configured with.
+ */
+class Automation
+{
+ public:
+  static constexpr int numParameters{4};
+
+ public:
+  void prepareToPlay(double sampleRate);
+  void start(Parameter parameter, float base, float target, float durationMs, Easing easing);
+  float value(Parameter parameter, float base, int offset) const;
+  bool isSet(Parameter parameter) const;
+  void advance(int numSamples);
+  void reset();
+
+ private:
+  struct Ramp
+  {
+    bool isSet{false};
+    float start{0.0f};
+    float target{0.0f};
+    int length{0};    //!< In samples
+    int position{0};  //!< Samples since the start, at the start of the current block
+    Easing easing{Easing::Linear};
+  };
+
+  std::array<Ramp, numParameters> m_ramps{};
+  double m_sampleRate{44100.0};
+};
+}  // namespace beak::synth
@@ -0,0 +1,100 @@
+#include "bufferSizeTuner.h"
+
+#include <plog/Log.h>
+
+namespace beak
+{
+/**
+ * @brief Construct a new Buffer Size Tuner:: Buffer Size Tuner object and starts tuning.
+ *
+ * @param deviceManager The device manager of the engine
+ */
+BufferSizeTuner::BufferSizeTuner(juce::AudioDeviceManager &deviceManager) :
+  m_deviceManager(deviceManager)
+{
+  startTimer(checkIntervalMs);
+}
+
+/**
+ * @brief Destroy the Buffer Size Tuner:: Buffer Size Tuner object
+ *
+ */
+BufferSizeTuner::~BufferSizeTuner() { stopTimer(); }
+
+/**
+ * @brief Checks the device for xruns and callback load and adjusts the buffer size.
+ *
+ */
+void BufferSizeTuner::timerCallback()
+{
+  auto *device = m_deviceManager.getCurrentAudioDevice();
+  if (!device)
+  {
+    return;
+  }
+
+  // devices that do not count xruns report a negative count, only the load is checked then
+  const int xruns = std::max(device->getXRunCount(), 0);
+  const double cpuUsage = m_deviceManager.getCpuUsage();
+  const bool hadXRuns = m_lastXRuns >= 0 && xruns > m_lastXRuns;
+  m_lastXRuns = xruns;
+
+  if (hadXRuns || cpuUsage > maxCpuUsage)
+  {
+    PLOGI << "buffer size " << device->getCurrentBufferSizeSamples() << ": " << xruns
+          << " xruns, " << juce::roundToInt(cpuUsage * 100.0) << "% load";
+    m_numStableChecks = 0;
+    if (!stepUp(*device))
+    {
+      PLOGW << "largest buffer size reached, the device does not run stably";
+      stopTimer();
+    }
+    return;
+  }
+
+  if (++m_numStableChecks >= stableChecks)
+  {
+    const int bufferSize = device->getCurrentBufferSizeSamples();
+    const double latencyMs = (bufferSize + device->getOutputLatencyInSamples()) * 1000.0 /
+                             device->getCurrentSampleRate();
+    PLOGI << "buffer size settled at " << bufferSize << " samples, " << latencyMs
+          << " ms output latency, " << juce::roundToInt(cpuUsage * 100.0) << "% load";
+    stopTimer();
+  }
+}
+
+/**
+ * @brief Switches the device to the next larger buffer size.
+ *
+ * @param device  The current device
+ * @return true   The buffer size has been increased, false if it already is the largest one
+ */
+bool BufferSizeTuner::stepUp(juce::AudioIODevice &device)
+{
+  const int current = device.getCurrentBufferSizeSamples();
+  int next = 0;
+  for (const int size : device.getAvailableBufferSizes())
+  {
+    if (size > current && (next == 0 || size < next))
+    {
+      next = size;
+    }
+  }
+  if (next == 0)
+  {
+    return false;
+  }
+
+  auto setup = m_deviceManager.getAudioDeviceSetup();
+  setup.bufferSize = next;
+  if (const auto err = m_deviceManager.setAudioDeviceSetup(setup, true); err.isNotEmpty())
+  {
+    PLOGE << "could not set buffer size " << next << ": " << err;
+    return false;
+  }
+  // the device restarts, so its xrun count may start over
+  m_lastXRuns = -1;
+  PLOGI << "increased buffer size to " << next << " samples";
+  return true;
+}
+}  // namespace beak
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <juce_audio_devices/juce_audio_devices.h>
+#include <juce_events/juce_events.h>
+
+namespace beak
+{
+/**
+ * @brief Finds the smallest buffer size the device runs stably with.
+ *
+ * Starts at the buffer size the device has been opened with, usually the smallest one it offers.
+ * Steps up to the next size whenever the device reports xruns or the callback load gets too high,
+ * until the device has run stably for a while. Runs on the message thread.
+ */
+class BufferSizeTuner : private juce::Timer
+{
+ public:
+  static constexpr int checkIntervalMs{1000};
+  static constexpr double maxCpuUsage{0.7};  //!< Callback load above which the size is increased
+  static constexpr int stableChecks{10};     //!< Checks without problems until the size is kept
+
+ public:
+  explicit BufferSizeTuner(juce::AudioDeviceManager &deviceManager);
+  ~BufferSizeTuner() override;
+
+ private:
+  void timerCallback() override;
+  bool stepUp(juce::AudioIODevice &device);
+
+ private:
+  juce::AudioDeviceManager &m_deviceManager;
+  int m_lastXRuns{-1};  //!< Negative until the count of the current setup is known
+  int m_numStableChecks{0};
+};
+}  // namespace beak
@@ -0,0 +1,64 @@
+#include "easing.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace beak::synth
+{
+/**
+ * @brief Maps the progress of a transition onto an easing curve.
+ *
+ * The curves follow the ones the LED firmware blends frames with, so light and sound can move
+ * together.
+ *
+ * @param easing  The curve
+ * @param t       Progress from 0 to 1
+ * @return float  Eased progress from 0 to 1
+ */
+float ease(Easing easing, float t)
+{
+  t = std::clamp(t, 0.0f, 1.0f);
+  const float u = t - 1.0f;
+  switch (easing)
+  {
+    case Easing::EaseInQuad:
+      return t * t;
+    case Easing::EaseOutQuad:
+      return t * (2.0f - t);
+    case Easing::EaseInOutQuad:
+      return t < 0.5f ? 2.0f * t * t : -1.0f + (4.0f - 2.0f * t) * t;
+    case Easing::EaseInCubic:
+      return t * t * t;
+    case Easing::EaseOutCubic:
+      return u * u * u + 1.0f;
+    case Easing::EaseInOutCubic:
+      return t < 0.5f ? 4.0f * t * t * t : u * (2.0f * t - 2.0f) * (2.0f * t - 2.0f) + 1.0f;
+    case Easing::EaseInQuart:
+      return t * t * t * t;
+    case Easing::EaseOutQuart:
+      return 1.0f - u * u * u * u;
+    case Easing::EaseInOutQuart:
+      return t < 0.5f ? 8.0f * t * t * t * t : 1.0f - 8.0f * u * u * u * u;
+    case Easing::EaseInQuint:
+      return t * t * t * t * t;
+    case Easing::EaseOutQuint:
+      return 1.0f + u * u * u * u * u;
+    case Easing::EaseInOutQuint:
+      return t < 0.5f ? 16.0f * t * t * t * t * t : 1.0f + 16.0f * u * u * u * u * u;
+    case Easing::EaseInExpo:
+      return t == 0.0f ? 0.0f : std::pow(2.0f, 10.0f * t - 10.0f);
+    case Easing::EaseOutExpo:
+      return t == 1.0f ? 1.0f : 1.0f - std::pow(2.0f, -10.0f * t);
+    case Easing::EaseInOutExpo:
+      if (t == 0.0f || t == 1.0f)
+      {
+        return t;
+      }
+      return t < 0.5f ? std::pow(2.0f, 20.0f * t - 10.0f) / 2.0f
+                      : (2.0f - std::pow(2.0f, -20.0f * t + 10.0f)) / 2.0f;
+    case Easing::Linear:
+    default:
+      return t;
+  }
+}
+}  // namespace beak::synth
@@ -0,0 +1,30 @@
+#pragma once
+
+namespace beak::synth
+{
+/**
+ * @brief Easing curves, the same set and order as the EasingMode of the LED firmware.
+ *
+ */
+enum class Easing
+{
+  Linear,
+  EaseInQuad,
+  EaseOutQuad,
+  EaseInOutQuad,
+  EaseInCubic,
+  EaseOutCubic,
+  EaseInOutCubic,
+  EaseInQuart,
+  EaseOutQuart,
+  EaseInOutQuart,
+  EaseInQuint,
+  EaseOutQuint,
+  EaseInOutQuint,
+  EaseInExpo,
+  EaseOutExpo,
+  EaseInOutExpo,
+};
+
+float ease(Easing easing, float t);
+}  // namespace beak::synth
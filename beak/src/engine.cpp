@@ -1,6 +1,11 @@
 #include "engine.h"
 
+#include <plog/Log.h>
+
+#include <algorithm>
+
 #include "processor.h"
+#include "rtCheck.h"
 #include "synthProcessor.h"
 
 namespace beak
@@ -20,7 +25,7 @@ Engine::Engine() :
  */
 Engine::~Engine()
 {
-  m_deviceManager.removeAudioCallback(m_player.get());
+  m_deviceManager.removeAudioCallback(this);
   m_mainProcessor->releaseResources();
   m_mainProcessor->clear();
 }
@@ -57,21 +62,65 @@ Error Engine::configureGraph(Config const &config)
   {
     return Error("could not add output node");
   }
+  m_reverbNode = m_mainProcessor->addNode(std::make_unique<ReverbProcessor>(config.outputs()));
+  if (!m_reverbNode)
+  {
+    return Error("could not add reverb node");
+  }
+  m_fanOutNode = m_mainProcessor->addNode(std::make_unique<FanOutProcessor>(config.outputs()));
+  if (!m_fanOutNode)
+  {
+    return Error("could not add fan out node");
+  }
   for (int i = 0; i < config.outputs(); ++i)
   {
+    m_mainProcessor->addConnection({{m_fanOutNode->nodeID, i}, {m_audioOutputNode->nodeID, i}});
     auto playerNode = m_mainProcessor->addNode(std::make_unique<SamplerProcessor>());
     m_mainProcessor->addConnection({{playerNode->nodeID, 0}, {m_audioOutputNode->nodeID, i}});
     m_playerNodes.push_back(playerNode);
     auto synthNode = m_mainProcessor->addNode(std::make_unique<SynthProcessor>());
     m_mainProcessor->addConnection({{synthNode->nodeID, 0}, {m_audioOutputNode->nodeID, i}});
+    m_mainProcessor->addConnection({{synthNode->nodeID, 1}, {m_reverbNode->nodeID, i}});
     m_synthNodes.push_back(synthNode);
+    m_mainProcessor->addConnection({{m_reverbNode->nodeID, i}, {m_audioOutputNode->nodeID, i}});
   }
   m_player->setProcessor(m_mainProcessor.get());
-  m_deviceManager.addAudioCallback(m_player.get());
+  startAudioCallback();
   m_mainProcessor->getCallbackLock().exit();
   return Error();
 }
 
+/**
+ * @brief Connects the sequencer and the overload guard to the channels and starts the audio
+ * callback.
+ *
+ * Must be called once the graph is complete.
+ */
+void Engine::startAudioCallback()
+{
+  std::vector<SynthProcessor *> synths;
+  for (const auto &node : m_synthNodes)
+  {
+    synths.push_back(dynamic_cast<SynthProcessor *>(node->getProcessor()));
+    synths.back()->setOverloadGuard(&m_overloadGuard);
+  }
+  std::vector<SamplerProcessor *> samplers;
+  for (const auto &node : m_playerNodes)
+  {
+    samplers.push_back(dynamic_cast<SamplerProcessor *>(node->getProcessor()));
+    samplers.back()->setOverloadGuard(&m_overloadGuard);
+  }
+  for (const auto &node : {m_reverbNode, m_fanOutNode})
+  {
+    if (auto *proc = dynamic_cast<ProcessorBase *>(node->getProcessor()))
+    {
+      proc->setOverloadGuard(&m_overloadGuard);
+    }
+  }
+  m_sequencer.setTargets(synths, samplers);
+  m_deviceManager.addAudioCallback(this);
+}
+
 /**
  * @brief Initializes the device manager with number of outputs and sample rate.
  *
@@ -101,6 +150,50 @@ Error Engine::configureDeviceManager(Config const &config)
   return Error();
 }
 
+/**
+ * @brief Sets the buffer size of the opened device.
+ *
+ * In auto mode the device starts with the smallest size it offers, the tuner increases it while
+ * running if needed.
+ *
+ * @param config  Configuration struct
+ * @return Error  Custom error type to signal an error
+ */
+Error Engine::configureBufferSize(Config const &config)
+{
+  if (config.bufferSize() == 0)
+  {
+    return Error();
+  }
+  auto *device = m_deviceManager.getCurrentAudioDevice();
+  if (!device)
+  {
+    return Error("no audio device");
+  }
+
+  int bufferSize = config.bufferSize();
+  if (bufferSize == Config::autoBufferSize)
+  {
+    const auto sizes = device->getAvailableBufferSizes();
+    if (sizes.isEmpty())
+    {
+      return Error();
+    }
+    bufferSize = *std::min_element(sizes.begin(), sizes.end());
+  }
+  auto setup = m_deviceManager.getAudioDeviceSetup();
+  setup.bufferSize = bufferSize;
+  if (auto err = m_deviceManager.setAudioDeviceSetup(setup, true); err.isNotEmpty())
+  {
+    return Error("setting buffer size: " + err);
+  }
+  device = m_deviceManager.getCurrentAudioDevice();
+  PLOGI << "buffer size " << device->getCurrentBufferSizeSamples() << " samples, "
+        << device->getCurrentBufferSizeSamples() * 1000.0 / device->getCurrentSampleRate()
+        << " ms";
+  return Error();
+}
+
 /**
  * @brief Initializes the device manager and the audio engine
  *
@@ -113,10 +206,18 @@ Error Engine::configure(Config const &config)
   {
     return err;
   }
+  if (auto err = configureBufferSize(config))
+  {
+    return err;
+  }
   if (auto err = configureGraph(config))
   {
     return err;
   }
+  if (config.bufferSize() == Config::autoBufferSize)
+  {
+    m_bufferSizeTuner = std::make_unique<BufferSizeTuner>(m_deviceManager);
+  }
   return Error();
 }
 
@@ -125,17 +226,23 @@ Error Engine::configure(Config const &config)
  *
  * @param file      The file to be played back
  * @param channel   The channel to play the sample back on
+ * @param priority  Sounds below the threshold are refused under overload
+ * @param metadata  Gain and attack of the sample
  * @return Error    Custom error to signal a failure
  */
-Error Engine::playSound(const juce::File &file, int channel)
+Error Engine::playSound(const juce::File &file, int channel, int priority,
+                        const SampleMetadata &metadata)
 {
+  if (!m_overloadGuard.admits(priority))
+  {
+    return Error("engine overloaded, sound refused");
+  }
   Error err;
-  channel = std::min(channel, 10);
-  channel = std::max(channel, 1);
+  channel = clampChannel(channel);
   auto playerNode = m_playerNodes.at(channel - 1);
   if (auto proc = dynamic_cast<SamplerProcessor *>(playerNode->getProcessor()))
   {
-    proc->playSample(file);
+    proc->playSample(file, metadata);
   }
   else
   {
@@ -147,8 +254,7 @@ Error Engine::playSound(const juce::File &file, int channel)
 Error Engine::stopPlayback(int channel)
 {
   Error err;
-  channel = std::min(channel, 10);
-  channel = std::max(channel, 1);
+  channel = clampChannel(channel);
   auto playerNode = m_playerNodes.at(channel - 1);
   if (auto proc = dynamic_cast<SamplerProcessor *>(playerNode->getProcessor()))
   {
@@ -161,42 +267,483 @@ Error Engine::stopPlayback(int channel)
   return err;
 }
 
-Error Engine::playSynth(const juce::MidiMessage &msg, int maxDurationMs)
+/**
+ * @brief Plays a decoded sample on several channels at once.
+ *
+ * @param fanOut  The sample and the channels or position to play it on
+ * @return Error  Custom error to signal a failure
+ */
+Error Engine::playFanOut(FanOut fanOut)
 {
+  if (!m_overloadGuard.admits(fanOut.priority))
+  {
+    return Error("engine overloaded, fan out refused");
+  }
+  if (!fanOut.positional && fanOut.gains.size() > m_synthNodes.size())
+  {
+    return Error("fan out has more channels than the engine");
+  }
+  auto proc = dynamic_cast<FanOutProcessor *>(m_fanOutNode->getProcessor());
+  if (!proc)
+  {
+    return Error("not a FanOutProcessor");
+  }
+  if (!proc->play(std::move(fanOut)))
+  {
+    return Error("fan out queue full");
+  }
+  return Error();
+}
+
+/**
+ * @brief Stops all samples played on several channels.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error Engine::stopFanOuts()
+{
+  auto proc = dynamic_cast<FanOutProcessor *>(m_fanOutNode->getProcessor());
+  if (!proc)
+  {
+    return Error("not a FanOutProcessor");
+  }
+  proc->stopAll();
+  return Error();
+}
+
+/**
+ * @brief Plays or releases a note of the synthesiser of a channel
+ *
+ * @param msg           Note on or note off message, the MIDI channel selects the channel
+ * @param maxDurationMs Time after which a started note is released, exact to the sample
+ * @param priority      Notes below the threshold are refused under overload, note offs never are
+ * @return Error        Custom error to signal a failure
+ */
+Error Engine::playSynth(const juce::MidiMessage &msg, float maxDurationMs, int priority)
+{
+  if (msg.isNoteOn() && !m_overloadGuard.admits(priority))
+  {
+    return Error("engine overloaded, note refused");
+  }
   Error err;
   int channel = msg.getChannel();
   const int note = msg.getNoteNumber();
-  channel = std::min(channel, 10);
-  channel = std::max(channel, 1);
+  channel = clampChannel(channel);
 
   auto synthNode = m_synthNodes.at(channel - 1);
   if (auto proc = dynamic_cast<SynthProcessor *>(synthNode->getProcessor()))
   {
     if (msg.isNoteOn())
     {
-      proc->noteOn(note, maxDurationMs);
+      if (!proc->noteOn(note, msg.getFloatVelocity(), maxDurationMs))
+      {
+        err = Error("note queue full");
+      }
     }
     else if (msg.isNoteOff())
     {
-      proc->noteOff(note);
+      if (!proc->noteOff(note))
+      {
+        err = Error("note queue full");
+      }
     }
   }
   return err;
 }
 
+/**
+ * @brief Plays a synth note that has been rendered ahead of time on a channel.
+ *
+ * @param channel   Channel to play the note on
+ * @param sample    The rendered note, has to be kept alive until it has finished playing
+ * @param priority  Notes below the threshold are refused under overload
+ * @return Error    Custom error to signal a failure
+ */
+Error Engine::playRendered(int channel, std::shared_ptr<const SampleBuffer> sample, int priority)
+{
+  if (!m_overloadGuard.admits(priority))
+  {
+    return Error("engine overloaded, note refused");
+  }
+  channel = clampChannel(channel);
+  auto synthNode = m_synthNodes.at(channel - 1);
+  auto proc = dynamic_cast<SynthProcessor *>(synthNode->getProcessor());
+  if (!proc)
+  {
+    return Error("not a SynthProcessor");
+  }
+  if (!proc->playRendered(std::move(sample), priority))
+  {
+    return Error("note queue full");
+  }
+  return Error{};
+}
+
 Error Engine::configureSynth(int channel, synth::Oscillator::Parameters &osc,
                              const juce::ADSR::Parameters &adsr,
                              const synth::Filter::Parameters &filter,
-                             const juce::ADSR::Parameters &filterAdsr)
+                             const juce::ADSR::Parameters &filterAdsr, int polyphony)
 {
-  channel = std::min(channel, 10);
-  channel = std::max(channel, 1);
+  channel = clampChannel(channel);
   auto synthNode = m_synthNodes.at(channel - 1);
   if (auto proc = dynamic_cast<SynthProcessor *>(synthNode->getProcessor()))
   {
-    proc->setVoiceParams(osc, adsr);
-    proc->setFilterParams(filter, filterAdsr);
+    proc->setConfig({osc, adsr, filter, filterAdsr, polyphony});
+  }
+  return Error{};
+}
+
+/**
+ * @brief Sets the reverb send of a channel and the parameters of the shared reverb.
+ *
+ * The wet level of the parameters is used as the send level of the channel. All other parameters
+ * are shared by all channels, so the channel configured last sets them.
+ *
+ * @param channel Channel to set the send level of
+ * @param params  Reverb parameters
+ * @param spread  Distribution of the reverb return across the outputs
+ * @return Error  Custom error to signal a failure
+ */
+Error Engine::configureReverb(int channel, const juce::Reverb::Parameters &params, float spread)
+{
+  channel = clampChannel(channel);
+  auto synthNode = m_synthNodes.at(channel - 1);
+  auto proc = dynamic_cast<SynthProcessor *>(synthNode->getProcessor());
+  if (!proc)
+  {
+    return Error("not a SynthProcessor");
+  }
+  proc->setSendLevel(params.wetLevel);
+  if (auto reverb = dynamic_cast<ReverbProcessor *>(m_reverbNode->getProcessor()))
+  {
+    reverb->setParameters(params, spread);
   }
   return Error{};
 }
+
+/**
+ * @brief Ramps a parameter of the synth of a channel, interpolated on the audio thread.
+ *
+ * @param channel     Channel of the synth
+ * @param parameter   The parameter
+ * @param target      Value at the end of the ramp
+ * @param durationMs  Length of the ramp, 0 jumps to the target
+ * @param easing      Curve of the ramp
+ * @return Error      Custom error to signal a failure
+ */
+Error Engine::rampSynth(int channel, synth::Parameter parameter, float target, float durationMs,
+                        synth::Easing easing)
+{
+  channel = clampChannel(channel);
+  auto synthNode = m_synthNodes.at(channel - 1);
+  auto proc = dynamic_cast<SynthProcessor *>(synthNode->getProcessor());
+  if (!proc)
+  {
+    return Error("not a SynthProcessor");
+  }
+  if (!proc->ramp(parameter, target, durationMs, easing))
+  {
+    return Error("ramp queue full");
+  }
+  return Error{};
+}
+
+/**
+ * @brief Sample rate of the device.
+ *
+ * @return double The sample rate, the default one if no device is open
+ */
+double Engine::getSampleRate() const
+{
+  if (auto *device = m_deviceManager.getCurrentAudioDevice())
+  {
+    return device->getCurrentSampleRate();
+  }
+  return Config::defaultSampleRate;
+}
+
+/**
+ * @brief Switches the audio thread to real-time scheduling with its next callback.
+ *
+ * @param audioThread Priority and core of the audio thread
+ */
+void Engine::enableRealtime(const rt::ThreadConfig &audioThread)
+{
+  m_audioThreadConfig = audioThread;
+  m_audioThreadReport = -1;
+  m_realtime = true;
+  m_hardenAudioThread = true;
+}
+
+/**
+ * @brief Guarantees the audio thread obtained in real-time mode.
+ *
+ * @return std::optional<rt::ThreadReport> The report, empty until the audio thread has run
+ */
+std::optional<rt::ThreadReport> Engine::audioThreadReport() const
+{
+  const int report = m_audioThreadReport.load();
+  if (report < 0)
+  {
+    return std::nullopt;
+  }
+  return rt::ThreadReport{(report & 1) != 0, (report & 2) != 0};
+}
+
+/**
+ * @brief Sets the priority a sound needs to be played while the engine refuses triggers.
+ *
+ * @param priority The lowest priority that is still played
+ */
+void Engine::setPriorityThreshold(int priority) { m_overloadGuard.setPriorityThreshold(priority); }
+
+/**
+ * @brief Load of the audio callback and how far the engine has degraded.
+ *
+ * @return OverloadGuard::Stats The stats
+ */
+OverloadGuard::Stats Engine::overloadStats() const { return m_overloadGuard.stats(); }
+
+/**
+ * @brief Synth configs of all channels that were replaced before the audio thread applied them.
+ *
+ * @return uint64_t The number of coalesced configs since the start
+ */
+uint64_t Engine::coalescedSynthConfigs() const
+{
+  uint64_t coalesced = 0;
+  for (const auto &synthNode : m_synthNodes)
+  {
+    if (auto proc = dynamic_cast<const SynthProcessor *>(synthNode->getProcessor()))
+    {
+      coalesced += proc->coalescedConfigs();
+    }
+  }
+  return coalesced;
+}
+
+/**
+ * @brief Checks if the sound of the synth of a channel is ramped away from its config.
+ *
+ * Notes rendered ahead of time follow the config only, so they must not be played meanwhile.
+ *
+ * @param channel Channel of the synth
+ * @return true   A ramp has been posted since the last config of the channel
+ */
+bool Engine::isSynthAutomated(int channel) const
+{
+  channel = clampChannel(channel);
+  if (channel > static_cast<int>(m_synthNodes.size()))
+  {
+    return false;
+  }
+  auto proc = dynamic_cast<const SynthProcessor *>(m_synthNodes.at(channel - 1)->getProcessor());
+  return proc && proc->isAutomated();
+}
+
+/**
+ * @brief Starts recording the final output of all channels of the device.
+ *
+ * @param directory         Directory the recording is written to
+ * @param retentionSeconds  Seconds of the recording that are kept on disk
+ * @return Error  Custom error type to signal an error
+ */
+Error Engine::startRecorder(const juce::File &directory, double retentionSeconds)
+{
+  if (m_recorder)
+  {
+    return Error("recorder is already running");
+  }
+  auto *device = m_deviceManager.getCurrentAudioDevice();
+  if (device == nullptr)
+  {
+    return Error("no audio device to record");
+  }
+  auto recorder = std::make_unique<OutputRecorder>(
+      directory, device->getActiveOutputChannels().countNumberOfSetBits(),
+      device->getCurrentSampleRate(), retentionSeconds);
+  if (auto err = recorder->start())
+  {
+    return err;
+  }
+  m_recorder = std::move(recorder);
+  m_recorderTap = m_recorder.get();
+  return Error();
+}
+
+/**
+ * @brief Saves the last seconds of the output into a file of their own.
+ *
+ * @param seconds Seconds to save
+ * @return Error  Custom error type to signal an error
+ */
+Error Engine::saveRecording(double seconds)
+{
+  if (!m_recorder)
+  {
+    return Error("recorder is not running");
+  }
+  m_recorder->requestSave(seconds);
+  return Error();
+}
+
+/**
+ * @brief Decodes a sample into memory for the sequencer.
+ *
+ * The sample is mixed down to mono and resampled to the sample rate of the device. It starts at
+ * its attack and the gain is applied with the mix down, so playing the sample costs nothing extra.
+ *
+ * @param file      The file to decode
+ * @param metadata  Gain and attack of the sample
+ * @return std::tuple<std::shared_ptr<const SampleBuffer>, Error> The sample or an error
+ */
+std::tuple<std::shared_ptr<const SampleBuffer>, Error> Engine::loadSample(
+    const juce::File &file, const SampleMetadata &metadata)
+{
+  juce::AudioFormatManager formatManager;
+  formatManager.registerBasicFormats();
+  std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+  if (!reader)
+  {
+    return {nullptr, Error("could not read " + file.getFullPathName())};
+  }
+
+  const auto numChannels = static_cast<int>(reader->numChannels);
+  const auto start = std::clamp<juce::int64>(metadata.attackOffset, 0, reader->lengthInSamples);
+  const auto length = static_cast<int>(reader->lengthInSamples - start);
+  juce::AudioBuffer<float> decoded(numChannels, length);
+  reader->read(&decoded, 0, length, start, true, true);
+  for (int channel = 1; channel < numChannels; ++channel)
+  {
+    decoded.addFrom(0, 0, decoded, channel, 0, length);
+  }
+  decoded.applyGain(0, 0, length, metadata.gain / static_cast<float>(numChannels));
+
+  auto *device = m_deviceManager.getCurrentAudioDevice();
+  if (!device)
+  {
+    return {nullptr, Error("no audio device")};
+  }
+  const double ratio = reader->sampleRate / device->getCurrentSampleRate();
+  const auto resampledLength = static_cast<int>(length / ratio);
+  auto sample = std::make_shared<SampleBuffer>(1, resampledLength);
+  juce::LagrangeInterpolator interpolator;
+  interpolator.process(ratio, decoded.getReadPointer(0), sample->getWritePointer(0),
+                       resampledLength);
+  return {sample, Error()};
+}
+
+/**
+ * @brief Sets the sequence to play, a playing sequence continues at its position.
+ *
+ * @param sequence  The sequence
+ * @return Error    Custom error to signal a failure
+ */
+Error Engine::setSequence(std::shared_ptr<const Sequence> sequence)
+{
+  if (sequence->bpm <= 0.0 || sequence->ticksPerBeat <= 0.0)
+  {
+    return Error("invalid tempo");
+  }
+  if (sequence->loop && sequence->length <= sequence->loopStart)
+  {
+    return Error("empty loop");
+  }
+  for (const auto &event : sequence->events)
+  {
+    if (event.channel < 1 || event.channel > static_cast<int>(m_synthNodes.size()))
+    {
+      return Error("invalid channel in sequence");
+    }
+  }
+  if (!m_sequencer.setSequence(std::move(sequence)))
+  {
+    return Error("sequencer queue full");
+  }
+  return Error();
+}
+
+/**
+ * @brief Starts the sequence from the beginning.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error Engine::startSequence()
+{
+  return m_sequencer.start() ? Error() : Error("sequencer queue full");
+}
+
+/**
+ * @brief Stops the sequence.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error Engine::stopSequence()
+{
+  return m_sequencer.stop() ? Error() : Error("sequencer queue full");
+}
+
+/**
+ * @brief Changes the tempo of the sequence.
+ *
+ * @param bpm     Beats per minute
+ * @return Error  Custom error to signal a failure
+ */
+Error Engine::setSequenceTempo(double bpm)
+{
+  return m_sequencer.setTempo(bpm) ? Error() : Error("invalid tempo or sequencer queue full");
+}
+
+/**
+ * @brief Reimplemented to run the sequencer before the graph renders the block.
+ *
+ * The time the block takes is measured against its duration for the overload guard.
+ */
+void Engine::audioDeviceIOCallbackWithContext(const float *const *inputChannelData,
+                                              int numInputChannels,
+                                              float *const *outputChannelData,
+                                              int numOutputChannels, int numSamples,
+                                              const juce::AudioIODeviceCallbackContext &context)
+{
+  const auto startTicks = juce::Time::getHighResolutionTicks();
+  if (m_hardenAudioThread.load(std::memory_order_relaxed) && m_hardenAudioThread.exchange(false))
+  {
+    const auto report = rt::hardenCurrentThread(m_audioThreadConfig);
+    m_audioThreadReport = (report.scheduled ? 1 : 0) | (report.pinned ? 2 : 0);
+  }
+  {
+    // the player locks by design, only the sequencer and the processors are checked
+    BEAK_RT_AUDIO_SCOPE;
+    m_sequencer.process(numSamples);
+  }
+  m_player->audioDeviceIOCallbackWithContext(inputChannelData, numInputChannels, outputChannelData,
+                                             numOutputChannels, numSamples, context);
+  if (auto *recorder = m_recorderTap.load(std::memory_order_acquire))
+  {
+    recorder->push(outputChannelData, numOutputChannels, numSamples);
+  }
+  m_overloadGuard.measure(
+      juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks),
+      numSamples / m_deviceSampleRate.load(std::memory_order_relaxed));
+}
+
+/**
+ * @brief Reimplemented to prepare the sequencer and the player.
+ *
+ * @param device The device that is about to start
+ */
+void Engine::audioDeviceAboutToStart(juce::AudioIODevice *device)
+{
+  m_deviceSampleRate = device->getCurrentSampleRate();
+  m_sequencer.prepare(device->getCurrentSampleRate());
+  m_player->audioDeviceAboutToStart(device);
+  // a restarted device may call back from a new thread
+  m_hardenAudioThread = m_realtime.load();
+}
+
+/**
+ * @brief Reimplemented to stop the player.
+ *
+ */
+void Engine::audioDeviceStopped() { m_player->audioDeviceStopped(); }
 }  // namespace beak
@@ -1,24 +1,49 @@
 #pragma once
 #include <juce_audio_utils/juce_audio_utils.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <optional>
+#include <tuple>
 
+#include "automation.h"
+#include "bufferSizeTuner.h"
 #include "error.h"
 #include "filter.h"
+#include "oscillator.h"
+#include "outputRecorder.h"
+#include "overload.h"
 #include "processor.h"
+#include "realtime.h"
+#include "sampleMetadata.h"
+#include "sequencer.h"
 
 namespace beak
 {
-class Engine
+/**
+ * @brief The audio engine, the audio callback of the device.
+ *
+ * Runs the sequencer before every block and lets the AudioProcessorPlayer render the graph. Every
+ * callback is timed against the duration of its block, the engine degrades gracefully when it gets
+ * close to the deadline.
+ */
+class Engine : public juce::AudioIODeviceCallback
 {
  public:
+  static constexpr int maxChannel{10};  //!< Higher channels are played on this one
+
+  /** Channel that is played for a channel of a client, also the key of per channel state */
+  static int clampChannel(int channel) { return std::clamp(channel, 1, maxChannel); }
+
   struct Config
   {
     explicit Config() :
       m_deviceName(defaultDevice),
       m_inputs(defaultInputs),
       m_outputs(defaultOutputs),
-      m_sampleRate(defaultSampleRate)
+      m_sampleRate(defaultSampleRate),
+      m_bufferSize(0)
     {
     }
 
@@ -46,44 +71,92 @@ class Engine
       retval.m_sampleRate = sampleRate == 0 ? defaultSampleRate : sampleRate;
       return retval;
     }
+    /** 0 keeps the size the driver picks, autoBufferSize tunes it while running */
+    Config WithBufferSize(int bufferSize)
+    {
+      auto retval = *this;
+      retval.m_bufferSize = bufferSize;
+      return retval;
+    }
     juce::String deviceName() const { return m_deviceName; }
     int inputs() const { return m_inputs; }
     int outputs() const { return m_outputs; }
     int sampleRate() const { return m_sampleRate; }
+    int bufferSize() const { return m_bufferSize; }
 
    private:
     juce::String m_deviceName;
     int m_inputs;
     int m_outputs;
     int m_sampleRate;
+    int m_bufferSize;
 
    public:
     static constexpr const char *defaultDevice = "MacBook Pro Speakers";
     static constexpr uint32_t defaultInputs = 2;
     static constexpr uint32_t defaultOutputs = 2;
     static constexpr int defaultSampleRate = 44100;
+    static constexpr int autoBufferSize = -1;
   };
 
  public:
   Engine();
-  virtual ~Engine();
+  ~Engine() override;
   Engine(Engine &&) = delete;
   Engine &operator=(Engine &&) = delete;
 
  public:
   [[nodiscard]] Error configure(Config const &config);
-  [[nodiscard]] virtual Error playSound(const juce::File &file, int channel);
+  [[nodiscard]] virtual Error playSound(const juce::File &file, int channel, int priority = 0,
+                                        const SampleMetadata &metadata = {});
   [[nodiscard]] virtual Error stopPlayback(int channel);
-  [[nodiscard]] virtual Error playSynth(const juce::MidiMessage &msg, int maxDurationMs = 1000);
+  [[nodiscard]] virtual Error playFanOut(FanOut fanOut);
+  [[nodiscard]] virtual Error stopFanOuts();
+  [[nodiscard]] virtual Error playSynth(const juce::MidiMessage &msg,
+                                        float maxDurationMs = 1000.0f, int priority = 0);
+  [[nodiscard]] virtual Error playRendered(int channel, std::shared_ptr<const SampleBuffer> sample,
+                                           int priority = 0);
   [[nodiscard]] virtual Error configureSynth(int channel, synth::Oscillator::Parameters &osc,
                                              const juce::ADSR::Parameters &adsr,
                                              const synth::Filter::Parameters &filter,
-                                             const juce::ADSR::Parameters &filterAdsr);
+                                             const juce::ADSR::Parameters &filterAdsr,
+                                             int polyphony = 0);
+  [[nodiscard]] virtual Error configureReverb(int channel, const juce::Reverb::Parameters &params,
+                                              float spread);
+  [[nodiscard]] virtual Error rampSynth(int channel, synth::Parameter parameter, float target,
+                                        float durationMs, synth::Easing easing);
+  [[nodiscard]] virtual std::tuple<std::shared_ptr<const SampleBuffer>, Error> loadSample(
+      const juce::File &file, const SampleMetadata &metadata = {});
+  [[nodiscard]] virtual Error setSequence(std::shared_ptr<const Sequence> sequence);
+  [[nodiscard]] virtual Error startSequence();
+  [[nodiscard]] virtual Error stopSequence();
+  [[nodiscard]] virtual Error setSequenceTempo(double bpm);
+  double getSampleRate() const;
+  void enableRealtime(const rt::ThreadConfig &audioThread);
+  std::optional<rt::ThreadReport> audioThreadReport() const;
+  void setPriorityThreshold(int priority);
+  OverloadGuard::Stats overloadStats() const;
+  uint64_t coalescedSynthConfigs() const;
+  bool isSynthAutomated(int channel) const;
+  [[nodiscard]] Error startRecorder(const juce::File &directory, double retentionSeconds);
+  [[nodiscard]] Error saveRecording(double seconds);
+
+  // audio callback
+  void audioDeviceIOCallbackWithContext(const float *const *inputChannelData,
+                                        int numInputChannels, float *const *outputChannelData,
+                                        int numOutputChannels, int numSamples,
+                                        const juce::AudioIODeviceCallbackContext &context) override;
+  void audioDeviceAboutToStart(juce::AudioIODevice *device) override;
+  void audioDeviceStopped() override;
 
  private:
-  [[nodiscard]] virtual Error configureDeviceManager(Config const &config);
   [[nodiscard]] virtual Error configureGraph(Config const &config);
 
+ protected:
+  [[nodiscard]] virtual Error configureDeviceManager(Config const &config);
+  [[nodiscard]] Error configureBufferSize(Config const &config);
+  void startAudioCallback();
+
  protected:
   juce::AudioDeviceManager m_deviceManager;
   std::unique_ptr<juce::AudioProcessorGraph> m_mainProcessor;
@@ -91,6 +164,20 @@ class Engine
   juce::AudioProcessorGraph::Node::Ptr m_audioOutputNode;
   std::vector<juce::AudioProcessorGraph::Node::Ptr> m_playerNodes;
   std::vector<juce::AudioProcessorGraph::Node::Ptr> m_synthNodes;
+  juce::AudioProcessorGraph::Node::Ptr m_reverbNode;
+  juce::AudioProcessorGraph::Node::Ptr m_fanOutNode;
+  Sequencer m_sequencer;
+  std::unique_ptr<BufferSizeTuner> m_bufferSizeTuner;
+  OverloadGuard m_overloadGuard;
+  std::atomic<double> m_deviceSampleRate{Config::defaultSampleRate};  //!< For the block duration
+  std::unique_ptr<OutputRecorder> m_recorder;
+  std::atomic<OutputRecorder *> m_recorderTap{nullptr};  //!< Recorder the audio callback feeds
+
+  // real-time mode, the audio thread hardens itself with its next callback
+  rt::ThreadConfig m_audioThreadConfig;
+  std::atomic<bool> m_realtime{false};
+  std::atomic<bool> m_hardenAudioThread{false};
+  std::atomic<int> m_audioThreadReport{-1};  //!< Bit 0 scheduled, bit 1 pinned, negative if unknown
 
  private:
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Engine)
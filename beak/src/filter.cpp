@@ -2,54 +2,26 @@
 
 namespace beak::synth
 {
-
-Filter::Filter() { setType(juce::dsp::StateVariableTPTFilterType::lowpass); }
-
-void Filter::setParams(const Parameters& params) { m_params = params; }
-void Filter::setModulator(const float mod) { m_mod = mod; }
-
-void Filter::update()
+constexpr float minCutoff = 20.0f;     //!< Lowest cutoff frequency in Hz
+constexpr float maxCutoff = 20000.0f;  //!< Highest cutoff frequency in Hz
+constexpr float minResonance = 0.01f;  //!< Keeps the damping finite
+
+/**
+ * @brief Calculates the coefficients for the modulated cutoff frequency and resonance.
+ *
+ * @param sampleRate    The sample rate to use
+ * @param params        The filter parameters
+ * @param mod           Factor applied to the cutoff frequency
+ * @return Coefficients The coefficients of the state variable filter
+ */
+Filter::Coefficients Filter::computeCoefficients(double sampleRate, const Parameters& params,
+                                                 float mod)
 {
-  const auto cutoff = juce::jlimit(20.0f, 20000.0f, (m_params.cutoff * m_mod));
-  selectFilterType(m_params.type);
-  setCutoffFrequency(cutoff);
-  setResonance(m_params.resonance);
+  const auto cutoff = juce::jlimit(minCutoff, maxCutoff, (params.cutoff * mod));
+  Coefficients coeffs;
+  coeffs.g = static_cast<float>(std::tan(juce::MathConstants<double>::pi * cutoff / sampleRate));
+  coeffs.r2 = 1.0f / std::max(params.resonance, minResonance);
+  coeffs.h = 1.0f / (1.0f + coeffs.r2 * coeffs.g + coeffs.g * coeffs.g);
+  return coeffs;
 }
-
-void Filter::prepareToPlay(double sampleRate, int samplesPerBlock, int outputChannels)
-{
-  resetAll();
-  juce::dsp::ProcessSpec spec;
-  spec.maximumBlockSize = samplesPerBlock;
-  spec.sampleRate = sampleRate;
-  spec.numChannels = outputChannels;
-  prepare(spec);
-}
-
-void Filter::selectFilterType(const Type filterType)
-{
-  switch (filterType)
-  {
-    case Type::Lowpass:
-      setType(juce::dsp::StateVariableTPTFilterType::lowpass);
-      break;
-    case Type::Bandpass:
-      setType(juce::dsp::StateVariableTPTFilterType::bandpass);
-      break;
-    case Type::Highpass:
-      setType(juce::dsp::StateVariableTPTFilterType::highpass);
-      break;
-    default:
-      setType(juce::dsp::StateVariableTPTFilterType::lowpass);
-      break;
-  }
-}
-
-float Filter::processNextSample(int channel, float inputValue)
-{
-  update();
-  return processSample(channel, inputValue);
-}
-
-void Filter::resetAll() { reset(); }
 }  // namespace beak::synth
@@ -2,11 +2,17 @@
 
 #include <juce_dsp/juce_dsp.h>
 
-#include "oscillator.h"
-
 namespace beak::synth
 {
-class Filter : public juce::dsp::StateVariableTPTFilter<float>
+/**
+ * @brief State variable filter (TPT structure) with control rate modulation.
+ *
+ * The voice groups run the filter for all their lanes at once, this class holds its parameters and
+ * computes its coefficients. The modulator is evaluated every `controlInterval` samples, between
+ * two control points the coefficients are interpolated linearly, so a filter sweep is smooth
+ * without computing a `tan` for every sample.
+ */
+class Filter
 {
  public:
   enum class Type
@@ -28,21 +34,16 @@ class Filter : public juce::dsp::StateVariableTPTFilter<float>
     float resonance{1};
   };
 
- public:
-  Filter();
-  void prepareToPlay(double sampleRate, int samplesPerBlock, int outputChannels);
-  void setParams(const Parameters& params);
-  void setModulator(const float mod);
-  // void processNextBlock(juce::AudioBuffer<float>& buffer);
-  float processNextSample(int channel, float inputValue);
-  void resetAll();
+  struct Coefficients
+  {
+    float g{0.0f};   //!< frequency warping coefficient
+    float r2{0.0f};  //!< damping, inverse of the resonance
+    float h{0.0f};   //!< normalisation of the high pass output
+  };
 
- private:
-  void selectFilterType(const Type type);
-  void update();
+  static constexpr int controlInterval{16};  //!< Samples between two control points
 
- private:
-  Parameters m_params;
-  float m_mod{1.0f};
+ public:
+  static Coefficients computeCoefficients(double sampleRate, const Parameters& params, float mod);
 };
 }  // namespace beak::synth
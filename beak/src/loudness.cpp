@@ -0,0 +1,240 @@
+#include "loudness.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace beak
+{
+namespace
+{
+constexpr int readBlockSize = 4096;      //!< Frames read from the file at once
+constexpr double gateStepSeconds = 0.1;  //!< Gating blocks of 400 ms overlap by 75 %
+constexpr int stepsPerGateBlock = 4;
+constexpr double relativeGateLu = -10.0;
+constexpr int oversampling = 4;   //!< True peak is measured at four times the sample rate
+constexpr int tapsPerPhase = 12;  //!< Length of the interpolation filter of one phase
+
+/**
+ * @brief Biquad in direct form II transposed, for the K-weighting filter.
+ *
+ */
+struct Biquad
+{
+  double b0{1.0}, b1{0.0}, b2{0.0}, a1{0.0}, a2{0.0};
+  double z1{0.0}, z2{0.0};
+
+  double process(double x)
+  {
+    const double y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    return y;
+  }
+};
+
+/**
+ * @brief K-weighting of BS.1770, a high shelf for the head followed by a high pass.
+ *
+ * The coefficients are derived for the sample rate, the standard only lists them for 48 kHz.
+ */
+struct KWeighting
+{
+  Biquad shelf;
+  Biquad highPass;
+
+  explicit KWeighting(double sampleRate)
+  {
+    {
+      const double f0 = 1681.974450955533;
+      const double gainDb = 3.999843853973347;
+      const double q = 0.7071752369554196;
+      const double k = std::tan(juce::MathConstants<double>::pi * f0 / sampleRate);
+      const double vh = std::pow(10.0, gainDb / 20.0);
+      const double vb = std::pow(vh, 0.4996667741545416);
+      const double a0 = 1.0 + k / q + k * k;
+      shelf.b0 = (vh + vb * k / q + k * k) / a0;
+      shelf.b1 = 2.0 * (k * k - vh) / a0;
+      shelf.b2 = (vh - vb * k / q + k * k) / a0;
+      shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+      shelf.a2 = (1.0 - k / q + k * k) / a0;
+    }
+    {
+      const double f0 = 38.13547087602444;
+      const double q = 0.5003270373238773;
+      const double k = std::tan(juce::MathConstants<double>::pi * f0 / sampleRate);
+      const double a0 = 1.0 + k / q + k * k;
+      highPass.b0 = 1.0;
+      highPass.b1 = -2.0;
+      highPass.b2 = 1.0;
+      highPass.a1 = 2.0 * (k * k - 1.0) / a0;
+      highPass.a2 = (1.0 - k / q + k * k) / a0;
+    }
+  }
+
+  double process(double x) { return highPass.process(shelf.process(x)); }
+};
+
+using Phases = std::array<std::array<double, tapsPerPhase>, oversampling>;
+
+/**
+ * @brief Hann windowed sinc interpolators for the positions between two samples.
+ *
+ * @return Phases Taps of every phase, applied to the samples around the position
+ */
+Phases interpolationPhases()
+{
+  Phases phases{};
+  constexpr double halfSpan = tapsPerPhase / 2.0;
+  for (int phase = 0; phase < oversampling; ++phase)
+  {
+    const double fraction = static_cast<double>(phase) / oversampling;
+    for (int tap = 0; tap < tapsPerPhase; ++tap)
+    {
+      // distance of the tap to the position, taps run from oldest to newest sample
+      const double t = (tap - (tapsPerPhase / 2 - 1)) - fraction;
+      const double x = juce::MathConstants<double>::pi * t;
+      const double sinc = t == 0.0 ? 1.0 : std::sin(x) / x;
+      const double window = 0.5 + 0.5 * std::cos(juce::MathConstants<double>::pi * t / halfSpan);
+      phases[phase][tap] = sinc * window;
+    }
+  }
+  return phases;
+}
+
+double toDb(double gain) { return gain > 0.0 ? 20.0 * std::log10(gain) : -100.0; }
+
+double toLufs(double meanSquare)
+{
+  return meanSquare > 0.0 ? -0.691 + 10.0 * std::log10(meanSquare) : -100.0;
+}
+}  // namespace
+
+/**
+ * @brief Measures the integrated loudness, the peak and the true peak of a sample.
+ *
+ * Follows ITU-R BS.1770-4 with all channels weighted equally. Samples shorter than one gating
+ * block, like clicks, are measured as a whole. The true peak is taken from the signal interpolated
+ * to four times the sample rate. The gain brings the sample to the target loudness, limited by the
+ * true peak ceiling and the maximum boost.
+ *
+ * @param reader  Reader of the sample, read from the start
+ * @return std::tuple<Loudness, Error> The loudness or an error
+ */
+std::tuple<Loudness, Error> analyseLoudness(juce::AudioFormatReader &reader)
+{
+  const auto numChannels = static_cast<int>(reader.numChannels);
+  if (numChannels == 0 || reader.sampleRate <= 0.0)
+  {
+    return {Loudness(), Error("sample has no audio")};
+  }
+
+  const auto stepFrames =
+      std::max(1, static_cast<int>(std::lround(gateStepSeconds * reader.sampleRate)));
+  const Phases phases = interpolationPhases();
+  std::vector<KWeighting> weighting(static_cast<size_t>(numChannels),
+                                    KWeighting(reader.sampleRate));
+  std::vector<std::array<double, tapsPerPhase>> history(static_cast<size_t>(numChannels),
+                                                        std::array<double, tapsPerPhase>{});
+
+  std::vector<double> steps;  //!< Mean square of every step, summed over the channels
+  double stepSum = 0.0;
+  int stepFill = 0;
+  double totalSum = 0.0;
+  juce::int64 totalFrames = 0;
+  double peak = 0.0;
+  double truePeak = 0.0;
+
+  juce::AudioBuffer<float> buffer(numChannels, readBlockSize);
+  for (juce::int64 start = 0; start < reader.lengthInSamples; start += readBlockSize)
+  {
+    const auto numFrames =
+        static_cast<int>(std::min<juce::int64>(readBlockSize, reader.lengthInSamples - start));
+    if (!reader.read(&buffer, 0, numFrames, start, true, true))
+    {
+      return {Loudness(), Error("could not read sample")};
+    }
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+      double energy = 0.0;
+      for (int channel = 0; channel < numChannels; ++channel)
+      {
+        const double x = buffer.getSample(channel, frame);
+        peak = std::max(peak, std::abs(x));
+
+        auto &taps = history[static_cast<size_t>(channel)];
+        std::rotate(taps.begin(), taps.begin() + 1, taps.end());
+        taps.back() = x;
+        for (const auto &phase : phases)
+        {
+          double y = 0.0;
+          for (int tap = 0; tap < tapsPerPhase; ++tap)
+          {
+            y += phase[tap] * taps[tap];
+          }
+          truePeak = std::max(truePeak, std::abs(y));
+        }
+
+        const double weighted = weighting[static_cast<size_t>(channel)].process(x);
+        energy += weighted * weighted;
+      }
+      stepSum += energy;
+      totalSum += energy;
+      ++totalFrames;
+      if (++stepFill == stepFrames)
+      {
+        steps.push_back(stepSum / stepFrames);
+        stepSum = 0.0;
+        stepFill = 0;
+      }
+    }
+  }
+
+  Loudness loudness;
+  loudness.peakDb = toDb(peak);
+  loudness.truePeakDb = toDb(std::max(peak, truePeak));
+
+  // gating blocks of four steps, the gates are applied to the loudness of the blocks
+  std::vector<double> blocks;
+  for (size_t i = 0; i + stepsPerGateBlock <= steps.size(); ++i)
+  {
+    double sum = 0.0;
+    for (size_t j = 0; j < stepsPerGateBlock; ++j)
+    {
+      sum += steps[i + j];
+    }
+    blocks.push_back(sum / stepsPerGateBlock);
+  }
+  if (blocks.empty() && totalFrames > 0)
+  {
+    blocks.push_back(totalSum / static_cast<double>(totalFrames));
+  }
+  const auto gatedMean = [&blocks](double gateLufs)
+  {
+    double sum = 0.0;
+    int count = 0;
+    for (const double block : blocks)
+    {
+      if (toLufs(block) > gateLufs)
+      {
+        sum += block;
+        ++count;
+      }
+    }
+    return count > 0 ? sum / count : 0.0;
+  };
+  const double absoluteGated = gatedMean(Loudness::silenceLufs);
+  if (absoluteGated <= 0.0)
+  {
+    return {loudness, Error()};
+  }
+  loudness.integratedLufs = toLufs(gatedMean(toLufs(absoluteGated) + relativeGateLu));
+
+  const double gainDb =
+      std::min({Loudness::targetLufs - loudness.integratedLufs,
+                Loudness::truePeakCeiling - loudness.truePeakDb, Loudness::maxBoostDb});
+  loudness.gain = static_cast<float>(std::pow(10.0, gainDb / 20.0));
+  return {loudness, Error()};
+}
+}  // namespace beak
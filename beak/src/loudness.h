@@ -0,0 +1,29 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include <tuple>
+
+#include "error.h"
+
+namespace beak
+{
+/**
+ * @brief Loudness of a sample after ITU-R BS.1770, analysed once when it is cached.
+ *
+ */
+struct Loudness
+{
+  static constexpr double targetLufs{-20.0};      //!< Integrated loudness samples are normalised to
+  static constexpr double truePeakCeiling{-1.0};  //!< dBTP a normalised sample never exceeds
+  static constexpr double maxBoostDb{12.0};       //!< Quiet samples are not raised further
+  static constexpr double silenceLufs{-70.0};     //!< Absolute gate, quieter is silence
+
+  double integratedLufs{silenceLufs};  //!< Gated integrated loudness
+  double peakDb{-100.0};               //!< Highest sample
+  double truePeakDb{-100.0};           //!< Highest sample of the 4x oversampled signal
+  float gain{1.0f};                    //!< Linear gain that normalises the sample
+};
+
+[[nodiscard]] std::tuple<Loudness, Error> analyseLoudness(juce::AudioFormatReader &reader);
+}  // namespace beak
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace beak
+{
+/**
+ * @brief Hands the latest value from one thread to another without locks.
+ *
+ * A triple buffer: the writer fills a slot of its own and swaps it with the pending one, the reader
+ * swaps the pending slot with its own if it holds a newer value. Values that were never taken are
+ * replaced, so the reader only ever sees the latest one. Neither side waits or allocates.
+ */
+template <typename T>
+class Mailbox
+{
+ public:
+  /**
+   * @brief Posts a value, must only be called from one thread at a time.
+   *
+   * @param value   The value
+   * @return true   The previous value had not been taken yet and has been replaced
+   */
+  bool post(const T &value)
+  {
+    m_slots[m_writeSlot] = value;
+    const uint32_t previous = m_pending.exchange(m_writeSlot | newBit, std::memory_order_acq_rel);
+    m_writeSlot = previous & slotMask;
+    return (previous & newBit) != 0;
+  }
+
+  /**
+   * @brief Takes the latest value if a new one has been posted, from the reading thread.
+   *
+   * @return const T*  The value, valid until the next call, nullptr if there is none
+   */
+  const T *take()
+  {
+    if ((m_pending.load(std::memory_order_relaxed) & newBit) == 0)
+    {
+      return nullptr;
+    }
+    m_readSlot = m_pending.exchange(m_readSlot, std::memory_order_acq_rel) & slotMask;
+    return &m_slots[m_readSlot];
+  }
+
+ private:
+  static constexpr uint32_t slotMask{3};
+  static constexpr uint32_t newBit{4};
+
+  std::array<T, 3> m_slots{};
+  std::atomic<uint32_t> m_pending{1};  //!< Slot of the latest value, with newBit until taken
+  uint32_t m_writeSlot{0};
+  uint32_t m_readSlot{2};
+};
+}  // namespace beak
@@ -1,66 +1,78 @@
 #include "oscillator.h"
 
+#include <juce_audio_basics/juce_audio_basics.h>
+
 namespace beak::synth
 {
-
-void Oscillator::prepareToPlay(double sampleRate, int samplesPerBlock, int outputChannels)
+/**
+ * @brief Prepares the oscillator for playback.
+ *
+ * Also makes sure all wavetables are computed before the audio thread needs them.
+ *
+ * @param sampleRate The sample rate to use
+ */
+void Oscillator::prepareToPlay(double sampleRate)
 {
+  m_sampleRate = sampleRate;
+  for (auto type : {Type::Sine, Type::Saw, Type::Square, Type::Triangle})
+  {
+    Wavetable::get(type);
+  }
+  setType(m_params.type);
   resetAll();
-
-  juce::dsp::ProcessSpec spec;
-  spec.maximumBlockSize = samplesPerBlock;
-  spec.sampleRate = sampleRate;
-  spec.numChannels = outputChannels;
-
-  prepare(spec);
-  m_osc.prepare(spec);
-  m_gain.prepare(spec);
 }
 
 void Oscillator::setType(const Type oscSelection)
 {
-  switch (oscSelection)
-  {
-    // Sine
-    case Type::Sine:
-      initialise([](float x) { return std::sin(x); });
-      break;
-
-    // Saw
-    case Type::Saw:
-      initialise([](float x) { return x / juce::MathConstants<float>::pi; });
-      break;
-
-    // Square
-    case Type::Square:
-      initialise([](float x) { return x < 0.0f ? -1.0f : 1.0f; });
-      break;
-
-    default:
-      // You shouldn't be here!
-      jassertfalse;
-      break;
-  }
+  m_wavetable = &Wavetable::get(oscSelection);
+  selectTable();
 }
 
-void Oscillator::setGain(const float levelInDecibels) { m_gain.setGainDecibels(levelInDecibels); }
+void Oscillator::setGain(const float levelInDecibels)
+{
+  m_gain = juce::Decibels::decibelsToGain(levelInDecibels);
+}
 
 void Oscillator::setFreq(const int midiNoteNumber)
 {
-  setFrequency(juce::MidiMessage::getMidiNoteInHertz((midiNoteNumber)), true);
+  m_increment = static_cast<float>(juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber) /
+                                   m_sampleRate);
+  selectTable();
 }
 
-void Oscillator::renderNextBlock(juce::dsp::AudioBlock<float>& audioBlock)
+/**
+ * @brief Renders a block of samples into a buffer, overwriting its content.
+ *
+ * @param output      The buffer to write to
+ * @param numSamples  Number of samples to render
+ * @param stride      Distance between two consecutive samples in the buffer
+ */
+void Oscillator::renderNextBlock(float* output, int numSamples, int stride)
 {
-  jassert(audioBlock.getNumSamples() > 0);
-  process(juce::dsp::ProcessContextReplacing<float>(audioBlock));
-  m_osc.process(juce::dsp::ProcessContextReplacing<float>(audioBlock));
-  m_gain.process(juce::dsp::ProcessContextReplacing<float>(audioBlock));
+  jassert(m_table != nullptr);
+  constexpr auto size = static_cast<float>(Wavetable::tableSize);
+  for (int s = 0; s < numSamples; ++s)
+  {
+    const float pos = m_phase * size;
+    const int index = static_cast<int>(pos);
+    const float frac = pos - static_cast<float>(index);
+    const float a = m_table[index];
+    const float b = m_table[index + 1];
+    output[s * stride] = m_gain * (a + frac * (b - a));
+
+    m_phase += m_increment;
+    if (m_phase >= 1.0f)
+    {
+      m_phase -= 1.0f;
+    }
+  }
 }
 
-float Oscillator::processNextSample(float input)
+float Oscillator::processNextSample()
 {
-  return m_gain.processSample(processSample(input));
+  float sample;
+  renderNextBlock(&sample, 1);
+  return sample;
 }
 
 void Oscillator::setParams(const Parameters& params)
@@ -70,10 +82,17 @@ void Oscillator::setParams(const Parameters& params)
   setGain(params.gain);
 }
 
-void Oscillator::resetAll()
+void Oscillator::resetAll() { m_phase = 0.0f; }
+
+/**
+ * @brief Picks the mip level of the current waveform for the current frequency.
+ *
+ */
+void Oscillator::selectTable()
 {
-  reset();
-  m_osc.reset();
-  m_gain.reset();
+  if (m_wavetable != nullptr)
+  {
+    m_table = m_wavetable->getTable(m_increment);
+  }
 }
 }  // namespace beak::synth
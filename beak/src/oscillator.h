@@ -1,41 +1,50 @@
 #pragma once
 
-#include <juce_dsp/juce_dsp.h>
+#include "wavetable.h"
 
 namespace beak::synth
 {
-class Oscillator : public juce::dsp::Oscillator<float>
+/**
+ * @brief Band-limited wavetable oscillator.
+ *
+ * Reads the mip level of the shared Wavetable that fits the played note, so no partial folds
+ * back below the Nyquist frequency.
+ */
+class Oscillator
 {
  public:
-  enum class Type
-  {
-    Sine,
-    Saw,
-    Square
-  };
+  using Type = Waveform;
 
   struct Parameters
   {
     Parameters() = default;
     Parameters(const Type& _type, float _gain) : type(_type), gain(_gain) {}
+    bool operator==(const Parameters& other) const = default;
     Type type{Type::Square};
-    float gain{1.0f};
+    float gain{1.0f};  //!< Gain in decibels
   };
 
  public:
-  void prepareToPlay(double sampleRate, int samplesPerBlock, int outputChannels);
+  void prepareToPlay(double sampleRate);
   void setType(const Type oscSelection);
   void setGain(const float levelInDecibels);
   void setFreq(const int midiNoteNumber);
-  void renderNextBlock(juce::dsp::AudioBlock<float>& audioBlock);
-  float processNextSample(float input);
+  void renderNextBlock(float* output, int numSamples, int stride = 1);
+  float processNextSample();
   void setParams(const Parameters& params);
   Parameters getParams() { return m_params; }
   void resetAll();
 
+ private:
+  void selectTable();
+
  private:
   Parameters m_params;
-  juce::dsp::Gain<float> m_gain;
-  juce::dsp::Oscillator<float> m_osc;
+  double m_sampleRate{44100.0};
+  const Wavetable* m_wavetable{nullptr};
+  const float* m_table{nullptr};
+  float m_gain{1.0f};
+  float m_phase{0.0f};      //!< Position in the cycle from 0 to 1
+  float m_increment{0.0f};  //!< Phase increment per sample
 };
 }  // namespace beak::synth
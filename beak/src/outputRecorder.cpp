@@ -0,0 +1,295 @@
+#include "outputRecorder.h"
+
+#include <plog/Log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace beak
+{
+/**
+ * @brief Construct a new Output Recorder:: Output Recorder object
+ *
+ * @param directory         Directory the chunks and saved files are written to
+ * @param numChannels       Number of channels to record
+ * @param sampleRate        The sample rate of the device
+ * @param retentionSeconds  Chunks older than this are deleted
+ */
+OutputRecorder::OutputRecorder(const juce::File &directory, int numChannels, double sampleRate,
+                               double retentionSeconds) :
+  juce::Thread("beak recorder"),
+  m_directory(directory),
+  m_numChannels(numChannels),
+  m_sampleRate(sampleRate),
+  m_retentionSeconds(retentionSeconds),
+  m_fifo(static_cast<int>(ringSeconds * sampleRate)),
+  m_ring(numChannels, static_cast<int>(ringSeconds * sampleRate))
+{
+  m_formatManager.registerBasicFormats();
+}
+
+/**
+ * @brief Destroy the Output Recorder:: Output Recorder object, writes what is left in the ring.
+ *
+ */
+OutputRecorder::~OutputRecorder() { stopThread(2000); }
+
+/**
+ * @brief Opens the first chunk and starts the writer.
+ *
+ * Chunks of earlier runs in the directory count towards the retention window.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error OutputRecorder::start()
+{
+  if (const auto result = m_directory.createDirectory(); result.failed())
+  {
+    return Error("could not create recording directory: " + result.getErrorMessage());
+  }
+  auto existing = m_directory.findChildFiles(juce::File::findFiles, false,
+                                             juce::String(chunkPrefix) + "*.wav");
+  std::sort(existing.begin(), existing.end());
+  m_chunks.assign(existing.begin(), existing.end());
+  if (auto err = openChunk())
+  {
+    return err;
+  }
+  applyRetention();
+  startThread(juce::Thread::Priority::low);
+  PLOGI << "recording " << m_numChannels << " channels to " << m_directory.getFullPathName()
+        << ", keeping " << m_retentionSeconds << " s";
+  return Error();
+}
+
+/**
+ * @brief Copies a block of the output into the ring, called from the audio callback.
+ *
+ * Never blocks or allocates. The block is dropped if it does not fit.
+ *
+ * @param channels    The output channels of the block
+ * @param numChannels Number of output channels, missing channels are recorded as silence
+ * @param numSamples  Number of samples of the block
+ */
+void OutputRecorder::push(const float *const *channels, int numChannels, int numSamples)
+{
+  if (m_fifo.getFreeSpace() < numSamples)
+  {
+    m_droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  const auto scope = m_fifo.write(numSamples);
+  const auto copy = [this, channels, numChannels](int start, int size, int sourceOffset)
+  {
+    for (int channel = 0; channel < m_numChannels; ++channel)
+    {
+      if (channel < numChannels && channels[channel] != nullptr)
+      {
+        m_ring.copyFrom(channel, start, channels[channel] + sourceOffset, size);
+      }
+      else
+      {
+        m_ring.clear(channel, start, size);
+      }
+    }
+  };
+  copy(scope.startIndex1, scope.blockSize1, 0);
+  copy(scope.startIndex2, scope.blockSize2, scope.blockSize1);
+}
+
+/**
+ * @brief Saves the last seconds of the output into a file of their own, the writer does the work.
+ *
+ * @param seconds Seconds to save, limited by the retention window
+ */
+void OutputRecorder::requestSave(double seconds)
+{
+  m_saveSeconds = std::max(seconds, 1.0 / m_sampleRate);
+  notify();
+}
+
+/**
+ * @brief Number of blocks dropped so far, because the writer could not keep up.
+ *
+ * @return int Number of blocks
+ */
+int OutputRecorder::droppedBlocks() const { return m_droppedBlocks.load(); }
+
+/**
+ * @brief Writes the ring to disk until the thread is stopped and handles save requests.
+ *
+ */
+void OutputRecorder::run()
+{
+  while (!threadShouldExit())
+  {
+    writeReady();
+    if (const double seconds = m_saveSeconds.exchange(0.0); seconds > 0.0)
+    {
+      if (auto err = save(seconds))
+      {
+        PLOGE << err.what();
+      }
+    }
+    if (const int dropped = m_droppedBlocks.load(); dropped != m_reportedDropped)
+    {
+      PLOGW << "recorder dropped " << dropped - m_reportedDropped << " blocks, disk too slow";
+      m_reportedDropped = dropped;
+    }
+    wait(writerPollMs);
+  }
+  writeReady();
+  closeChunk();
+}
+
+/**
+ * @brief Writes all audio of the ring to the chunks, starts a new chunk when one is full.
+ *
+ */
+void OutputRecorder::writeReady()
+{
+  const auto framesPerChunk = static_cast<juce::int64>(chunkSeconds * m_sampleRate);
+  int remaining = m_fifo.getNumReady();
+  while (remaining > 0)
+  {
+    const auto numFrames =
+        static_cast<int>(std::min<juce::int64>(remaining, framesPerChunk - m_chunkFrames));
+    const auto scope = m_fifo.read(numFrames);
+    if (m_writer)
+    {
+      m_writer->writeFromAudioSampleBuffer(m_ring, scope.startIndex1, scope.blockSize1);
+      m_writer->writeFromAudioSampleBuffer(m_ring, scope.startIndex2, scope.blockSize2);
+    }
+    m_chunkFrames += numFrames;
+    remaining -= numFrames;
+
+    if (m_chunkFrames >= framesPerChunk)
+    {
+      closeChunk();
+      if (auto err = openChunk())
+      {
+        PLOGE << err.what();
+      }
+      applyRetention();
+    }
+  }
+}
+
+/**
+ * @brief Starts a new chunk named after the current time.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error OutputRecorder::openChunk()
+{
+  const auto file = m_directory.getChildFile(
+      chunkPrefix + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + ".wav");
+  m_chunkFrames = 0;
+  m_writer = createWriter(file);
+  if (!m_writer)
+  {
+    return Error("could not create recording chunk " + file.getFullPathName());
+  }
+  m_chunks.push_back(file);
+  return Error();
+}
+
+/**
+ * @brief Finishes the chunk being written.
+ *
+ */
+void OutputRecorder::closeChunk()
+{
+  m_writer.reset();
+  m_chunkFrames = 0;
+}
+
+/**
+ * @brief Deletes the oldest chunks outside of the retention window.
+ *
+ */
+void OutputRecorder::applyRetention()
+{
+  // the chunk being written is not full yet, so one more is kept
+  const auto maxChunks = static_cast<size_t>(std::ceil(m_retentionSeconds / chunkSeconds)) + 1;
+  while (m_chunks.size() > maxChunks)
+  {
+    m_chunks.front().deleteFile();
+    m_chunks.pop_front();
+  }
+}
+
+/**
+ * @brief Copies the last seconds of the chunks into a file of their own.
+ *
+ * @param seconds Seconds to save
+ * @return Error  Custom error to signal a failure
+ */
+Error OutputRecorder::save(double seconds)
+{
+  // write the header, so the chunk being written can be read up to here
+  if (m_writer)
+  {
+    m_writer->flush();
+  }
+
+  auto framesLeft = static_cast<juce::int64>(seconds * m_sampleRate);
+  std::vector<std::unique_ptr<juce::AudioFormatReader>> readers;  //!< Newest first
+  std::vector<juce::int64> starts;
+  for (auto chunk = m_chunks.rbegin(); chunk != m_chunks.rend() && framesLeft > 0; ++chunk)
+  {
+    std::unique_ptr<juce::AudioFormatReader> reader(m_formatManager.createReaderFor(*chunk));
+    if (!reader)
+    {
+      continue;
+    }
+    const juce::int64 start = std::max<juce::int64>(reader->lengthInSamples - framesLeft, 0);
+    framesLeft -= reader->lengthInSamples - start;
+    starts.push_back(start);
+    readers.push_back(std::move(reader));
+  }
+  if (readers.empty())
+  {
+    return Error("nothing recorded yet");
+  }
+
+  const auto file = m_directory.getChildFile(
+      savePrefix + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + ".wav");
+  auto writer = createWriter(file);
+  if (!writer)
+  {
+    return Error("could not create " + file.getFullPathName());
+  }
+  for (size_t i = readers.size(); i-- > 0;)
+  {
+    writer->writeFromAudioReader(*readers[i], starts[i], readers[i]->lengthInSamples - starts[i]);
+  }
+  PLOGI << "saved the last " << seconds << " s of the output to " << file.getFullPathName();
+  return Error();
+}
+
+/**
+ * @brief Creates a WAV writer for all channels, replaces an existing file.
+ *
+ * @param file  The file to write
+ * @return std::unique_ptr<juce::AudioFormatWriter> The writer, nullptr on failure
+ */
+std::unique_ptr<juce::AudioFormatWriter> OutputRecorder::createWriter(const juce::File &file)
+{
+  file.deleteFile();
+  auto stream = file.createOutputStream();
+  if (!stream)
+  {
+    return nullptr;
+  }
+  // the writer owns the stream once it has been created
+  std::unique_ptr<juce::AudioFormatWriter> writer(m_format.createWriterFor(
+      stream.get(), m_sampleRate, static_cast<unsigned int>(m_numChannels), bitsPerSample, {}, 0));
+  if (writer)
+  {
+    stream.release();
+  }
+  return writer;
+}
+}  // namespace beak
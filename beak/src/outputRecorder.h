@@ -0,0 +1,78 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+
+#include "error.h"
+
+namespace beak
+{
+/**
+ * @brief Black box of the final output of all channels.
+ *
+ * The audio callback copies every block into a lock-free ring, a thread of its own writes the ring
+ * to disk as multichannel WAV files of one chunk each. Chunks older than the retention window are
+ * deleted. The last seconds can be saved into a file of their own on demand. Blocks that do not fit
+ * into the ring, because the disk stalls, are dropped and counted.
+ */
+class OutputRecorder : private juce::Thread
+{
+ public:
+  static constexpr const char *chunkPrefix = "beak-rec-";
+  static constexpr const char *savePrefix = "beak-save-";
+  static constexpr double ringSeconds{10.0};   //!< Disk stalls up to this long do not drop audio
+  static constexpr double chunkSeconds{60.0};  //!< Length of one file
+  static constexpr int bitsPerSample{16};
+  static constexpr int writerPollMs{20};  //!< Interval in which the writer looks for audio
+
+ public:
+  OutputRecorder(const juce::File &directory, int numChannels, double sampleRate,
+                 double retentionSeconds);
+  ~OutputRecorder() override;
+  OutputRecorder(const OutputRecorder &) = delete;
+  OutputRecorder &operator=(const OutputRecorder &) = delete;
+
+  [[nodiscard]] Error start();
+
+  // audio thread
+  void push(const float *const *channels, int numChannels, int numSamples);
+
+  // any thread
+  void requestSave(double seconds);
+  int droppedBlocks() const;
+
+ private:
+  void run() override;
+  void writeReady();
+  [[nodiscard]] Error openChunk();
+  void closeChunk();
+  void applyRetention();
+  [[nodiscard]] Error save(double seconds);
+  std::unique_ptr<juce::AudioFormatWriter> createWriter(const juce::File &file);
+
+ private:
+  juce::File m_directory;
+  int m_numChannels;
+  double m_sampleRate;
+  double m_retentionSeconds;
+
+  // ring between the audio and the writer thread
+  juce::AbstractFifo m_fifo;
+  juce::AudioBuffer<float> m_ring;
+  std::atomic<int> m_droppedBlocks{0};
+  std::atomic<double> m_saveSeconds{0.0};  //!< Pending save request, 0 if none
+
+  // writer thread
+  juce::WavAudioFormat m_format;
+  juce::AudioFormatManager m_formatManager;
+  std::unique_ptr<juce::AudioFormatWriter> m_writer;
+  std::deque<juce::File> m_chunks;  //!< Oldest first, the last one is being written
+  juce::int64 m_chunkFrames{0};     //!< Frames in the chunk being written
+  int m_reportedDropped{0};
+};
+}  // namespace beak
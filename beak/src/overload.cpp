@@ -0,0 +1,216 @@
+#include "overload.h"
+
+#include <plog/Log.h>
+
+#include <algorithm>
+
+namespace beak
+{
+/**
+ * @brief Name of a degradation level for the log.
+ *
+ * @param level         The level
+ * @return const char*  The name
+ */
+const char *toString(Degradation level)
+{
+  switch (level)
+  {
+    case Degradation::None:
+      return "none";
+    case Degradation::QuietReverb:
+      return "quiet reverb";
+    case Degradation::ShedVoices:
+      return "shed voices";
+    case Degradation::RefuseTriggers:
+      return "refuse triggers";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Construct a new Overload Guard:: Overload Guard object and starts logging level changes.
+ *
+ */
+OverloadGuard::OverloadGuard() { startTimer(logIntervalMs); }
+
+/**
+ * @brief Destroy the Overload Guard:: Overload Guard object
+ *
+ */
+OverloadGuard::~OverloadGuard() { stopTimer(); }
+
+/**
+ * @brief Adds the time of one audio callback and adjusts the level.
+ *
+ * @param elapsedSeconds  Time the callback took
+ * @param blockSeconds    Duration of the block, the deadline of the callback
+ */
+void OverloadGuard::measure(double elapsedSeconds, double blockSeconds)
+{
+  if (blockSeconds <= 0.0)
+  {
+    return;
+  }
+  const double load = elapsedSeconds / blockSeconds;
+  m_smoothedLoad += (load - m_smoothedLoad) * smoothing;
+  m_load.store(m_smoothedLoad, std::memory_order_relaxed);
+  if (load > m_peakLoad.load(std::memory_order_relaxed))
+  {
+    m_peakLoad.store(load, std::memory_order_relaxed);
+  }
+
+  const auto current = m_level.load(std::memory_order_relaxed);
+  auto target = Degradation::None;
+  for (const auto level :
+       {Degradation::QuietReverb, Degradation::ShedVoices, Degradation::RefuseTriggers})
+  {
+    if (m_smoothedLoad > threshold(level))
+    {
+      target = level;
+    }
+  }
+  // a missed deadline is audible right away, so it escalates without waiting for the average
+  if (load > 1.0)
+  {
+    m_overruns.fetch_add(1, std::memory_order_relaxed);
+    target = std::max(target, static_cast<Degradation>(std::min(
+                                  static_cast<int>(current) + 1,
+                                  static_cast<int>(Degradation::RefuseTriggers))));
+  }
+
+  if (target > current)
+  {
+    m_level.store(target, std::memory_order_relaxed);
+    m_recoveryTime = 0.0;
+  }
+  else if (current != Degradation::None &&
+           m_smoothedLoad < threshold(current) - recoveryMargin)
+  {
+    m_recoveryTime += blockSeconds;
+    if (m_recoveryTime >= recoverySeconds)
+    {
+      m_level.store(static_cast<Degradation>(static_cast<int>(current) - 1),
+                    std::memory_order_relaxed);
+      m_recoveryTime = 0.0;
+    }
+  }
+  else
+  {
+    m_recoveryTime = 0.0;
+  }
+}
+
+/**
+ * @brief Counts voices that have been shed by a processor.
+ *
+ * @param numVoices Number of voices
+ */
+void OverloadGuard::countShed(int numVoices)
+{
+  if (numVoices > 0)
+  {
+    m_shedVoices.fetch_add(numVoices, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief The current degradation level.
+ *
+ * @return Degradation The level
+ */
+Degradation OverloadGuard::level() const { return m_level.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Sets the priority a sound needs to be played while triggers are refused.
+ *
+ * @param priority The lowest priority that is still played
+ */
+void OverloadGuard::setPriorityThreshold(int priority) { m_priorityThreshold = priority; }
+
+/**
+ * @brief Checks if a new sound may be played, counts the refused ones.
+ *
+ * @param priority  Priority of the sound
+ * @return true     The sound may be played
+ */
+bool OverloadGuard::admits(int priority)
+{
+  if (level() < Degradation::RefuseTriggers || priority >= m_priorityThreshold.load())
+  {
+    return true;
+  }
+  m_refusedTriggers.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+/**
+ * @brief Snapshot of the load and the degradation.
+ *
+ * @return Stats The stats
+ */
+OverloadGuard::Stats OverloadGuard::stats() const
+{
+  return {level(),
+          m_load.load(std::memory_order_relaxed),
+          m_peakLoad.load(std::memory_order_relaxed),
+          m_overruns.load(std::memory_order_relaxed),
+          m_shedVoices.load(std::memory_order_relaxed),
+          m_refusedTriggers.load(std::memory_order_relaxed)};
+}
+
+/**
+ * @brief Logs level changes and what has been dropped since the last check.
+ *
+ */
+void OverloadGuard::timerCallback()
+{
+  const Stats current = stats();
+  m_peakLoad.store(0.0, std::memory_order_relaxed);
+  const int overruns = current.overruns - m_loggedStats.overruns;
+  const int shed = current.shedVoices - m_loggedStats.shedVoices;
+  const int refused = current.refusedTriggers - m_loggedStats.refusedTriggers;
+  m_loggedStats = current;
+  if (current.level == m_loggedLevel && overruns == 0 && shed == 0 && refused == 0)
+  {
+    return;
+  }
+
+  const auto message = juce::String("overload: ") + toString(current.level) + ", " +
+                       juce::String(juce::roundToInt(current.load * 100.0)) + "% load, " +
+                       juce::String(juce::roundToInt(current.peakLoad * 100.0)) + "% peak, " +
+                       juce::String(overruns) + " overruns, " + juce::String(shed) +
+                       " voices shed, " + juce::String(refused) + " triggers refused";
+  if (current.level > m_loggedLevel || overruns > 0)
+  {
+    PLOGW << message;
+  }
+  else
+  {
+    PLOGI << message;
+  }
+  m_loggedLevel = current.level;
+}
+
+/**
+ * @brief Smoothed load above which a level is entered.
+ *
+ * @param level   The level
+ * @return double The load
+ */
+double OverloadGuard::threshold(Degradation level)
+{
+  switch (level)
+  {
+    case Degradation::None:
+      return 0.0;
+    case Degradation::QuietReverb:
+      return quietReverbLoad;
+    case Degradation::ShedVoices:
+      return shedVoicesLoad;
+    case Degradation::RefuseTriggers:
+      return refuseTriggersLoad;
+  }
+  return 0.0;
+}
+}  // namespace beak
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <juce_events/juce_events.h>
+
+#include <atomic>
+
+namespace beak
+{
+/**
+ * @brief Steps the engine takes to keep the audio callback within its deadline, each one includes
+ * the ones before it.
+ *
+ */
+enum class Degradation
+{
+  None,            //!< Everything is rendered
+  QuietReverb,     //!< Quiet channels are not sent to the reverb, which skips its tail
+  ShedVoices,      //!< The quietest voices of the lowest priority are faded out
+  RefuseTriggers,  //!< New sounds below the priority threshold are refused
+};
+
+const char *toString(Degradation level);
+
+/**
+ * @brief Measures the audio callback against the block deadline and degrades the engine gracefully
+ * when it gets close.
+ *
+ * The level is raised as soon as the smoothed load crosses its threshold, or by one step with
+ * every block that overruns its deadline. It is lowered one step at a time once the load has
+ * stayed clearly below the threshold for a while. Level changes are logged on the message thread.
+ */
+class OverloadGuard : private juce::Timer
+{
+ public:
+  static constexpr double quietReverbLoad{0.6};     //!< Load above which quiet sends are skipped
+  static constexpr double shedVoicesLoad{0.75};     //!< Load above which voices are shed
+  static constexpr double refuseTriggersLoad{0.9};  //!< Load above which sounds are refused
+  static constexpr double recoveryMargin{0.1};      //!< Load below a threshold to leave its level
+  static constexpr double recoverySeconds{2.0};     //!< Time below that until a level is left
+  static constexpr double smoothing{0.1};           //!< Weight of the latest block in the load
+  static constexpr int shedVoiceLimit{4};           //!< Voices per processor while shedding
+  static constexpr int defaultPriorityThreshold{1};
+  static constexpr int logIntervalMs{1000};
+
+  /**
+   * @brief Snapshot of the load and the degradation.
+   *
+   */
+  struct Stats
+  {
+    Degradation level{Degradation::None};
+    double load{0.0};      //!< Smoothed callback time relative to the block duration
+    double peakLoad{0.0};  //!< Highest load of a single block within the last second
+    int overruns{0};       //!< Blocks that took longer than their duration
+    int shedVoices{0};
+    int refusedTriggers{0};
+  };
+
+ public:
+  OverloadGuard();
+  ~OverloadGuard() override;
+
+  // audio thread
+  void measure(double elapsedSeconds, double blockSeconds);
+  void countShed(int numVoices);
+
+  // any thread
+  Degradation level() const;
+  void setPriorityThreshold(int priority);
+  [[nodiscard]] bool admits(int priority);
+  Stats stats() const;
+
+ private:
+  void timerCallback() override;
+  static double threshold(Degradation level);
+
+ private:
+  std::atomic<Degradation> m_level{Degradation::None};
+  std::atomic<double> m_load{0.0};
+  std::atomic<double> m_peakLoad{0.0};
+  std::atomic<int> m_overruns{0};
+  std::atomic<int> m_shedVoices{0};
+  std::atomic<int> m_refusedTriggers{0};
+  std::atomic<int> m_priorityThreshold{defaultPriorityThreshold};
+
+  // audio thread
+  double m_smoothedLoad{0.0};
+  double m_recoveryTime{0.0};  //!< Time the load has been below the threshold of the level
+
+  // message thread
+  Degradation m_loggedLevel{Degradation::None};
+  Stats m_loggedStats;
+};
+}  // namespace beak
@@ -0,0 +1,200 @@
+#include "patchTable.h"
+
+#include <fmt/format.h>
+
+namespace beak
+{
+/**
+ * @brief Translates a waveform from the protocol.
+ *
+ * @param waveform                  The waveform of the protocol
+ * @return synth::Oscillator::Type  The waveform of the oscillator
+ */
+static synth::Oscillator::Type translateWaveform(SynthWaveform waveform)
+{
+  switch (waveform)
+  {
+    case SynthWaveform::SAW:
+      return synth::Oscillator::Type::Saw;
+    case SynthWaveform::SQUARE:
+      return synth::Oscillator::Type::Square;
+    case SynthWaveform::TRIANGLE:
+      return synth::Oscillator::Type::Triangle;
+    case SynthWaveform::SINE:
+    default:
+      return synth::Oscillator::Type::Sine;
+  }
+}
+
+/**
+ * @brief Translates a filter type from the protocol.
+ *
+ * @param filterType            The filter type of the protocol
+ * @return synth::Filter::Type  The type of the filter
+ */
+static synth::Filter::Type translateFilterType(SynthFilterType filterType)
+{
+  switch (filterType)
+  {
+    case SynthFilterType::HIGHPASS:
+      return synth::Filter::Type::Highpass;
+    case SynthFilterType::BANDPASS:
+      return synth::Filter::Type::Bandpass;
+    case SynthFilterType::LOWPASS:
+    default:
+      return synth::Filter::Type::Lowpass;
+  }
+}
+
+/**
+ * @brief Translates a synth config of the protocol into a patch.
+ *
+ * @param config  The config to translate
+ * @return Patch  The patch
+ */
+Patch Patch::fromConfig(const SynthConfig &config)
+{
+  Patch patch;
+  patch.osc = synth::Oscillator::Parameters(translateWaveform(config.wave_form()), config.gain());
+
+  const auto &adsrConfig = config.adsr_config();
+  patch.adsr = juce::ADSR::Parameters(adsrConfig.attack(), adsrConfig.decay(),
+                                      adsrConfig.sustain(), adsrConfig.release());
+
+  patch.filter = synth::Filter::Parameters(translateFilterType(config.filter_type()),
+                                           config.cutoff(), config.resonance());
+  const auto &filterAdsrConfig = config.filter_adsr_config();
+  patch.filterAdsr =
+      juce::ADSR::Parameters(filterAdsrConfig.attack(), filterAdsrConfig.decay(),
+                             filterAdsrConfig.sustain(), filterAdsrConfig.release());
+
+  patch.polyphony = static_cast<int>(config.polyphony());
+
+  // the channel keeps its reverb send if there is no reverb config
+  patch.hasReverb = config.has_reverb_config();
+  if (patch.hasReverb)
+  {
+    const auto &reverbConfig = config.reverb_config();
+    patch.reverb.roomSize = reverbConfig.room_size();
+    patch.reverb.width = reverbConfig.width();
+    patch.reverb.damping = reverbConfig.damping();
+    patch.reverb.freezeMode = reverbConfig.freeze_mode();
+    patch.reverb.wetLevel = reverbConfig.wet_level();
+    patch.reverbSpread = reverbConfig.spread();
+  }
+  return patch;
+}
+
+/**
+ * @brief Returns a copy of the patch with the set overrides applied.
+ *
+ * @param overrides Overrides of a note, unset values are zero
+ * @return Patch    The changed patch
+ */
+Patch Patch::withOverrides(const SynthPatchOverrides &overrides) const
+{
+  Patch patch = *this;
+  if (overrides.cutoff() > 0.0f)
+  {
+    patch.filter.cutoff = overrides.cutoff();
+  }
+  if (overrides.resonance() > 0.0f)
+  {
+    patch.filter.resonance = overrides.resonance();
+  }
+  return patch;
+}
+
+/**
+ * @brief Checks if two envelopes have the same parameters.
+ *
+ * @param a     The first envelope
+ * @param b     The second envelope
+ * @return true The envelopes are the same
+ */
+static bool isSameEnvelope(const juce::ADSR::Parameters &a, const juce::ADSR::Parameters &b)
+{
+  return a.attack == b.attack && a.decay == b.decay && a.sustain == b.sustain &&
+         a.release == b.release;
+}
+
+/**
+ * @brief Checks if two patches configure a channel the same way.
+ *
+ * @param other The other patch
+ * @return true The patches are the same
+ */
+bool Patch::operator==(const Patch &other) const
+{
+  const bool isSameReverb =
+      hasReverb == other.hasReverb &&
+      (!hasReverb ||
+       (reverb.roomSize == other.reverb.roomSize && reverb.damping == other.reverb.damping &&
+        reverb.wetLevel == other.reverb.wetLevel && reverb.dryLevel == other.reverb.dryLevel &&
+        reverb.width == other.reverb.width && reverb.freezeMode == other.reverb.freezeMode &&
+        reverbSpread == other.reverbSpread));
+  return osc == other.osc && isSameEnvelope(adsr, other.adsr) && filter.type == other.filter.type &&
+         filter.cutoff == other.filter.cutoff && filter.resonance == other.filter.resonance &&
+         isSameEnvelope(filterAdsr, other.filterAdsr) && polyphony == other.polyphony &&
+         isSameReverb;
+}
+
+/**
+ * @brief Registers a patch, replacing any patch with the same id.
+ *
+ * Channels using a replaced patch are reconfigured with their next note.
+ *
+ * @param patchId Id of the patch, 0 is reserved for notes without a patch
+ * @param config  Config of the patch
+ * @return Error  Custom error to signal a failure
+ */
+Error PatchTable::registerPatch(uint32_t patchId, const SynthConfig &config)
+{
+  if (patchId == 0)
+  {
+    return Error("patch id 0 is reserved");
+  }
+  m_patches.insert_or_assign(patchId, Entry{Patch::fromConfig(config), m_nextRevision++});
+  return Error();
+}
+
+/**
+ * @brief Selects a patch for a channel.
+ *
+ * @param channel   The channel
+ * @param patchId   Id of a registered patch
+ * @param overrides Overrides of the note
+ * @return std::tuple<std::optional<Patch>, Error> The patch to configure the channel with, empty if
+ *                                                  the channel already uses it
+ */
+std::tuple<std::optional<Patch>, Error> PatchTable::select(int channel, uint32_t patchId,
+                                                           const SynthPatchOverrides &overrides)
+{
+  const auto entry = m_patches.find(patchId);
+  if (entry == m_patches.end())
+  {
+    return {std::nullopt, Error(fmt::format("unknown patch id {}", patchId))};
+  }
+
+  const Selection selection{patchId, entry->second.revision, overrides.cutoff(),
+                            overrides.resonance()};
+  if (const auto current = m_selections.find(channel); current != m_selections.end())
+  {
+    const auto &previous = current->second;
+    if (previous.patchId == selection.patchId && previous.revision == selection.revision &&
+        previous.cutoff == selection.cutoff && previous.resonance == selection.resonance)
+    {
+      return {std::nullopt, Error()};
+    }
+  }
+  m_selections.insert_or_assign(channel, selection);
+  return {entry->second.patch.withOverrides(overrides), Error()};
+}
+
+/**
+ * @brief Forgets the patch of a channel, after it has been configured without one.
+ *
+ * @param channel The channel
+ */
+void PatchTable::invalidate(int channel) { m_selections.erase(channel); }
+}  // namespace beak
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+#include <map>
+#include <optional>
+#include <tuple>
+
+#include "error.h"
+#include "filter.h"
+#include "oscillator.h"
+#include "proto.h"
+
+namespace beak
+{
+/**
+ * @brief Synthesiser configuration of a channel, translated from a SynthConfig.
+ *
+ */
+struct Patch
+{
+  synth::Oscillator::Parameters osc;
+  juce::ADSR::Parameters adsr;
+  synth::Filter::Parameters filter;
+  juce::ADSR::Parameters filterAdsr;
+  int polyphony{0};
+  bool hasReverb{false};
+  juce::Reverb::Parameters reverb;
+  float reverbSpread{0.0f};
+
+  static Patch fromConfig(const SynthConfig &config);
+  Patch withOverrides(const SynthPatchOverrides &overrides) const;
+  bool operator==(const Patch &other) const;
+};
+
+/**
+ * @brief Patches registered by the clients, referenced by id in note events.
+ *
+ * Remembers which patch every channel uses, so a channel is only reconfigured if the patch, its
+ * overrides or the registered patch itself changed. Only used from the network thread.
+ */
+class PatchTable
+{
+ public:
+  [[nodiscard]] Error registerPatch(uint32_t patchId, const SynthConfig &config);
+  [[nodiscard]] std::tuple<std::optional<Patch>, Error> select(
+      int channel, uint32_t patchId, const SynthPatchOverrides &overrides);
+  void invalidate(int channel);
+
+ private:
+  struct Entry
+  {
+    Patch patch;
+    uint64_t revision;
+  };
+
+  struct Selection
+  {
+    uint32_t patchId;
+    uint64_t revision;
+    float cutoff;
+    float resonance;
+  };
+
+ private:
+  std::map<uint32_t, Entry> m_patches;
+  std::map<int, Selection> m_selections;
+  uint64_t m_nextRevision{1};
+};
+}  // namespace beak
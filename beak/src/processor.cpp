@@ -1,69 +1,678 @@
 #include "processor.h"
 
+#include "rtCheck.h"
+
 namespace beak
 {
 
-/* ---------------------------- panning processor --------------------------- */
 /**
- * @brief Construct a new Panning Processor:: Panning Processor object
+ * @brief Position of a channel between the left (0) and the right (1) end of the speaker line.
+ *
+ * @param channel     The channel index
+ * @param numChannels Number of channels
+ * @return float      The position
+ */
+static float channelPosition(int channel, int numChannels)
+{
+  return numChannels > 1 ? static_cast<float>(channel) / static_cast<float>(numChannels - 1)
+                         : 0.5f;
+}
+
+/* --------------------------- downmix processor ---------------------------- */
+constexpr float surroundSpan = 110.0f;  //!< Angle of the surround speakers from the center
+constexpr float crossfeed = 0.3f;       //!< Level of the opposite side in headphones
+
+/**
+ * @brief Constant power gains of one channel on the speakers of a layout.
+ *
+ * @param layout    The layout
+ * @param position  Position of the channel between the left (0) and the right (1) end
+ * @param gains     Receives the gain of every speaker of the layout
+ */
+static void downmixGains(DownmixLayout layout, float position, float *gains)
+{
+  const auto pan = [](float fraction, float &left, float &right)
+  {
+    left = std::cos(fraction * juce::MathConstants<float>::halfPi);
+    right = std::sin(fraction * juce::MathConstants<float>::halfPi);
+  };
+
+  switch (layout)
+  {
+    case DownmixLayout::Stereo:
+      pan(position, gains[0], gains[1]);
+      break;
+    case DownmixLayout::Headphones:
+    {
+      float left = 0.0f;
+      float right = 0.0f;
+      pan(position, left, right);
+      gains[0] = left + crossfeed * right;
+      gains[1] = right + crossfeed * left;
+      const float norm = 1.0f / std::sqrt(gains[0] * gains[0] + gains[1] * gains[1]);
+      gains[0] *= norm;
+      gains[1] *= norm;
+      break;
+    }
+    case DownmixLayout::Surround51:
+    {
+      // speakers from left to right with their angles, in the order of the JUCE 5.1 channel set
+      constexpr std::array<int, 5> speakers{4, 0, 2, 1, 5};  // Ls, L, C, R, Rs
+      constexpr std::array<float, 5> angles{-surroundSpan, -30.0f, 0.0f, 30.0f, surroundSpan};
+      std::fill(gains, gains + 6, 0.0f);
+      const float angle = (position * 2.0f - 1.0f) * surroundSpan;
+      size_t pair = 0;
+      while (pair + 2 < angles.size() && angle > angles[pair + 1])
+      {
+        ++pair;
+      }
+      const float fraction =
+          juce::jlimit(0.0f, 1.0f, (angle - angles[pair]) / (angles[pair + 1] - angles[pair]));
+      pan(fraction, gains[speakers[pair]], gains[speakers[pair + 1]]);
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Speakers of a layout.
+ *
+ * @param layout                The layout
+ * @return juce::AudioChannelSet The channels of the layout
+ */
+juce::AudioChannelSet DownmixProcessor::channelSet(DownmixLayout layout)
+{
+  return layout == DownmixLayout::Surround51 ? juce::AudioChannelSet::create5point1()
+                                             : juce::AudioChannelSet::stereo();
+}
+
+/**
+ * @brief Construct a new Downmix Processor:: Downmix Processor object
+ *
+ * @param numInputs Number of channels to mix down
+ * @param layout    Speaker layout of the outputs
+ */
+DownmixProcessor::DownmixProcessor(int numInputs, DownmixLayout layout) :
+  ProcessorBase(BusesProperties()
+                    .withInput("Input", juce::AudioChannelSet::discreteChannels(numInputs))
+                    .withOutput("Output", channelSet(layout))),
+  m_numInputs(numInputs),
+  m_numOutputs(channelSet(layout).size()),
+  m_matrix(static_cast<size_t>(m_numInputs * m_numOutputs))
+{
+  std::vector<float> gains(m_numOutputs);
+  for (int i = 0; i < m_numInputs; ++i)
+  {
+    downmixGains(layout, channelPosition(i, m_numInputs), gains.data());
+    for (int output = 0; output < m_numOutputs; ++output)
+    {
+      m_matrix[output * m_numInputs + i] = gains[output];
+    }
+  }
+}
+
+/**
+ * @brief Destroy the Downmix Processor:: Downmix Processor object
+ *
+ */
+DownmixProcessor::~DownmixProcessor() = default;
+
+/**
+ * @brief Reimplemented, the downmix has no state.
+ *
+ */
+void DownmixProcessor::reset() {}
+
+/**
+ * @brief Reimplemented to release the mix buffer.
+ *
+ */
+void DownmixProcessor::releaseResources() { m_mix.setSize(0, 0); }
+
+/**
+ * @brief Reimplemented to prepare the mix buffer.
+ *
+ * @param samplesPerBlock The expected samples per block
+ */
+void DownmixProcessor::prepareToPlay(double, int samplesPerBlock)
+{
+  m_mix.setSize(m_numOutputs, samplesPerBlock);
+}
+
+/**
+ * @brief Reimplemented to replace the channels in the buffer with the speakers of the layout.
+ *
+ * Channels that are silent in the block are skipped.
+ *
+ * @param buffer Buffer holding all channels, receives the speakers
+ */
+void DownmixProcessor::processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &)
+{
+  BEAK_RT_AUDIO_SCOPE;
+  const int numInputs = std::min(m_numInputs, buffer.getNumChannels());
+  const int numOutputs = std::min(m_numOutputs, buffer.getNumChannels());
+  const int chunkSize = m_mix.getNumSamples();
+  if (chunkSize == 0)
+  {
+    buffer.clear();
+    return;
+  }
+
+  for (int start = 0; start < buffer.getNumSamples(); start += chunkSize)
+  {
+    const int numSamples = std::min(chunkSize, buffer.getNumSamples() - start);
+    m_mix.clear();
+    for (int i = 0; i < numInputs; ++i)
+    {
+      if (buffer.getMagnitude(i, start, numSamples) == 0.0f)
+      {
+        continue;
+      }
+      const auto *input = buffer.getReadPointer(i, start);
+      for (int output = 0; output < numOutputs; ++output)
+      {
+        const float gain = m_matrix[output * m_numInputs + i];
+        if (gain != 0.0f)
+        {
+          juce::FloatVectorOperations::addWithMultiply(m_mix.getWritePointer(output), input,
+                                                       gain, numSamples);
+        }
+      }
+    }
+    for (int output = 0; output < numOutputs; ++output)
+    {
+      buffer.copyFrom(output, start, m_mix, output, 0, numSamples);
+    }
+    for (int channel = numOutputs; channel < buffer.getNumChannels(); ++channel)
+    {
+      buffer.clear(channel, start, numSamples);
+    }
+  }
+}
+
+/* ---------------------------- reverb processor ---------------------------- */
+constexpr float tailThreshold = 1.0e-5f;  //!< Level (-100 dB) below which the tail is cut to zero
+constexpr double tailHoldSeconds = 0.1;   //!< Longer than the delay lines of the reverb
+constexpr float quietSendLevel = 0.05f;   //!< Level (-26 dB) of sends that are skipped under load
+
+/**
+ * @brief Construct a new Reverb Processor:: Reverb Processor object
  *
- * @param inputNum  The input number this panning processor uses
- * @param maxInputs The maximum number of inputs (used to calculate panning position)
+ * @param numChannels Number of channels, each one has a send input and a return output
  */
-PanningProcessor::PanningProcessor(int inputNum, int maxInputs) :
+ReverbProcessor::ReverbProcessor(int numChannels) :
   ProcessorBase(BusesProperties()
-                    .withInput("Input", juce::AudioChannelSet::stereo())
-                    .withOutput("Output", juce::AudioChannelSet::stereo())),
-  m_inputNum(inputNum),
-  m_maxInputs(maxInputs)
+                    .withInput("Input", juce::AudioChannelSet::discreteChannels(numChannels))
+                    .withOutput("Output", juce::AudioChannelSet::discreteChannels(numChannels))),
+  m_numChannels(numChannels),
+  m_sendLeft(numChannels),
+  m_sendRight(numChannels),
+  m_returnLeft(numChannels),
+  m_returnRight(numChannels),
+  m_sendActive(numChannels)
 {
-  m_panner.setRule(juce::dsp::PannerRule::squareRoot3dB);
-  const float pan = static_cast<float>(m_inputNum) / static_cast<float>(m_maxInputs) * 2 - 1;
-  m_panner.setPan(pan);
+  // the sends enter the reverb at the position of their channel
+  for (int i = 0; i < m_numChannels; ++i)
+  {
+    const float position = channelPosition(i, m_numChannels);
+    m_sendLeft[i] = std::cos(position * juce::MathConstants<float>::halfPi);
+    m_sendRight[i] = std::sin(position * juce::MathConstants<float>::halfPi);
+  }
+  m_params.dryLevel = 0.0f;
+  m_params.wetLevel = 1.0f;
 }
 
 /**
- * @brief Destroy the Panning Processor:: Panning Processor object
+ * @brief Destroy the Reverb Processor:: Reverb Processor object
  *
  */
-PanningProcessor::~PanningProcessor() { m_panner.reset(); }
+ReverbProcessor::~ReverbProcessor() { m_reverb.reset(); }
 
 /**
- * @brief Reimplemented to release the panners resources.
+ * @brief Reimplemented to clear the reverb tail.
  *
  */
-void PanningProcessor::releaseResources() { m_panner.reset(); }
+void ReverbProcessor::reset()
+{
+  m_reverb.reset();
+  m_idle = true;
+  m_quietSamples = 0;
+}
 
 /**
- * @brief Reimplemented to reset the panner.
+ * @brief Reimplemented to release the bus buffer.
  *
  */
-void PanningProcessor::reset() { m_panner.reset(); }
+void ReverbProcessor::releaseResources() { m_bus.setSize(0, 0); }
 
 /**
- * @brief Reimplemented to prepare playback with panning.
+ * @brief Reimplemented to prepare the reverb and the bus buffer.
  *
  * @param sampleRate      The sample rate to use
  * @param samplesPerBlock The expected samples per block
  */
-void PanningProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
+void ReverbProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+  m_reverb.setSampleRate(sampleRate);
+  m_tailHoldSamples = static_cast<int>(sampleRate * tailHoldSeconds);
+  reset();
+  m_bus.setSize(2, samplesPerBlock);
+}
+
+/**
+ * @brief Sets the parameters of the reverb.
+ *
+ * Room size, damping, width and freeze mode are used, the levels are ignored since the reverb only
+ * produces the return and the send levels are set per channel.
+ *
+ * @param params  Parameters of the reverb
+ * @param spread  How far the return is spread across the outputs, 0 returns the same signal to all
+ *                outputs, 1 crossfades from the left return on the first output to the right
+ *                return on the last one
+ */
+void ReverbProcessor::setParameters(const juce::Reverb::Parameters &params, float spread)
 {
-  const juce::dsp::ProcessSpec spec = {sampleRate, static_cast<juce::uint32>(samplesPerBlock), 2};
-  m_panner.prepare(spec);
+  const juce::SpinLock::ScopedLockType lock(m_paramsLock);
+  m_params = params;
+  m_params.dryLevel = 0.0f;
+  m_params.wetLevel = 1.0f;
+  m_spread = juce::jlimit(0.0f, 1.0f, spread);
+  m_paramsChanged = true;
 }
 
 /**
- * @brief Reimplemented to do the actual panning.
+ * @brief Applies changed parameters on the audio thread.
  *
- * @param buffer Reference to the buffer to write to.
+ * Skipped if the parameters are being written at the moment, they are picked up with the next
+ * block then.
  */
-void PanningProcessor::processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &)
+void ReverbProcessor::applyParameters()
 {
-  juce::dsp::AudioBlock<float> block(buffer);
-  const juce::dsp::ProcessContextReplacing<float> context(block);
-  m_panner.process(context);
+  const juce::SpinLock::ScopedTryLockType lock(m_paramsLock);
+  if (!lock.isLocked() || !m_paramsChanged)
+  {
+    return;
+  }
+  m_paramsChanged = false;
+  m_reverb.setParameters(m_params);
+  for (int i = 0; i < m_numChannels; ++i)
+  {
+    const float position = channelPosition(i, m_numChannels);
+    const float spreadPosition = 0.5f + (position - 0.5f) * m_spread;
+    m_returnLeft[i] = std::cos(spreadPosition * juce::MathConstants<float>::halfPi);
+    m_returnRight[i] = std::sin(spreadPosition * juce::MathConstants<float>::halfPi);
+  }
 }
 
+/**
+ * @brief Reimplemented to replace the sends in the buffer with the reverb return.
+ *
+ * The reverb is skipped while all sends are silent and the tail has decayed. Under load, quiet
+ * sends are left out and the tail is not rendered: once no send is left, the tail fades out over
+ * the block and the reverb is skipped from the next block on.
+ *
+ * @param buffer Buffer holding the sends of all channels, receives the returns
+ */
+void ReverbProcessor::processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &)
+{
+  BEAK_RT_AUDIO_SCOPE;
+  juce::ScopedNoDenormals noDenormals;
+  applyParameters();
+
+  const int numChannels = std::min(m_numChannels, buffer.getNumChannels());
+  const bool isDegraded = degradation() >= Degradation::QuietReverb;
+  const float minSendLevel = isDegraded ? quietSendLevel : 0.0f;
+  bool hasInput = false;
+  for (int i = 0; i < numChannels; ++i)
+  {
+    m_sendActive[i] = buffer.getMagnitude(i, 0, buffer.getNumSamples()) > minSendLevel;
+    hasInput = hasInput || m_sendActive[i];
+  }
+
+  const int chunkSize = m_bus.getNumSamples();
+  if ((!hasInput && m_idle) || chunkSize == 0)
+  {
+    buffer.clear();
+    return;
+  }
+  m_idle = false;
+
+  float tailLevel = 0.0f;
+  for (int start = 0; start < buffer.getNumSamples(); start += chunkSize)
+  {
+    const int numSamples = std::min(chunkSize, buffer.getNumSamples() - start);
+    auto *left = m_bus.getWritePointer(0);
+    auto *right = m_bus.getWritePointer(1);
+    m_bus.clear();
+    for (int i = 0; i < numChannels; ++i)
+    {
+      if (!m_sendActive[i])
+      {
+        continue;
+      }
+      const auto *send = buffer.getReadPointer(i, start);
+      juce::FloatVectorOperations::addWithMultiply(left, send, m_sendLeft[i], numSamples);
+      juce::FloatVectorOperations::addWithMultiply(right, send, m_sendRight[i], numSamples);
+    }
+
+    m_reverb.processStereo(left, right, numSamples);
+    tailLevel = std::max({tailLevel, m_bus.getMagnitude(0, 0, numSamples),
+                          m_bus.getMagnitude(1, 0, numSamples)});
+
+    for (int i = 0; i < numChannels; ++i)
+    {
+      auto *output = buffer.getWritePointer(i, start);
+      juce::FloatVectorOperations::copyWithMultiply(output, left, m_returnLeft[i], numSamples);
+      juce::FloatVectorOperations::addWithMultiply(output, right, m_returnRight[i], numSamples);
+    }
+  }
+  if (isDegraded && !hasInput)
+  {
+    for (int i = 0; i < numChannels; ++i)
+    {
+      buffer.applyGainRamp(i, 0, buffer.getNumSamples(), 1.0f, 0.0f);
+    }
+    reset();
+    return;
+  }
+
+  // cut the decayed tail to exact zero, so the reverb can be skipped until the next send. The
+  // output has to stay quiet for a while, energy can still be travelling through the delay lines.
+  m_quietSamples = !hasInput && tailLevel < tailThreshold
+                       ? m_quietSamples + buffer.getNumSamples()
+                       : 0;
+  if (m_quietSamples >= m_tailHoldSamples)
+  {
+    reset();
+  }
+}
+
+/* --------------------------- fan out processor ---------------------------- */
+/**
+ * @brief Constant power gains of a source along a line of channels.
+ *
+ * The source is faded linearly into the channels within its width around its position. The gains
+ * are normalised, so the power stays the same wherever the source is.
+ *
+ * @param position    0 is the first channel, 1 the last one
+ * @param spread      Width of the source in channels, narrower sources play on two channels at most
+ * @param gains       Receives the gain of every channel
+ * @param numChannels Number of channels
+ */
+void positionGains(float position, float spread, float *gains, int numChannels)
+{
+  const float center = juce::jlimit(0.0f, 1.0f, position) * static_cast<float>(numChannels - 1);
+  const float width = std::max(spread, 1.0f);
+  float power = 0.0f;
+  for (int i = 0; i < numChannels; ++i)
+  {
+    gains[i] = std::max(0.0f, 1.0f - std::abs(static_cast<float>(i) - center) / width);
+    power += gains[i] * gains[i];
+  }
+  if (power > 0.0f)
+  {
+    juce::FloatVectorOperations::multiply(gains, 1.0f / std::sqrt(power), numChannels);
+  }
+}
+
+/**
+ * @brief Construct a new Fan Out Processor:: Fan Out Processor object
+ *
+ * @param numChannels Number of channels, each one is an output
+ */
+FanOutProcessor::FanOutProcessor(int numChannels) :
+  ProcessorBase(BusesProperties().withOutput(
+      "Output", juce::AudioChannelSet::discreteChannels(numChannels))),
+  m_numChannels(numChannels)
+{
+  for (auto &voice : m_voices)
+  {
+    voice.gains.resize(numChannels);
+    voice.targetGains.resize(numChannels);
+  }
+}
+
+/**
+ * @brief Destroy the Fan Out Processor:: Fan Out Processor object
+ *
+ */
+FanOutProcessor::~FanOutProcessor() = default;
+
+/**
+ * @brief Reimplemented, nothing to prepare.
+ *
+ */
+void FanOutProcessor::prepareToPlay(double, int) {}
+
+/**
+ * @brief Reimplemented to stop all voices.
+ *
+ */
+void FanOutProcessor::reset() { m_stop = true; }
+
+/**
+ * @brief Reimplemented, the voices do not hold resources of their own.
+ *
+ */
+void FanOutProcessor::releaseResources() {}
+
+/**
+ * @brief Plays a sample on several channels with the next block.
+ *
+ * Must only be called from one thread at a time. Samples that are not used anymore are released
+ * here.
+ *
+ * @param fanOut  The sample and where to play it
+ * @return true   The fan out has been queued, false if the queue is full
+ */
+bool FanOutProcessor::play(FanOut fanOut)
+{
+  if (!fanOut.sample)
+  {
+    return false;
+  }
+  // keep the sample alive until no voice plays it anymore
+  std::erase_if(m_pool, [](const auto &pooled) { return pooled.use_count() == 1; });
+  m_pool.push_back(fanOut.sample);
+  fanOut.gains.resize(m_numChannels, 0.0f);
+
+  const auto scope = m_fifo.write(1);
+  if (scope.blockSize1 + scope.blockSize2 == 0)
+  {
+    return false;
+  }
+  scope.forEach([this, &fanOut](int index) { m_fanOuts[index] = std::move(fanOut); });
+  return true;
+}
+
+/**
+ * @brief Stops all fan outs with the next block.
+ *
+ */
+void FanOutProcessor::stopAll() { m_stop = true; }
+
+/**
+ * @brief Starts a fan out on the audio thread.
+ *
+ * If all voices are busy, the one that has played the longest is replaced.
+ *
+ * @param fanOut The fan out
+ */
+void FanOutProcessor::startVoice(const FanOut &fanOut)
+{
+  auto *target = &m_voices.front();
+  for (auto &voice : m_voices)
+  {
+    if (!voice.sample)
+    {
+      target = &voice;
+      break;
+    }
+    if (voice.position > target->position)
+    {
+      target = &voice;
+    }
+  }
+  target->sample = fanOut.sample;
+  target->position = 0;
+  target->positional = fanOut.positional;
+  target->startPosition = fanOut.position;
+  target->endPosition = fanOut.moveSamples > 0 ? fanOut.endPosition : fanOut.position;
+  target->spread = fanOut.spread;
+  target->moveSamples = fanOut.moveSamples;
+  target->priority = fanOut.priority;
+  target->fading = false;
+  if (target->positional)
+  {
+    positionGains(target->startPosition, target->spread, target->gains.data(), m_numChannels);
+  }
+  else
+  {
+    std::copy(fanOut.gains.begin(), fanOut.gains.end(), target->gains.begin());
+  }
+  std::copy(target->gains.begin(), target->gains.end(), target->targetGains.begin());
+}
+
+/**
+ * @brief Calculates the gains of a moving voice at the end of the next block.
+ *
+ * @param voice       The voice
+ * @param numSamples  Samples the voice plays in the next block
+ */
+void FanOutProcessor::updateTargetGains(Voice &voice, int numSamples)
+{
+  if (voice.fading)
+  {
+    std::fill(voice.targetGains.begin(), voice.targetGains.end(), 0.0f);
+    return;
+  }
+  if (!voice.positional || voice.moveSamples == 0)
+  {
+    return;
+  }
+  const float progress =
+      std::min(1.0f, static_cast<float>(voice.position + numSamples) / voice.moveSamples);
+  const float position = voice.startPosition + (voice.endPosition - voice.startPosition) * progress;
+  positionGains(position, voice.spread, voice.targetGains.data(), m_numChannels);
+}
+
+/**
+ * @brief Fades out voices until no more than the given number are playing.
+ *
+ * Voices of the lowest priority go first, the quietest of them before the louder ones.
+ *
+ * @param maxVoices Voices that may keep playing
+ * @return int      Number of voices that have been faded out
+ */
+int FanOutProcessor::shed(int maxVoices)
+{
+  int numActive = static_cast<int>(std::count_if(m_voices.begin(), m_voices.end(),
+                                                 [](const Voice &voice)
+                                                 { return voice.sample && !voice.fading; }));
+  int numShed = 0;
+  for (; numActive > maxVoices; --numActive, ++numShed)
+  {
+    Voice *victim = nullptr;
+    float victimLevel = 0.0f;
+    for (auto &voice : m_voices)
+    {
+      if (!voice.sample || voice.fading)
+      {
+        continue;
+      }
+      const float level = *std::max_element(voice.gains.begin(), voice.gains.end());
+      if (victim == nullptr || voice.priority < victim->priority ||
+          (voice.priority == victim->priority && level < victimLevel))
+      {
+        victim = &voice;
+        victimLevel = level;
+      }
+    }
+    victim->fading = true;
+  }
+  return numShed;
+}
+
+/**
+ * @brief Reimplemented to add every voice to the channels it is audible on.
+ *
+ * Gain changes of moving voices are ramped over the block. Under load, voices are shed.
+ *
+ * @param buffer Buffer to write the channels to
+ */
+void FanOutProcessor::processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &)
+{
+  BEAK_RT_AUDIO_SCOPE;
+  buffer.clear();
+  if (m_stop.exchange(false))
+  {
+    // the samples are kept alive by the pool, so this does not free memory
+    for (auto &voice : m_voices)
+    {
+      voice.sample.reset();
+    }
+  }
+  const auto scope = m_fifo.read(m_fifo.getNumReady());
+  scope.forEach([this](int index) { startVoice(m_fanOuts[index]); });
+  if (degradation() >= Degradation::ShedVoices)
+  {
+    m_overloadGuard->countShed(shed(OverloadGuard::shedVoiceLimit));
+  }
+
+  const int numChannels = std::min(m_numChannels, buffer.getNumChannels());
+  for (auto &voice : m_voices)
+  {
+    if (!voice.sample)
+    {
+      continue;
+    }
+    const int numSamples =
+        std::min(buffer.getNumSamples(), voice.sample->getNumSamples() - voice.position);
+    updateTargetGains(voice, numSamples);
+    const auto *source = voice.sample->getReadPointer(0, voice.position);
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+      const float gain = voice.gains[channel];
+      const float targetGain = voice.targetGains[channel];
+      if (gain == 0.0f && targetGain == 0.0f)
+      {
+        continue;
+      }
+      buffer.addFromWithRamp(channel, 0, source, numSamples, gain, targetGain);
+      voice.gains[channel] = targetGain;
+    }
+    voice.position += numSamples;
+    if (voice.position >= voice.sample->getNumSamples() || voice.fading)
+    {
+      voice.sample.reset();
+    }
+  }
+}
+
+/**
+ * @brief Reader source that applies a fixed gain.
+ *
+ * The gain of a transport source ramps from unity over its first block, which would play the
+ * transient of a normalised sample at its original level.
+ */
+class GainReaderSource : public juce::AudioFormatReaderSource
+{
+ public:
+  GainReaderSource(juce::AudioFormatReader *reader, float gain) :
+    juce::AudioFormatReaderSource(reader, true), m_gain(gain)
+  {
+  }
+
+  void getNextAudioBlock(const juce::AudioSourceChannelInfo &info) override
+  {
+    juce::AudioFormatReaderSource::getNextAudioBlock(info);
+    info.buffer->applyGain(info.startSample, info.numSamples, m_gain);
+  }
+
+ private:
+  float m_gain;
+};
+
 /**
  * @brief Construct a new Sampler Processor:: Sampler Processor object
  *
@@ -96,11 +705,49 @@ void SamplerProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 /**
  * @brief Reimplemented to process the block with the mixer source doing the heavy lifting.
  *
+ * The mixer source is not touched while nothing is playing. Decoded samples scheduled by the
+ * sequencer are added on top, under load they are shed.
+ *
  * @param buffer Buffer to write to.
  */
 void SamplerProcessor::processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &)
 {
-  m_source.getNextAudioBlock(juce::AudioSourceChannelInfo(buffer));
+  BEAK_RT_AUDIO_SCOPE;
+  if (m_stopSampleVoices.exchange(false))
+  {
+    // the samples are kept alive by the sequencer, so this does not free memory
+    m_sampleVoices.stopAll();
+  }
+
+  if (m_numPlaying.load() == 0)
+  {
+    buffer.clear();
+  }
+  else
+  {
+    m_source.getNextAudioBlock(juce::AudioSourceChannelInfo(buffer));
+  }
+  if (degradation() >= Degradation::ShedVoices)
+  {
+    m_overloadGuard->countShed(m_sampleVoices.shed(OverloadGuard::shedVoiceLimit));
+  }
+  m_sampleVoices.render(buffer, buffer.getNumChannels());
+}
+
+/**
+ * @brief Plays a decoded sample with the next block, must be called from the audio thread.
+ *
+ * Used by the sequencer before the block is rendered.
+ *
+ * @param sample    The sample, mono at the sample rate of the device
+ * @param offset    Sample of the next block the sample starts on
+ * @param gain      Linear gain
+ * @param priority  Samples of lower priority are shed first under load
+ */
+void SamplerProcessor::scheduleSample(const std::shared_ptr<const SampleBuffer> &sample, int offset,
+                                      float gain, int priority)
+{
+  m_sampleVoices.schedule(sample, offset, gain, priority);
 }
 
 /**
@@ -118,24 +765,37 @@ void SamplerProcessor::releaseResources() { m_source.releaseResources(); }
 /**
  * @brief Plays one sample
  *
- * @param file Path to file
+ * @param file      Path to file
+ * @param metadata  Gain and attack of the sample, the gain applies from the first sample on
  */
-void SamplerProcessor::playSample(juce::File const &file)
+void SamplerProcessor::playSample(juce::File const &file, const SampleMetadata &metadata)
 {
   juce::AudioFormatReader *reader = m_formatManager.createReaderFor(file);
+  if (reader != nullptr && metadata.attackOffset > 0 &&
+      metadata.attackOffset < reader->lengthInSamples)
+  {
+    reader = new juce::AudioSubsectionReader(reader, metadata.attackOffset,
+                                             reader->lengthInSamples - metadata.attackOffset, true);
+  }
   auto transportSource = new juce::AudioTransportSource();
 
-  transportSource->setSource(new juce::AudioFormatReaderSource(reader, true), 0, nullptr,
+  transportSource->setSource(new GainReaderSource(reader, metadata.gain), 0, nullptr,
                              reader->sampleRate);
   const juce::MessageManagerLock mmLock;
   transportSource->addChangeListener(this);
   transportSource->start();
   m_source.addInputSource(transportSource, true);
   m_transportSources.insert(transportSource);
+  ++m_numPlaying;
 }
 
+/**
+ * @brief Stops all samples that are playing.
+ *
+ */
 void SamplerProcessor::stopPlayback()
 {
+  m_stopSampleVoices = true;
   for (auto it = m_transportSources.begin(); it != m_transportSources.end(); ++it)
   {
     (*it)->stop();
@@ -155,8 +815,9 @@ void SamplerProcessor::changeListenerCallback(juce::ChangeBroadcaster *emitter)
   {
     if (!emitterSource->isPlaying())
     {
-      m_source.removeInputSource(emitterSource);
       m_transportSources.erase(m_transportSources.find(emitterSource));
+      --m_numPlaying;
+      m_source.removeInputSource(emitterSource);
     }
   }
 }
@@ -4,7 +4,15 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <juce_dsp/juce_dsp.h>
 
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <memory>
+#include <vector>
+
+#include "overload.h"
+#include "sampleMetadata.h"
+#include "sampleVoices.h"
 
 namespace beak
 {
@@ -36,34 +44,188 @@ class ProcessorBase : public juce::AudioProcessor
   void getStateInformation(juce::MemoryBlock &) override {}
   void setStateInformation(const void *, int) override {}
 
+  /** The guard of the engine, the processor degrades along with it */
+  void setOverloadGuard(OverloadGuard *guard) { m_overloadGuard = guard; }
+
+ protected:
+  Degradation degradation() const
+  {
+    return m_overloadGuard ? m_overloadGuard->level() : Degradation::None;
+  }
+
  protected:
   juce::String m_name;
   std::set<juce::AudioTransportSource *> m_transportSources;
+  OverloadGuard *m_overloadGuard{nullptr};
 
  private:
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ProcessorBase)
 };
 
-class PanningProcessor : public ProcessorBase
+/**
+ * @brief Speaker layouts the channels can be mixed down to.
+ *
+ */
+enum class DownmixLayout
+{
+  Stereo,      //!< Channels from the left to the right speaker, the last one fully right
+  Surround51,  //!< Channels around the front from the left to the right surround speaker
+  Headphones   //!< Stereo with crossfeed, so the outer channels do not sound isolated
+};
+
+/**
+ * @brief Mixes all channels down to a speaker layout in one pass.
+ *
+ * Every input is one channel, placed along the speaker line with constant power. The gains of all
+ * channels are calculated once, the outputs are summed with one multiply-add per channel and
+ * speaker that it is audible on.
+ */
+class DownmixProcessor : public ProcessorBase
+{
+ public:
+  explicit DownmixProcessor(int numInputs, DownmixLayout layout);
+  ~DownmixProcessor() override;
+  DownmixProcessor(DownmixProcessor &&) = delete;
+  DownmixProcessor &operator=(DownmixProcessor &&) = delete;
+
+  void prepareToPlay(double sampleRate, int samplesPerBlock) override;
+  void processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &) override;
+  void reset() override;
+  void releaseResources() override;
+
+  static juce::AudioChannelSet channelSet(DownmixLayout layout);
+
+ private:
+  int m_numInputs;
+  int m_numOutputs;
+  std::vector<float> m_matrix;  //!< Gain of every input per output, output major
+  juce::AudioSampleBuffer m_mix;
+
+ private:
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DownmixProcessor)
+};
+
+/**
+ * @brief Shared reverb on the summed sends of all channels.
+ *
+ * Every input carries the send of one channel. The sends are panned by channel position into one
+ * stereo reverb, whose return is distributed back across all outputs.
+ */
+class ReverbProcessor : public ProcessorBase
 {
  public:
-  explicit PanningProcessor(int inputNum, int maxInputs);
-  ~PanningProcessor() override;
-  PanningProcessor(PanningProcessor &&) = delete;
-  PanningProcessor &operator=(PanningProcessor &&) = delete;
+  explicit ReverbProcessor(int numChannels);
+  ~ReverbProcessor() override;
+  ReverbProcessor(ReverbProcessor &&) = delete;
+  ReverbProcessor &operator=(ReverbProcessor &&) = delete;
 
   void prepareToPlay(double sampleRate, int samplesPerBlock) override;
   void processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &) override;
   void reset() override;
   void releaseResources() override;
+  void setParameters(const juce::Reverb::Parameters &params, float spread);
+
+ private:
+  void applyParameters();
+
+ private:
+  int m_numChannels;
+  juce::Reverb m_reverb;
+  juce::AudioSampleBuffer m_bus;  //!< Stereo input and return of the reverb
+  std::vector<float> m_sendLeft;
+  std::vector<float> m_sendRight;
+  std::vector<float> m_returnLeft;
+  std::vector<float> m_returnRight;
+  std::vector<char> m_sendActive;  //!< Channels that are sent to the reverb in the current block
+
+  bool m_idle{true};         //!< No input and the tail has decayed
+  int m_quietSamples{0};     //!< Samples since the tail fell below the threshold without input
+  int m_tailHoldSamples{0};  //!< Quiet samples before the tail is cut
+
+  juce::SpinLock m_paramsLock;
+  juce::Reverb::Parameters m_params;
+  float m_spread{0.0f};
+  bool m_paramsChanged{true};
+
+ private:
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReverbProcessor)
+};
+
+/**
+ * @brief One sample played on several channels at once.
+ *
+ */
+struct FanOut
+{
+  std::shared_ptr<const SampleBuffer> sample;
+  std::vector<float> gains;  //!< Linear gain per channel, used if not positional
+  bool positional{false};
+  float position{0.0f};     //!< 0 is the first channel, 1 the last one
+  float endPosition{0.0f};  //!< Position at the end of the movement
+  float spread{1.0f};       //!< Width of the source in channels
+  int moveSamples{0};       //!< Duration of the movement, 0 keeps the source in place
+  int priority{0};          //!< Voices of lower priority are shed first under overload
+};
+
+void positionGains(float position, float spread, float *gains, int numChannels);
+
+/**
+ * @brief Plays decoded samples on several channels with one gain matrix pass.
+ *
+ * Every output is one channel. A sample is read once per block and added to all channels it is
+ * audible on, with gains that are either given per channel or follow a position along the
+ * channels. Fan outs are passed from the network thread through a lock-free queue, samples are only
+ * released on the network thread.
+ */
+class FanOutProcessor : public ProcessorBase
+{
+ public:
+  static constexpr int maxVoices{16};  //!< Fan outs that can play at the same time
+  static constexpr int queueSize{64};  //!< Fan outs that can be pending between two blocks
+
+ public:
+  explicit FanOutProcessor(int numChannels);
+  ~FanOutProcessor() override;
+  FanOutProcessor(FanOutProcessor &&) = delete;
+  FanOutProcessor &operator=(FanOutProcessor &&) = delete;
+
+  void prepareToPlay(double sampleRate, int samplesPerBlock) override;
+  void processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &) override;
+  void reset() override;
+  void releaseResources() override;
+  [[nodiscard]] bool play(FanOut fanOut);
+  void stopAll();
+
+ private:
+  struct Voice
+  {
+    std::shared_ptr<const SampleBuffer> sample;
+    int position{0};
+    std::vector<float> gains;        //!< Gains at the start of the next block
+    std::vector<float> targetGains;  //!< Gains at the end of the next block
+    bool positional{false};
+    float startPosition{0.0f};
+    float endPosition{0.0f};
+    float spread{1.0f};
+    int moveSamples{0};
+    int priority{0};
+    bool fading{false};  //!< Shed, fades out within the next block
+  };
+
+  void startVoice(const FanOut &fanOut);
+  void updateTargetGains(Voice &voice, int numSamples);
+  int shed(int maxVoices);
 
  private:
-  int m_inputNum;
-  int m_maxInputs;
-  juce::dsp::Panner<float> m_panner;
+  int m_numChannels;
+  juce::AbstractFifo m_fifo{queueSize};
+  std::array<FanOut, queueSize> m_fanOuts;
+  std::vector<std::shared_ptr<const SampleBuffer>> m_pool;  //!< Network thread
+  std::array<Voice, maxVoices> m_voices;                    //!< Audio thread
+  std::atomic<bool> m_stop{false};
 
  private:
-  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PanningProcessor)
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FanOutProcessor)
 };
 
 class SamplerProcessor : public ProcessorBase, public juce::ChangeListener
@@ -78,14 +240,19 @@ class SamplerProcessor : public ProcessorBase, public juce::ChangeListener
   void processBlock(juce::AudioSampleBuffer &buffer, juce::MidiBuffer &) override;
   void reset() override;
   void releaseResources() override;
-  void playSample(juce::File const &file);
+  void playSample(juce::File const &file, const SampleMetadata &metadata = {});
   void stopPlayback();
+  void scheduleSample(const std::shared_ptr<const SampleBuffer> &sample, int offset, float gain,
+                      int priority = 0);
 
   void changeListenerCallback(juce::ChangeBroadcaster *source) override;
 
  private:
   juce::AudioFormatManager m_formatManager;
   juce::MixerAudioSource m_source;
+  std::atomic<int> m_numPlaying{0};  //!< Sources that have not finished yet
+  SampleVoices m_sampleVoices;       //!< Decoded samples scheduled by the sequencer
+  std::atomic<bool> m_stopSampleVoices{false};
 
  private:
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SamplerProcessor)
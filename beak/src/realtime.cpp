@@ -0,0 +1,122 @@
+#include "realtime.h"
+
+#ifdef __linux__
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+namespace beak::rt
+{
+/**
+ * @brief Locks all current and future memory of the process, so it is never paged out.
+ *
+ * Freed memory is kept by the allocator instead of being returned to the system, so it does not
+ * have to be faulted in again.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error lockMemory()
+{
+#ifdef __linux__
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+  {
+    return Error(juce::String("mlockall failed: ") + std::strerror(errno));
+  }
+  return Error();
+#else
+  return Error("locking memory is only supported on linux");
+#endif
+}
+
+/**
+ * @brief Switches the calling thread to real-time scheduling and pins it to a core.
+ *
+ * @param config        Priority and core of the thread
+ * @return ThreadReport The guarantees that have been obtained
+ */
+ThreadReport hardenCurrentThread(const ThreadConfig &config)
+{
+  ThreadReport report;
+#ifdef __linux__
+  if (config.priority > 0)
+  {
+    sched_param param{};
+    param.sched_priority = std::min(config.priority, sched_get_priority_max(SCHED_FIFO));
+    report.scheduled = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+  }
+  if (config.core >= 0)
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(config.core, &cpus);
+    report.pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+  }
+#else
+  juce::ignoreUnused(config);
+#endif
+  prefaultStack();
+  return report;
+}
+
+/**
+ * @brief Touches the stack of the calling thread, so growing into it later does not fault.
+ *
+ */
+void prefaultStack()
+{
+  char stack[prefaultStackBytes];
+  std::memset(stack, 0, sizeof(stack));
+  // the volatile reads keep the writes from being optimised away
+  prefault(stack, sizeof(stack));
+}
+
+/**
+ * @brief Touches every page of a memory region, so it is resident before it is used.
+ *
+ * @param data  Start of the region
+ * @param size  Size of the region in bytes
+ */
+void prefault(const void *data, size_t size)
+{
+  const auto *bytes = static_cast<const volatile char *>(data);
+  for (size_t i = 0; i < size; i += 4096)
+  {
+    static_cast<void>(bytes[i]);
+  }
+}
+
+/**
+ * @brief Describes the guarantees of a thread for the log.
+ *
+ * @param name          Name of the thread
+ * @param config        What has been requested
+ * @param report        What has been obtained
+ * @return juce::String The description
+ */
+juce::String describe(const juce::String &name, const ThreadConfig &config,
+                      const ThreadReport &report)
+{
+  juce::String description = name + " thread: ";
+  if (config.priority > 0)
+  {
+    description << "SCHED_FIFO " << config.priority << (report.scheduled ? " ok" : " denied");
+  }
+  else
+  {
+    description << "normal scheduling";
+  }
+  if (config.core >= 0)
+  {
+    description << ", core " << config.core << (report.pinned ? " ok" : " denied");
+  }
+  return description;
+}
+}  // namespace beak::rt
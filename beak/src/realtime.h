@@ -0,0 +1,37 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include "error.h"
+
+namespace beak::rt
+{
+constexpr size_t prefaultStackBytes = 256 * 1024;  //!< Stack touched up front by hardened threads
+
+/**
+ * @brief Scheduling of a thread in real-time mode.
+ *
+ */
+struct ThreadConfig
+{
+  int priority{0};  //!< SCHED_FIFO priority, 0 keeps the normal scheduler
+  int core{-1};     //!< Core to pin the thread to, negative to run on any core
+};
+
+/**
+ * @brief Guarantees obtained for a thread.
+ *
+ */
+struct ThreadReport
+{
+  bool scheduled{false};  //!< Runs with SCHED_FIFO
+  bool pinned{false};     //!< Pinned to its core
+};
+
+[[nodiscard]] Error lockMemory();
+ThreadReport hardenCurrentThread(const ThreadConfig &config);
+void prefaultStack();
+void prefault(const void *data, size_t size);
+juce::String describe(const juce::String &name, const ThreadConfig &config,
+                      const ThreadReport &report);
+}  // namespace beak::rt
@@ -0,0 +1,203 @@
+#include "renderCache.h"
+
+#include <plog/Log.h>
+
+#include "synthSound.h"
+#include "synthesiser.h"
+
+namespace beak
+{
+/**
+ * @brief Construct a new Render Cache object
+ *
+ * @param budgetBytes Memory the rendered notes may use
+ */
+RenderCache::RenderCache(size_t budgetBytes) : m_budgetBytes(budgetBytes) {}
+
+/**
+ * @brief Destroy the Render Cache object, waits for a note that is being rendered.
+ *
+ */
+RenderCache::~RenderCache() { m_renderPool.removeAllJobs(true, 1000); }
+
+/**
+ * @brief Sets the sample rate notes are rendered at, must match the device.
+ *
+ * @param sampleRate The sample rate of the device
+ */
+void RenderCache::prepare(double sampleRate)
+{
+  std::scoped_lock lock(m_mutex);
+  m_sampleRate = sampleRate;
+}
+
+/**
+ * @brief Looks up a rendered note.
+ *
+ * Queues the note for rendering if it is not in the cache yet.
+ *
+ * @param patch       Patch of the channel
+ * @param note        The note
+ * @param velocity    Velocity of the note from 0 to 1
+ * @param durationMs  Time until the note is released
+ * @return std::shared_ptr<const SampleBuffer> The rendered note, nullptr if it is not rendered yet
+ */
+std::shared_ptr<const SampleBuffer> RenderCache::get(const Patch &patch, int note, float velocity,
+                                                     float durationMs)
+{
+  // quantised like the notes of the live path, so both play at the same level
+  const juce::uint8 midiVelocity = juce::MidiMessage::floatValueToMidiByte(velocity);
+  std::scoped_lock lock(m_mutex);
+  const Key key = makeKey(patch, note, midiVelocity, durationMs);
+  if (const auto entry = m_entries.find(key); entry != m_entries.end())
+  {
+    m_lru.splice(m_lru.begin(), m_lru, entry->second.lruPosition);
+    return entry->second.sample;
+  }
+
+  if (m_pending.insert(key).second)
+  {
+    m_renderPool.addJob(
+        [this, key, patch, note, midiVelocity, durationMs, sampleRate = m_sampleRate]
+        {
+          auto sample = render(patch, note, midiVelocity, durationMs, sampleRate);
+          std::scoped_lock lock(m_mutex);
+          m_pending.erase(key);
+          insert(key, std::move(sample));
+        });
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Identifies a note by everything that changes its sound.
+ *
+ * @param patch       Patch of the channel
+ * @param note        The note
+ * @param velocity    MIDI velocity of the note
+ * @param durationMs  Time until the note is released
+ * @return Key        The key of the note
+ */
+RenderCache::Key RenderCache::makeKey(const Patch &patch, int note, juce::uint8 velocity,
+                                      float durationMs) const
+{
+  return {static_cast<float>(patch.osc.type),
+          patch.osc.gain,
+          patch.adsr.attack,
+          patch.adsr.decay,
+          patch.adsr.sustain,
+          patch.adsr.release,
+          static_cast<float>(patch.filter.type),
+          patch.filter.cutoff,
+          patch.filter.resonance,
+          patch.filterAdsr.attack,
+          patch.filterAdsr.decay,
+          patch.filterAdsr.sustain,
+          patch.filterAdsr.release,
+          static_cast<float>(note),
+          static_cast<float>(velocity),
+          durationMs,
+          static_cast<float>(m_sampleRate)};
+}
+
+/**
+ * @brief Adds a rendered note and evicts the least recently used ones above the budget.
+ *
+ * Notes that are still playing are not evicted, so they are never released on the audio thread.
+ * The note is dropped if the budget can not be met.
+ *
+ * @param key     The key of the note
+ * @param sample  The rendered note
+ */
+void RenderCache::insert(const Key &key, std::shared_ptr<const SampleBuffer> sample)
+{
+  const size_t size = sizeOf(*sample);
+  if (size > m_budgetBytes)
+  {
+    PLOGD << "rendered note exceeds the render cache budget";
+    return;
+  }
+  auto position = m_lru.end();
+  while (position != m_lru.begin() && m_usedBytes + size > m_budgetBytes)
+  {
+    --position;
+    const auto entry = m_entries.find(*position);
+    if (entry->second.sample.use_count() > 1)
+    {
+      continue;
+    }
+    m_usedBytes -= sizeOf(*entry->second.sample);
+    m_entries.erase(entry);
+    position = m_lru.erase(position);
+  }
+  if (m_usedBytes + size > m_budgetBytes)
+  {
+    PLOGD << "render cache full, note is not cached";
+    return;
+  }
+  m_lru.push_front(key);
+  m_entries.emplace(key, Entry{std::move(sample), m_lru.begin()});
+  m_usedBytes += size;
+}
+
+/**
+ * @brief Renders a note offline with a synthesiser of its own.
+ *
+ * The synthesiser handles events behind the block it renders at the end of that block, so every
+ * block only gets the events that fall into it.
+ *
+ * @param patch       Patch of the channel
+ * @param note        The note
+ * @param velocity    MIDI velocity of the note
+ * @param durationMs  Time until the note is released
+ * @param sampleRate  The sample rate to render at
+ * @return std::shared_ptr<const SampleBuffer> The note until its release has finished, mono
+ */
+std::shared_ptr<const SampleBuffer> RenderCache::render(const Patch &patch, int note,
+                                                        juce::uint8 velocity, float durationMs,
+                                                        double sampleRate)
+{
+  synth::Synthesiser synth;
+  synth.addSound(new synth::Sound());
+  synth.prepareToPlay(sampleRate, renderBlockSize);
+  synth.setParams(patch.osc, patch.adsr, patch.filter, patch.filterAdsr);
+  synth.setPolyphony(1);
+
+  const int maxSamples = static_cast<int>(maxRenderSeconds * sampleRate);
+  const int noteOffSample = std::clamp(
+      static_cast<int>(std::lround(std::max(durationMs, 0.0f) * sampleRate / 1000.0)), 0,
+      maxSamples - 1);
+  juce::MidiBuffer midi;
+  midi.addEvent(juce::MidiMessage::noteOn(1, note, velocity), 0);
+  midi.addEvent(juce::MidiMessage::noteOff(1, note), noteOffSample);
+
+  juce::AudioBuffer<float> rendered(2, maxSamples);
+  rendered.clear();
+  juce::MidiBuffer blockMidi;
+  int length = 0;
+  while (length < maxSamples && (length <= noteOffSample || !synth.isIdle()))
+  {
+    const int numSamples = std::min(renderBlockSize, maxSamples - length);
+    blockMidi.clear();
+    blockMidi.addEvents(midi, length, numSamples, 0);
+    synth.renderNextBlock(rendered, blockMidi, length, numSamples);
+    length += numSamples;
+  }
+
+  auto sample = std::make_shared<SampleBuffer>(1, length);
+  sample->copyFrom(0, 0, rendered, 0, 0, length);
+  return sample;
+}
+
+/**
+ * @brief Memory used by a rendered note.
+ *
+ * @param sample  The rendered note
+ * @return size_t Size in bytes
+ */
+size_t RenderCache::sizeOf(const SampleBuffer &sample)
+{
+  return static_cast<size_t>(sample.getNumChannels()) *
+         static_cast<size_t>(sample.getNumSamples()) * sizeof(float);
+}
+}  // namespace beak
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+
+#include "patchTable.h"
+#include "sampleBuffer.h"
+
+namespace beak
+{
+/**
+ * @brief Notes of the synthesiser rendered ahead of time, for sound effects that repeat.
+ *
+ * A note is identified by its patch, note number, velocity and duration. The first time a note is
+ * requested it is rendered offline on a thread of its own, later requests get the rendered buffer
+ * to play as a sample. The cache is limited to a memory budget, the least recently used notes are
+ * evicted first. Notes are requested from the network thread and inserted by the render thread,
+ * the entries are guarded by a mutex. The audio thread only holds the rendered buffers.
+ */
+class RenderCache
+{
+ public:
+  static constexpr double maxRenderSeconds{10.0};  //!< Longest note, including its release
+  static constexpr int renderBlockSize{512};
+
+ public:
+  explicit RenderCache(size_t budgetBytes);
+  ~RenderCache();
+  RenderCache(const RenderCache &) = delete;
+  RenderCache &operator=(const RenderCache &) = delete;
+
+  void prepare(double sampleRate);
+  std::shared_ptr<const SampleBuffer> get(const Patch &patch, int note, float velocity,
+                                          float durationMs);
+
+ private:
+  using Key = std::array<float, 17>;
+  using Lru = std::list<Key>;
+
+  struct Entry
+  {
+    std::shared_ptr<const SampleBuffer> sample;
+    Lru::iterator lruPosition;
+  };
+
+  Key makeKey(const Patch &patch, int note, juce::uint8 velocity, float durationMs) const;
+  void insert(const Key &key, std::shared_ptr<const SampleBuffer> sample);
+  static std::shared_ptr<const SampleBuffer> render(const Patch &patch, int note,
+                                                    juce::uint8 velocity, float durationMs,
+                                                    double sampleRate);
+  static size_t sizeOf(const SampleBuffer &sample);
+
+ private:
+  size_t m_budgetBytes;
+  size_t m_usedBytes{0};
+  double m_sampleRate{44100.0};
+  std::mutex m_mutex;  //!< Guards the entries, rendering inserts them
+  std::map<Key, Entry> m_entries;
+  Lru m_lru;                         //!< Most recently used first
+  std::set<Key> m_pending;           //!< Notes that are being rendered
+  juce::ThreadPool m_renderPool{1};  //!< Declared last, so jobs finish before members are gone
+};
+}  // namespace beak
@@ -3,13 +3,55 @@
 #include <fmt/format.h>
 #include <plog/Log.h>
 
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "realtime.h"
 
 namespace beak
 {
-constexpr uint32_t statusOk = 200;  //!< HTTP ok status code.
+constexpr uint32_t statusOk = 200;       //!< HTTP ok status code.
+constexpr int progressStepPercent = 25;  //!< Download progress is logged in these steps
 constexpr int downloadCheckIntervalMs =
     5;  //!< Interal in which to check if downloads is finished in ms.
+constexpr int attackScanBlockSize = 1024;  //!< Frames read at once while looking for the attack
+
+/**
+ * @brief Finds the first frame of a sample in which any channel reaches the threshold.
+ *
+ * @param reader      Reader of the sample
+ * @param threshold   Linear level below which frames are silence
+ * @return juce::int64 Frames of leading silence, 0 if the sample is silent throughout
+ */
+static juce::int64 findAttack(juce::AudioFormatReader& reader, float threshold)
+{
+  const auto numChannels = static_cast<int>(reader.numChannels);
+  juce::AudioBuffer<float> buffer(numChannels, attackScanBlockSize);
+  for (juce::int64 start = 0; start < reader.lengthInSamples; start += attackScanBlockSize)
+  {
+    const auto numFrames = static_cast<int>(
+        std::min<juce::int64>(attackScanBlockSize, reader.lengthInSamples - start));
+    if (!reader.read(&buffer, 0, numFrames, start, true, true))
+    {
+      return 0;
+    }
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+      for (int channel = 0; channel < numChannels; ++channel)
+      {
+        if (std::abs(buffer.getSample(channel, frame)) >= threshold)
+        {
+          return start + frame;
+        }
+      }
+    }
+  }
+  return 0;
+}
 
 /**
  * @brief Configure the cache
@@ -30,6 +72,43 @@ Error Cache::configure()
   return Error();
 }
 
+/**
+ * @brief Maps all cached files into memory and touches every page, now and for new files.
+ *
+ * With locked memory the files then stay resident, so playing a sample never waits for the disk.
+ */
+void Cache::prefault()
+{
+  m_prefault = true;
+  const std::lock_guard lock(m_mutex);
+  for (auto& [key, item] : m_ressourceMap)
+  {
+    mapFile(item);
+  }
+}
+
+/**
+ * @brief Maps a cached file into memory and touches every page.
+ *
+ * @param item The cached file
+ */
+void Cache::mapFile(InternalDataType& item)
+{
+  if (item.mapping)
+  {
+    return;
+  }
+  item.mapping =
+      std::make_shared<juce::MemoryMappedFile>(item.buffer, juce::MemoryMappedFile::readOnly);
+  if (item.mapping->getData() == nullptr)
+  {
+    PLOGW << "could not map " << item.buffer.getFullPathName();
+    item.mapping.reset();
+    return;
+  }
+  rt::prefault(item.mapping->getData(), item.mapping->getSize());
+}
+
 /**
  * @brief Get a resource from the cache from an uri
  *
@@ -41,9 +120,9 @@ std::tuple<std::optional<Cache::DataType>, Error> Cache::get(juce::String const&
   const juce::URL url(uri);
 
   // check if already cached
-  if (m_ressourceMap.contains(url.toString(false)))
+  if (auto file = find(url.toString(false)))
   {
-    return std::make_tuple(m_ressourceMap.at(url.toString(false)).buffer, Error());
+    return std::make_tuple(file, Error());
   }
   else
   {
@@ -53,13 +132,201 @@ std::tuple<std::optional<Cache::DataType>, Error> Cache::get(juce::String const&
       return std::make_tuple(std::nullopt, err);
     }
 
-    if (!m_ressourceMap.contains(url.toString(false)))
+    file = find(url.toString(false));
+    if (!file)
     {
       auto err = fmt::format("unknown error while caching '{}", url.toString(false).toStdString());
       return std::make_tuple(std::nullopt, Error(err));
     }
-    return std::make_tuple(m_ressourceMap.at(url.toString(false)).buffer, Error());
+    return std::make_tuple(file, Error());
+  }
+}
+
+/**
+ * @brief Looks up a cached resource
+ *
+ * @param key   Key of the resource
+ * @return std::optional<Cache::DataType> The file, empty if it is not cached
+ */
+std::optional<Cache::DataType> Cache::find(juce::String const& key) const
+{
+  const std::lock_guard lock(m_mutex);
+  const auto item = m_ressourceMap.find(key);
+  if (item == m_ressourceMap.end())
+  {
+    return std::nullopt;
+  }
+  return item->second.buffer;
+}
+
+/**
+ * @brief Gain and start of a cached resource, applied when it is played.
+ *
+ * @param uri   The uri of the resource
+ * @return SampleMetadata The metadata, neutral for unknown resources
+ */
+SampleMetadata Cache::metadata(juce::String const& uri) const
+{
+  SampleMetadata metadata;
+  const std::lock_guard lock(m_mutex);
+  const auto item = m_ressourceMap.find(juce::URL(uri).toString(false));
+  if (item != m_ressourceMap.end())
+  {
+    metadata.gain = item->second.loudness.gain;
+    metadata.attackOffset = m_keepLeadingSilence ? 0 : item->second.attackOffset;
+  }
+  return metadata;
+}
+
+/**
+ * @brief Plays samples from their first frame instead of their attack.
+ *
+ * @param keep  True to keep the leading silence
+ */
+void Cache::keepLeadingSilence(bool keep) { m_keepLeadingSilence = keep; }
+
+/**
+ * @brief Get a resource decoded into memory, it is only decoded with the first request.
+ *
+ * The decoded sample belongs to the version of the file it was decoded from, reloading or removing
+ * the file drops it. A file that changes while it is decoded is decoded again with the next
+ * request. Decoded samples are limited to a memory budget, the least recently used samples that
+ * are not playing are dropped first. Samples that do not fit are returned without being kept.
+ *
+ * @param uri         The uri of the resource
+ * @param sampleRate  The sample rate to decode at
+ * @param decode      Decodes the file if it is not decoded at this sample rate yet
+ * @return std::tuple<std::shared_ptr<const SampleBuffer>, Error> The sample or an error
+ */
+std::tuple<std::shared_ptr<const SampleBuffer>, Error> Cache::decoded(juce::String const& uri,
+                                                                      double sampleRate,
+                                                                      Decoder const& decode)
+{
+  auto [file, err] = get(uri);
+  if (err)
+  {
+    return {nullptr, err};
+  }
+
+  const juce::String key = juce::URL(uri).toString(false);
+  SampleMetadata metadata;
+  std::uint64_t version = 0;
+  {
+    const std::lock_guard lock(m_mutex);
+    const auto item = m_ressourceMap.find(key);
+    if (item != m_ressourceMap.end())
+    {
+      metadata.gain = item->second.loudness.gain;
+      metadata.attackOffset = m_keepLeadingSilence ? 0 : item->second.attackOffset;
+      if (item->second.decoded && item->second.decodedSampleRate == sampleRate &&
+          item->second.decodedAttackOffset == metadata.attackOffset)
+      {
+        m_decodedLru.splice(m_decodedLru.begin(), m_decodedLru, item->second.decodedPosition);
+        return {item->second.decoded, Error()};
+      }
+      version = item->second.version;
+    }
+  }
+
+  auto [sample, decodeErr] = decode(file.value(), metadata);
+  if (decodeErr)
+  {
+    return {nullptr, decodeErr};
+  }
+  std::vector<std::shared_ptr<const SampleBuffer>> released;
+  {
+    const std::lock_guard lock(m_mutex);
+    const auto item = m_ressourceMap.find(key);
+    if (item != m_ressourceMap.end() && item->second.version == version)
+    {
+      forgetDecoded(item->second);
+      released.push_back(std::move(item->second.decoded));
+      const size_t size = sizeOf(*sample);
+      evictDecoded(size, released);
+      if (m_decodedBytes + size <= m_decodedBudgetBytes)
+      {
+        m_decodedLru.push_front(key);
+        item->second.decoded = sample;
+        item->second.decodedSampleRate = sampleRate;
+        item->second.decodedAttackOffset = metadata.attackOffset;
+        item->second.decodedPosition = m_decodedLru.begin();
+        m_decodedBytes += size;
+      }
+      else
+      {
+        PLOGD << "decoded sample cache full, " << key << " is not kept";
+      }
+    }
+  }
+  // replaced and evicted samples are released here, outside of the lock
+  return {sample, Error()};
+}
+
+/**
+ * @brief Limits the memory of the decoded resources.
+ *
+ * @param budgetBytes The budget in bytes
+ */
+void Cache::setDecodedBudget(size_t budgetBytes)
+{
+  std::vector<std::shared_ptr<const SampleBuffer>> evicted;
+  const std::lock_guard lock(m_mutex);
+  m_decodedBudgetBytes = budgetBytes;
+  evictDecoded(0, evicted);
+}
+
+/**
+ * @brief Removes the decoded sample of an item from the budget, must be called with the lock held.
+ *
+ * The sample itself stays with the item, so it can be released outside of the lock.
+ *
+ * @param item  The item that is replaced or removed
+ */
+void Cache::forgetDecoded(InternalDataType const& item)
+{
+  if (!item.decoded)
+  {
+    return;
   }
+  m_decodedBytes -= sizeOf(*item.decoded);
+  m_decodedLru.erase(item.decodedPosition);
+}
+
+/**
+ * @brief Drops the least recently used decoded samples until a sample of the size fits the budget.
+ *
+ * Must be called with the lock held. Samples that are still playing are kept.
+ *
+ * @param size    Size of the sample to make room for
+ * @param evicted Receives the dropped samples, to release them outside of the lock
+ */
+void Cache::evictDecoded(size_t size, std::vector<std::shared_ptr<const SampleBuffer>>& evicted)
+{
+  auto position = m_decodedLru.end();
+  while (position != m_decodedLru.begin() && m_decodedBytes + size > m_decodedBudgetBytes)
+  {
+    --position;
+    auto& item = m_ressourceMap.at(*position);
+    if (item.decoded.use_count() > 1)
+    {
+      continue;
+    }
+    m_decodedBytes -= sizeOf(*item.decoded);
+    evicted.push_back(std::move(item.decoded));
+    position = m_decodedLru.erase(position);
+  }
+}
+
+/**
+ * @brief Memory of a decoded sample.
+ *
+ * @param sample  The sample
+ * @return size_t Its size in bytes
+ */
+size_t Cache::sizeOf(SampleBuffer const& sample)
+{
+  return static_cast<size_t>(sample.getNumChannels()) *
+         static_cast<size_t>(sample.getNumSamples()) * sizeof(float);
 }
 
 namespace fs = std::filesystem;
@@ -140,10 +407,13 @@ std::tuple<juce::String, Error> Cache::download(juce::URL url, juce::File const&
 {
   juce::URL::DownloadTaskOptions downloadOptions;
   downloadOptions = downloadOptions.withListener(this);
-  if (m_ressourceMap.contains(url.toString(false)) && checkVersion)
+  if (checkVersion)
   {
-    downloadOptions = downloadOptions.withExtraHeaders("If-None-Match: " +
-                                                       m_ressourceMap.at(url.toString(false)).etag);
+    const std::lock_guard lock(m_mutex);
+    if (const auto item = m_ressourceMap.find(url.toString(false)); item != m_ressourceMap.end())
+    {
+      downloadOptions = downloadOptions.withExtraHeaders("If-None-Match: " + item->second.etag);
+    }
   }
 
   const juce::String etag;  //!< todo implement etags
@@ -167,7 +437,7 @@ std::tuple<juce::String, Error> Cache::download(juce::URL url, juce::File const&
 }
 
 /**
- * @brief Stores one item in the cache
+ * @brief Stores one item in the cache, replaces the item stored before
  *
  * @param key     Key to find the item
  * @param value   The acutal value to store
@@ -175,13 +445,38 @@ std::tuple<juce::String, Error> Cache::download(juce::URL url, juce::File const&
  * @return Error  Error if something went wrong
  */
 Error Cache::storeItem(juce::String const& key, DataType const& value, juce::String const& etag)
+{
+  auto [item, err] = loadItem(value, etag);
+  if (err)
+  {
+    return err;
+  }
+  InternalDataType replaced;
+  {
+    const std::lock_guard lock(m_mutex);
+    forgetDecoded(m_ressourceMap[key]);
+    replaced = std::exchange(m_ressourceMap[key], std::move(item));
+  }
+  // the mapping of the replaced item is released here, outside of the lock
+  return Error();
+}
+
+/**
+ * @brief Checks and analyses a file for the cache
+ *
+ * @param value   The file
+ * @param etag    The etag of this file version
+ * @return std::tuple<Cache::InternalDataType, Error> The item or an error
+ */
+std::tuple<Cache::InternalDataType, Error> Cache::loadItem(DataType const& value,
+                                                           juce::String const& etag)
 {
   // check if audio file is readable
   std::unique_ptr<juce::AudioFormatReader> reader(m_fmtManager.createReaderFor(value));
   if (!reader)
   {
     auto err = fmt::format("creating reader for '{}", value.getFullPathName().toStdString());
-    return Error(err);
+    return {InternalDataType(), Error(err)};
   }
 
   // check for maximum duration (consider rickroll case)
@@ -192,53 +487,179 @@ Error Cache::storeItem(juce::String const& key, DataType const& value, juce::Str
     {
       auto err = fmt::format("file '{}' is longer than maximum size of {}s",
                              value.getFullPathName().toStdString(), m_fileLengthLimitSeconds);
-      return Error(err);
+      return {InternalDataType(), Error(err)};
     }
   }
 
-  m_ressourceMap[key] = {
+  // analysed once, so playback only scales the voice gain and starts at the attack
+  auto [loudness, err] = analyseLoudness(*reader);
+  if (err)
+  {
+    return {InternalDataType(), Error(fmt::format("analysing '{}': {}",
+                                                  value.getFullPathName().toStdString(),
+                                                  err.what()))};
+  }
+  const auto gainDb = juce::Decibels::gainToDecibels(loudness.gain);
+  PLOGD << fmt::format("{}: {:.1f} LUFS, peak {:.1f} dBFS, true peak {:.1f} dBTP, gain {:+.1f} dB",
+                       value.getFileName().toStdString(), loudness.integratedLufs,
+                       loudness.peakDb, loudness.truePeakDb, gainDb);
+  const juce::int64 attackOffset =
+      findAttack(*reader, juce::Decibels::decibelsToGain(m_silenceThresholdDb));
+  if (attackOffset > 0)
+  {
+    PLOGD << fmt::format("{}: {:.1f} ms of leading silence", value.getFileName().toStdString(),
+                         1000.0 * static_cast<double>(attackOffset) / reader->sampleRate);
+  }
+
+  InternalDataType item = {
       value,
       etag,
+      nullptr,
+      loudness,
+      attackOffset,
+      ++m_version,
   };
-
-  return Error();
+  if (m_prefault)
+  {
+    mapFile(item);
+  }
+  return {item, Error()};
 }
 
 /**
- * @brief Render the progress to stdout
+ * @brief Analyses a changed file again and swaps it in for every key it is cached under.
  *
- * @param bytesDownloaded   Bytes already downloaded
- * @param totalLength       Length of the file in bytes
+ * Files that have not been requested yet are left to the lazy path. The file has been renamed over
+ * the old version, so sounds still playing the old version keep its inode through their reader or
+ * their decoded buffer and finish undisturbed.
+ *
+ * @param file  The changed file
  */
-void Cache::progress(juce::URL::DownloadTask*, juce::int64 bytesDownloaded, juce::int64 totalLength)
+void Cache::refresh(DataType const& file)
 {
-  double progress = static_cast<double>(bytesDownloaded) / static_cast<double>(totalLength);
-  progress = progress < 0 ? 0 : progress;
-  const int barWidth = 70;
+  std::vector<juce::String> keys;
+  {
+    const std::lock_guard lock(m_mutex);
+    for (const auto& [key, item] : m_ressourceMap)
+    {
+      if (item.buffer == file)
+      {
+        keys.push_back(key);
+      }
+    }
+  }
+  if (keys.empty())
+  {
+    return;
+  }
+
+  // local files have no etag
+  auto [item, err] = loadItem(file, "");
+  if (err)
+  {
+    // the next request tries again
+    PLOGW << "reloading failed, " << err.what();
+    remove(file);
+    return;
+  }
+  std::vector<InternalDataType> replaced;
+  {
+    const std::lock_guard lock(m_mutex);
+    for (const auto& key : keys)
+    {
+      forgetDecoded(m_ressourceMap[key]);
+      replaced.push_back(std::exchange(m_ressourceMap[key], item));
+    }
+  }
+  PLOGI << "reloaded " << file.getFullPathName();
+}
 
-  std::cout << "[";
-  const int pos = static_cast<int>(barWidth * progress);
-  for (int i = 0; i < barWidth; ++i)
+/**
+ * @brief Analyses all cached local files again, when changes might have been missed.
+ *
+ */
+void Cache::refreshAll()
+{
+  std::set<DataType> files;
   {
-    if (i < pos)
+    const std::lock_guard lock(m_mutex);
+    for (const auto& [key, item] : m_ressourceMap)
     {
-      std::cout << "=";
+      if (item.buffer.isAChildOf(m_sampleDir))
+      {
+        files.insert(item.buffer);
+      }
     }
-    else if (i == pos)
+  }
+  for (const auto& file : files)
+  {
+    if (file.existsAsFile())
     {
-      std::cout << ">";
+      refresh(file);
     }
     else
     {
-      std::cout << " ";
+      remove(file);
     }
   }
-  std::cout << "] " << int(progress * 100.0) << " %\r";
-  std::cout.flush();
+}
 
-  if (progress >= 1.0)
+/**
+ * @brief Drops a removed file from the cache and releases its memory.
+ *
+ * @param file  The removed file, or directory to drop all files in
+ */
+void Cache::remove(DataType const& file)
+{
+  std::vector<InternalDataType> removed;
   {
-    std::cout << std::endl;
+    const std::lock_guard lock(m_mutex);
+    for (auto item = m_ressourceMap.begin(); item != m_ressourceMap.end();)
+    {
+      if (item->second.buffer == file || item->second.buffer.isAChildOf(file))
+      {
+        forgetDecoded(item->second);
+        removed.push_back(std::move(item->second));
+        item = m_ressourceMap.erase(item);
+      }
+      else
+      {
+        ++item;
+      }
+    }
+  }
+  if (!removed.empty())
+  {
+    PLOGI << "removed " << file.getFullPathName() << " from the cache";
+  }
+  // the mappings of the removed items are released here, outside of the lock
+}
+
+/**
+ * @brief Logs the progress in steps, not with every chunk
+ *
+ * Every download keeps its own step, downloads may run at the same time.
+ *
+ * @param task              The download task
+ * @param bytesDownloaded   Bytes already downloaded
+ * @param totalLength       Length of the file in bytes
+ */
+void Cache::progress(juce::URL::DownloadTask* task, juce::int64 bytesDownloaded,
+                     juce::int64 totalLength)
+{
+  if (totalLength <= 0)
+  {
+    return;
+  }
+  const auto percent = static_cast<int>(bytesDownloaded * 100 / totalLength);
+  const int step = percent / progressStepPercent;
+  const std::lock_guard lock(m_progressMutex);
+  auto& loggedStep = m_progressSteps.try_emplace(task, -1).first->second;
+  if (step > loggedStep)
+  {
+    loggedStep = step;
+    PLOGD << "download of " << task->getTargetLocation().getFileName() << " "
+          << step * progressStepPercent << "%";
   }
 }
 
@@ -248,5 +669,9 @@ void Cache::progress(juce::URL::DownloadTask*, juce::int64 bytesDownloaded, juce
  * @param task      Pointer to the download task
  * @param success   boolean to signal if the download was successful
  */
-void Cache::finished(juce::URL::DownloadTask*, bool) {}
+void Cache::finished(juce::URL::DownloadTask* task, bool)
+{
+  const std::lock_guard lock(m_progressMutex);
+  m_progressSteps.erase(task);
+}
 }  // namespace beak
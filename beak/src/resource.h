@@ -5,11 +5,21 @@
 #include <juce_core/juce_core.h>
 #include <plog/Log.h>
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "error.h"
+#include "loudness.h"
+#include "sampleBuffer.h"
+#include "sampleMetadata.h"
 
 namespace beak
 {
@@ -19,11 +29,24 @@ class Cache : public juce::URL::DownloadTaskListener
 {
   typedef juce::File DataType;
 
+ public:
+  /** Decodes a file with its metadata, at the sample rate the cache is asked for */
+  using Decoder = std::function<std::tuple<std::shared_ptr<const SampleBuffer>, Error>(
+      juce::File const&, SampleMetadata const&)>;
+
  private:
   struct InternalDataType
   {
     DataType buffer;
     juce::String etag;
+    std::shared_ptr<juce::MemoryMappedFile> mapping;  //!< Keeps the file resident if prefaulted
+    Loudness loudness;                                //!< Analysed once when stored
+    juce::int64 attackOffset{0};                      //!< Frames of leading silence
+    std::uint64_t version{0};                         //!< Changes with every analysis of the file
+    std::shared_ptr<const SampleBuffer> decoded{};    //!< Dropped with the item when it changes
+    double decodedSampleRate{0.0};
+    juce::int64 decodedAttackOffset{0};
+    std::list<juce::String>::iterator decodedPosition{};  //!< In the lru list if decoded is set
   };
 
  public:
@@ -35,16 +58,35 @@ class Cache : public juce::URL::DownloadTaskListener
   }
 
   [[nodiscard]] Error configure();
+  void prefault();
 
   [[nodiscard]] std::tuple<std::optional<DataType>, Error> get(juce::String const& uri);
+  SampleMetadata metadata(juce::String const& uri) const;
+  [[nodiscard]] std::tuple<std::shared_ptr<const SampleBuffer>, Error> decoded(
+      juce::String const& uri, double sampleRate, Decoder const& decode);
+  void setDecodedBudget(size_t budgetBytes);
+  void keepLeadingSilence(bool keep);
   [[nodiscard]] Error cacheFile(juce::URL const& url, bool checkVersion = false);
+  juce::File resourceDirectory() const { return m_sampleDir; }
+
+  // resource watcher
+  void refresh(juce::File const& file);
+  void refreshAll();
+  void remove(juce::File const& file);
 
  private:
   [[nodiscard]] std::tuple<juce::String, Error> download(juce::URL url,
                                                          juce::File const& destination,
                                                          bool checkVersion);
+  void mapFile(InternalDataType& item);
   [[nodiscard]] Error storeItem(juce::String const& key, juce::File const& file,
                                 juce::String const& etag = "");
+  [[nodiscard]] std::tuple<InternalDataType, Error> loadItem(juce::File const& file,
+                                                             juce::String const& etag);
+  std::optional<DataType> find(juce::String const& key) const;
+  void forgetDecoded(InternalDataType const& item);
+  void evictDecoded(size_t size, std::vector<std::shared_ptr<const SampleBuffer>>& evicted);
+  static size_t sizeOf(SampleBuffer const& sample);
 
   // download status
   void progress(juce::URL::DownloadTask*, juce::int64 bytesDownloaded,
@@ -55,7 +97,18 @@ class Cache : public juce::URL::DownloadTaskListener
   juce::AudioFormatManager m_fmtManager;
   juce::File m_cachePath;
   juce::File m_sampleDir;
+  mutable std::mutex m_mutex;  //!< Guards the resources, the watcher replaces them
   std::map<juce::String, InternalDataType> m_ressourceMap;
+  std::list<juce::String> m_decodedLru;  //!< Keys of decoded resources, most recently used first
+  size_t m_decodedBytes{0};              //!< Memory of the decoded resources
+  size_t m_decodedBudgetBytes{defaultDecodedBudgetBytes};
   static constexpr double m_fileLengthLimitSeconds = 400.0f;
+  static constexpr size_t defaultDecodedBudgetBytes = size_t{256} << 20;
+  static constexpr float m_silenceThresholdDb = -60.0f;  //!< Quieter leading frames are skipped
+  std::atomic<bool> m_prefault{false};
+  std::atomic<bool> m_keepLeadingSilence{false};
+  std::mutex m_progressMutex;  //!< Guards the progress, downloads report from threads of their own
+  std::map<juce::URL::DownloadTask*, int> m_progressSteps;  //!< Last logged step per download
+  std::atomic<std::uint64_t> m_version{0};  //!< Last version handed to an analysed file
 };
 }  // namespace beak
@@ -0,0 +1,181 @@
+#include "resourceWatcher.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <plog/Log.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <set>
+
+namespace beak
+{
+#ifdef __linux__
+constexpr uint32_t watchMask = IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |
+                               IN_CREATE;  //!< Events that replace the content of a directory
+#endif
+
+/**
+ * @brief Construct a new Resource Watcher:: Resource Watcher object
+ *
+ * @param cache     The cache to keep up to date
+ * @param directory The resource directory, watched with all its subdirectories
+ */
+ResourceWatcher::ResourceWatcher(Cache &cache, const juce::File &directory) :
+  juce::Thread("beak resources"), m_cache(cache), m_directory(directory)
+{
+}
+
+/**
+ * @brief Destroy the Resource Watcher:: Resource Watcher object
+ *
+ */
+ResourceWatcher::~ResourceWatcher()
+{
+  stopThread(2 * pollMs);
+#ifdef __linux__
+  if (m_fd >= 0)
+  {
+    close(m_fd);
+  }
+#endif
+}
+
+/**
+ * @brief Watches the directory tree and starts the thread.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error ResourceWatcher::start()
+{
+#ifdef __linux__
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0)
+  {
+    return Error(juce::String("inotify failed: ") + std::strerror(errno));
+  }
+  watch(m_directory);
+  if (m_watches.empty())
+  {
+    return Error("could not watch " + m_directory.getFullPathName());
+  }
+  startThread(juce::Thread::Priority::low);
+  PLOGI << "watching " << m_watches.size() << " resource directories";
+  return Error();
+#else
+  return Error("watching resources is only supported on linux");
+#endif
+}
+
+/**
+ * @brief Waits for changes until the thread is stopped.
+ *
+ */
+void ResourceWatcher::run()
+{
+#ifdef __linux__
+  while (!threadShouldExit())
+  {
+    pollfd fd{m_fd, POLLIN, 0};
+    if (poll(&fd, 1, pollMs) > 0)
+    {
+      handleEvents();
+    }
+  }
+#endif
+}
+
+/**
+ * @brief Watches a directory and all its subdirectories.
+ *
+ * @param directory The directory
+ */
+void ResourceWatcher::watch(const juce::File &directory)
+{
+#ifdef __linux__
+  const int wd = inotify_add_watch(m_fd, directory.getFullPathName().toRawUTF8(), watchMask);
+  if (wd < 0)
+  {
+    PLOGW << "could not watch " << directory.getFullPathName() << ": " << std::strerror(errno);
+    return;
+  }
+  m_watches[wd] = directory;
+  for (const auto &child : directory.findChildFiles(juce::File::findDirectories, false))
+  {
+    watch(child);
+  }
+#else
+  juce::ignoreUnused(directory);
+#endif
+}
+
+/**
+ * @brief Reads the pending events and applies them to the cache.
+ *
+ * Replaced files are reloaded once per batch of events, however often they were replaced.
+ */
+void ResourceWatcher::handleEvents()
+{
+#ifdef __linux__
+  alignas(inotify_event) std::array<char, 4096> buffer;
+  std::set<juce::File> changed;
+  ssize_t length = 0;
+  while ((length = read(m_fd, buffer.data(), buffer.size())) > 0)
+  {
+    for (ssize_t offset = 0; offset < length;)
+    {
+      const auto *event = reinterpret_cast<const inotify_event *>(buffer.data() + offset);
+      offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+      if (event->mask & IN_Q_OVERFLOW)
+      {
+        PLOGW << "resource events overflowed, reloading all cached resources";
+        m_cache.refreshAll();
+        continue;
+      }
+      if (event->mask & IN_IGNORED)
+      {
+        m_watches.erase(event->wd);
+        continue;
+      }
+      const auto directory = m_watches.find(event->wd);
+      if (directory == m_watches.end() || event->len == 0)
+      {
+        continue;
+      }
+      const juce::File file = directory->second.getChildFile(event->name);
+
+      if (event->mask & IN_ISDIR)
+      {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        {
+          watch(file);
+        }
+        else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+          m_cache.remove(file);
+        }
+      }
+      else if (event->mask & IN_MOVED_TO)
+      {
+        changed.insert(file);
+      }
+      else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+      {
+        changed.erase(file);
+        m_cache.remove(file);
+      }
+    }
+  }
+  for (const auto &file : changed)
+  {
+    m_cache.refresh(file);
+  }
+#endif
+}
+}  // namespace beak
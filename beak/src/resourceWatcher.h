@@ -0,0 +1,48 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <map>
+
+#include "error.h"
+#include "resource.h"
+
+namespace beak
+{
+/**
+ * @brief Watches the resource directory with inotify and keeps the cache up to date.
+ *
+ * A thread of its own waits for changes. Replaced files are analysed again and swapped into the
+ * cache, removed files are dropped from it and their memory is released. New directories are
+ * watched as they appear, so content can be updated without a restart and without a rescan.
+ * Only supported on linux.
+ *
+ * Files have to be replaced atomically, written next to the directory and renamed into it. Sounds
+ * of a single channel stream their file while they play, so a file rewritten in place would change
+ * under them. Such writes are not picked up.
+ */
+class ResourceWatcher : private juce::Thread
+{
+ public:
+  static constexpr int pollMs{100};  //!< Interval in which the thread checks if it should exit
+
+ public:
+  ResourceWatcher(Cache &cache, const juce::File &directory);
+  ~ResourceWatcher() override;
+  ResourceWatcher(const ResourceWatcher &) = delete;
+  ResourceWatcher &operator=(const ResourceWatcher &) = delete;
+
+  [[nodiscard]] Error start();
+
+ private:
+  void run() override;
+  void watch(const juce::File &directory);
+  void handleEvents();
+
+ private:
+  Cache &m_cache;
+  juce::File m_directory;
+  int m_fd{-1};
+  std::map<int, juce::File> m_watches;  //!< Watched directories by watch descriptor
+};
+}  // namespace beak
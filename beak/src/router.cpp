@@ -0,0 +1,539 @@
+#include "router.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+#include <plog/Log.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+#include "overload.h"
+
+namespace beak::net
+{
+/**
+ * @brief Parses a channel of a route, channels start at 1.
+ *
+ * @param text     The channel
+ * @param channel  Set to the channel
+ * @return true    The channel is valid
+ */
+static bool parseChannel(const std::string &text, uint32_t &channel)
+{
+  const char *end = text.data() + text.size();
+  const auto [ptr, error] = std::from_chars(text.data(), end, channel);
+  return error == std::errc() && ptr == end && channel >= 1;
+}
+
+/**
+ * @brief Construct a new Router:: Router object
+ *
+ * @param ioCtx  The io context the router runs on
+ * @param port   The public port
+ */
+Router::Router(asio::io_context &ioCtx, uint16_t port) :
+  m_ioCtx(ioCtx),
+  m_socket(ioCtx, udp::endpoint(udp::v4(), static_cast<asio::ip::port_type>(port))),
+  m_statusTimer(ioCtx)
+{
+}
+
+/**
+ * @brief Adds a route of the form <first>-<last>@<host>:<port>[/<local channel>].
+ *
+ * The public channels first to last are played on the backend, starting at the local channel,
+ * which defaults to 1. A single channel can be given without the last one.
+ *
+ * @param route   The route
+ * @return Error  Custom error to signal a failure
+ */
+Error Router::addRoute(const std::string &route)
+{
+  const auto invalid = [&route]()
+  { return Error("invalid route " + route + ", use <first>-<last>@<host>:<port>[/<channel>]"); };
+  const auto at = route.find('@');
+  const auto colon = route.rfind(':');
+  if (at == std::string::npos || colon == std::string::npos || colon < at)
+  {
+    return invalid();
+  }
+  const auto slash = route.find('/', colon);
+  const std::string channels = route.substr(0, at);
+  const std::string host = route.substr(at + 1, colon - at - 1);
+  const std::string port =
+      route.substr(colon + 1, slash == std::string::npos ? std::string::npos : slash - colon - 1);
+
+  Route parsed{0, 0, 0, 1};
+  const auto dash = channels.find('-');
+  const std::string last = dash == std::string::npos ? channels : channels.substr(dash + 1);
+  if (!parseChannel(channels.substr(0, dash), parsed.first) || !parseChannel(last, parsed.last) ||
+      parsed.last < parsed.first ||
+      (slash != std::string::npos && !parseChannel(route.substr(slash + 1), parsed.localFirst)))
+  {
+    return invalid();
+  }
+  for (const auto &existing : m_routes)
+  {
+    if (parsed.first <= existing.last && existing.first <= parsed.last)
+    {
+      return Error("route " + route + " overlaps another route");
+    }
+  }
+
+  const std::string name = host + ":" + port;
+  const auto backend = std::find_if(m_backends.begin(), m_backends.end(),
+                                    [&name](const Backend &candidate)
+                                    { return candidate.name == name; });
+  parsed.backend = static_cast<size_t>(std::distance(m_backends.begin(), backend));
+  if (backend == m_backends.end())
+  {
+    asio::error_code error;
+    udp::resolver resolver(m_ioCtx);
+    const auto endpoints = resolver.resolve(udp::v4(), host, port, error);
+    if (error || endpoints.empty())
+    {
+      return Error("backend " + name + ": " + (error ? error.message() : "not found"));
+    }
+    m_backends.push_back(Backend{name, endpoints.begin()->endpoint(), BeakStatus(), 0, false});
+  }
+  m_routes.push_back(parsed);
+  return Error();
+}
+
+/**
+ * @brief Starts forwarding and asking the backends for their load.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error Router::start()
+{
+  if (m_routes.empty())
+  {
+    return Error("the router has no routes, use --routes");
+  }
+  for (const auto &route : m_routes)
+  {
+    PLOGI << "routing channels " << route.first << "-" << route.last << " to "
+          << m_backends[route.backend].name << " as " << route.localFirst << "-"
+          << route.localFirst + route.last - route.first;
+  }
+  startReceive();
+  requestStatus();
+  return Error();
+}
+
+/**
+ * @brief Waits for the next datagram.
+ *
+ */
+void Router::startReceive()
+{
+  m_socket.async_receive_from(
+      asio::buffer(m_recvBuffer), m_remoteEndpoint,
+      std::bind(&Router::handleReceive, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+/**
+ * @brief Handles the datagram and all others that are already waiting, then sends the result.
+ *
+ * A backend that is not running answers with port unreachable, which fails the next receive, so
+ * errors do not stop the router.
+ *
+ * @param error  Error of the receive
+ * @param sz     Size of the datagram
+ */
+void Router::handleReceive(const asio::error_code &error, std::size_t sz)
+{
+  if (error == asio::error::operation_aborted)
+  {
+    return;
+  }
+  if (!error)
+  {
+    handle(sz);
+  }
+  asio::error_code receiveError;
+  for (size_t i = 1; i < maxBatch && m_socket.available(receiveError) > 0; ++i)
+  {
+    const std::size_t received =
+        m_socket.receive_from(asio::buffer(m_recvBuffer), m_remoteEndpoint, 0, receiveError);
+    if (!receiveError)
+    {
+      handle(received);
+    }
+  }
+  flush();
+  startReceive();
+}
+
+/**
+ * @brief Queues the packet of a datagram for the backends that own its channels.
+ *
+ * @param sz  Size of the datagram
+ */
+void Router::handle(std::size_t sz)
+{
+  if (!m_packet.ParseFromArray(m_recvBuffer.data(), static_cast<int>(sz)))
+  {
+    return;
+  }
+  switch (m_packet.content_case())
+  {
+    case Packet::kAudioFrame:
+      if (m_packet.audio_frame().has_fan_out())
+      {
+        forwardAudio(sz);
+      }
+      else
+      {
+        forwardToChannel(m_packet.audio_frame().channel(), sz);
+      }
+      break;
+    case Packet::kSynthFrame:
+      // patches are registered on every backend, they are selected by id later
+      if (m_packet.synth_frame().event_type() == REGISTER_PATCH)
+      {
+        queueToAll(sz);
+      }
+      else
+      {
+        forwardToChannel(m_packet.synth_frame().channel(), sz);
+      }
+      break;
+    case Packet::kSynthRamp:
+      forwardToChannel(m_packet.synth_ramp().channel(), sz);
+      break;
+    case Packet::kSynthSequence:
+      forwardSequence();
+      break;
+    case Packet::kSequenceControl:
+    case Packet::kRecorderControl:
+      queueToAll(sz);
+      break;
+    case Packet::kBeakStatus:
+      handleStatus();
+      break;
+    default:
+      // pixels and inputs are not for beak
+      break;
+  }
+}
+
+/**
+ * @brief Queues a packet of one channel for the backend of the channel.
+ *
+ * The datagram is forwarded as received if the backend plays it on the same channel.
+ *
+ * @param channel  The public channel
+ * @param sz       Size of the datagram
+ */
+void Router::forwardToChannel(uint32_t channel, std::size_t sz)
+{
+  const Route *route = find(channel);
+  if (route == nullptr)
+  {
+    PLOGD << "channel " << channel << " has no route";
+    return;
+  }
+  const auto &backend = m_backends[route->backend];
+  const uint32_t local = route->localFirst + channel - route->first;
+  if (local == channel)
+  {
+    queueRaw(backend.endpoint, sz);
+    return;
+  }
+  if (m_packet.has_audio_frame())
+  {
+    m_packet.mutable_audio_frame()->set_channel(local);
+  }
+  else if (m_packet.has_synth_ramp())
+  {
+    m_packet.mutable_synth_ramp()->set_channel(local);
+  }
+  else
+  {
+    m_packet.mutable_synth_frame()->set_channel(local);
+  }
+  m_packet.SerializeToString(&queue(backend.endpoint));
+}
+
+/**
+ * @brief Splits a fan-out into one per backend with the channels the backend owns.
+ *
+ * Every backend decodes the sample once for its channels. Stops reach all backends. Positional
+ * fan-outs depend on the channel layout of one engine and can not be split.
+ *
+ * @param sz  Size of the datagram
+ */
+void Router::forwardAudio(std::size_t sz)
+{
+  const auto &frame = m_packet.audio_frame();
+  if (frame.stop())
+  {
+    queueToAll(sz);
+    return;
+  }
+  const auto &fanOut = frame.fan_out();
+  if (fanOut.positional())
+  {
+    PLOGW << "positional fan-outs can not be split across backends, use channels and gains";
+    return;
+  }
+
+  m_split.resize(m_backends.size());
+  for (auto &packet : m_split)
+  {
+    packet.Clear();
+  }
+  for (int i = 0; i < fanOut.channels_size(); ++i)
+  {
+    const Route *route = find(fanOut.channels(i));
+    if (route == nullptr)
+    {
+      PLOGD << "channel " << fanOut.channels(i) << " has no route";
+      continue;
+    }
+    auto *split = m_split[route->backend].mutable_audio_frame()->mutable_fan_out();
+    split->add_channels(route->localFirst + fanOut.channels(i) - route->first);
+    split->add_gains(i < fanOut.gains_size() ? fanOut.gains(i) : 1.0f);
+  }
+  for (size_t backend = 0; backend < m_backends.size(); ++backend)
+  {
+    auto &split = m_split[backend];
+    if (!split.has_audio_frame())
+    {
+      continue;
+    }
+    split.mutable_audio_frame()->set_uri(frame.uri());
+    split.mutable_audio_frame()->set_priority(frame.priority());
+    split.SerializeToString(&queue(m_backends[backend].endpoint));
+  }
+}
+
+/**
+ * @brief Splits a sequence into one per backend with the tracks of the channels it owns.
+ *
+ * Backends without tracks get an empty sequence, so none of them keeps playing an old one.
+ *
+ */
+void Router::forwardSequence()
+{
+  const auto &sequence = m_packet.synth_sequence();
+  m_split.resize(m_backends.size());
+  for (auto &packet : m_split)
+  {
+    packet.Clear();
+    auto *split = packet.mutable_synth_sequence();
+    split->set_bpm(sequence.bpm());
+    split->set_ticks_per_beat(sequence.ticks_per_beat());
+    split->set_length_ticks(sequence.length_ticks());
+    split->set_loop(sequence.loop());
+    split->set_loop_start_ticks(sequence.loop_start_ticks());
+  }
+  for (const auto &track : sequence.tracks())
+  {
+    const Route *route = find(track.channel());
+    if (route == nullptr)
+    {
+      PLOGD << "channel " << track.channel() << " has no route";
+      continue;
+    }
+    auto *split = m_split[route->backend].mutable_synth_sequence()->add_tracks();
+    split->CopyFrom(track);
+    split->set_channel(route->localFirst + track.channel() - route->first);
+  }
+  for (size_t backend = 0; backend < m_backends.size(); ++backend)
+  {
+    m_split[backend].SerializeToString(&queue(m_backends[backend].endpoint));
+  }
+}
+
+/**
+ * @brief Takes the reply of a backend, or answers a request with the busiest backend.
+ *
+ */
+void Router::handleStatus()
+{
+  const auto backend = std::find_if(m_backends.begin(), m_backends.end(),
+                                    [this](const Backend &candidate)
+                                    { return candidate.endpoint == m_remoteEndpoint; });
+  if (backend == m_backends.end())
+  {
+    Packet reply;
+    auto *status = reply.mutable_beak_status();
+    for (const auto &candidate : m_backends)
+    {
+      if (candidate.isUp && candidate.status.load() >= status->load())
+      {
+        status->CopyFrom(candidate.status);
+      }
+    }
+    reply.SerializeToString(&queue(m_remoteEndpoint));
+    return;
+  }
+
+  const auto &status = m_packet.beak_status();
+  if (!backend->isUp)
+  {
+    PLOGI << "backend " << backend->name << " is up";
+  }
+  if (status.degradation() != backend->status.degradation())
+  {
+    constexpr auto highest = static_cast<uint32_t>(Degradation::RefuseTriggers);
+    const auto level = static_cast<Degradation>(std::min(status.degradation(), highest));
+    PLOGI << "backend " << backend->name << " degradation " << toString(level);
+  }
+  backend->status = status;
+  backend->missedStatus = 0;
+  backend->isUp = true;
+}
+
+/**
+ * @brief Finds the route of a public channel.
+ *
+ * @param channel          The public channel
+ * @return const Route*    The route, nullptr if the channel has none
+ */
+const Router::Route *Router::find(uint32_t channel) const
+{
+  const auto route =
+      std::find_if(m_routes.begin(), m_routes.end(), [channel](const Route &candidate)
+                   { return channel >= candidate.first && channel <= candidate.last; });
+  return route != m_routes.end() ? &*route : nullptr;
+}
+
+/**
+ * @brief Queues a datagram, the buffers of earlier flushes are reused.
+ *
+ * @param endpoint      Receiver of the datagram
+ * @return std::string& The payload to fill
+ */
+std::string &Router::queue(const udp::endpoint &endpoint)
+{
+  if (m_numOutgoing == m_outbox.size())
+  {
+    m_outbox.emplace_back();
+  }
+  auto &outgoing = m_outbox[m_numOutgoing++];
+  outgoing.endpoint = endpoint;
+  outgoing.payload.clear();
+  return outgoing.payload;
+}
+
+/**
+ * @brief Queues the received datagram unchanged.
+ *
+ * @param endpoint  Receiver of the datagram
+ * @param sz        Size of the datagram
+ */
+void Router::queueRaw(const udp::endpoint &endpoint, std::size_t sz)
+{
+  queue(endpoint).assign(m_recvBuffer.data(), sz);
+}
+
+/**
+ * @brief Queues the received datagram unchanged for every backend.
+ *
+ * @param sz  Size of the datagram
+ */
+void Router::queueToAll(std::size_t sz)
+{
+  for (const auto &backend : m_backends)
+  {
+    queueRaw(backend.endpoint, sz);
+  }
+}
+
+/**
+ * @brief Sends all queued datagrams, on linux with one system call for up to a batch of them.
+ *
+ */
+void Router::flush()
+{
+#ifdef __linux__
+  for (size_t start = 0; start < m_numOutgoing; start += maxBatch)
+  {
+    const size_t count = std::min(maxBatch, m_numOutgoing - start);
+    std::array<mmsghdr, maxBatch> messages{};
+    std::array<iovec, maxBatch> iovecs{};
+    for (size_t i = 0; i < count; ++i)
+    {
+      auto &outgoing = m_outbox[start + i];
+      iovecs[i].iov_base = outgoing.payload.data();
+      iovecs[i].iov_len = outgoing.payload.size();
+      messages[i].msg_hdr.msg_name = outgoing.endpoint.data();
+      messages[i].msg_hdr.msg_namelen = static_cast<socklen_t>(outgoing.endpoint.size());
+      messages[i].msg_hdr.msg_iov = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t sent = 0;
+    while (sent < count)
+    {
+      const int result = sendmmsg(m_socket.native_handle(), messages.data() + sent,
+                                  static_cast<unsigned int>(count - sent), 0);
+      if (result < 0)
+      {
+        // the first datagram failed, the others still go out
+        PLOGD << "forwarding to " << m_outbox[start + sent].endpoint
+              << " failed: " << std::strerror(errno);
+        ++sent;
+        continue;
+      }
+      sent += static_cast<size_t>(result);
+    }
+  }
+#else
+  for (size_t i = 0; i < m_numOutgoing; ++i)
+  {
+    asio::error_code error;
+    m_socket.send_to(asio::buffer(m_outbox[i].payload), m_outbox[i].endpoint, 0, error);
+    if (error)
+    {
+      PLOGD << "forwarding to " << m_outbox[i].endpoint << " failed: " << error.message();
+    }
+  }
+#endif
+  m_numOutgoing = 0;
+}
+
+/**
+ * @brief Asks every backend for its load and reports backends that stopped answering.
+ *
+ */
+void Router::requestStatus()
+{
+  Packet request;
+  request.mutable_beak_status();
+  const bool isReport = ++m_statusRequests % statusLogIntervals == 0;
+  for (auto &backend : m_backends)
+  {
+    if (++backend.missedStatus == missedStatusLimit)
+    {
+      PLOGW << "backend " << backend.name << " does not answer";
+      backend.isUp = false;
+    }
+    if (isReport && backend.isUp)
+    {
+      PLOGD << "backend " << backend.name << ": load " << backend.status.load() << ", peak "
+            << backend.status.peak_load() << ", overruns " << backend.status.overruns()
+            << ", coalesced configs " << backend.status.coalesced_configs();
+    }
+    request.SerializeToString(&queue(backend.endpoint));
+  }
+  flush();
+
+  m_statusTimer.expires_after(std::chrono::milliseconds(statusIntervalMs));
+  m_statusTimer.async_wait(
+      [this](const asio::error_code &error)
+      {
+        if (!error)
+        {
+          requestStatus();
+        }
+      });
+}
+}  // namespace beak::net
@@ -0,0 +1,92 @@
+#pragma once
+#include <asio.hpp>
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "proto.h"
+#include "server.h"
+
+namespace beak::net
+{
+/**
+ * @brief Forwards the events of the public port to backend instances of beak by channel.
+ *
+ * Every route maps a range of public channels to a backend and the local channel the range starts
+ * at there, so each backend can run its own device on its own core or host. Packets are parsed
+ * once; if the channel does not change they are forwarded as received, otherwise they are written
+ * again with the local channel. All datagrams waiting on the socket are handled in one go and
+ * their packets are sent with a single system call. Backends are asked for their load regularly.
+ */
+class Router
+{
+ public:
+  static constexpr int statusIntervalMs{1000};   //!< Interval in which backends report their load
+  static constexpr int missedStatusLimit{3};     //!< Unanswered requests until a backend is down
+  static constexpr int statusLogIntervals{10};   //!< Requests between two load reports in the log
+  static constexpr size_t maxBatch{64};          //!< Datagrams handled with one wakeup
+
+ public:
+  Router(asio::io_context &ioCtx, uint16_t port);
+  Router(const Router &) = delete;
+  Router &operator=(const Router &) = delete;
+
+  [[nodiscard]] Error addRoute(const std::string &route);
+  [[nodiscard]] Error start();
+
+ private:
+  struct Backend
+  {
+    std::string name;  //!< host:port as configured
+    udp::endpoint endpoint;
+    BeakStatus status;
+    int missedStatus{0};
+    bool isUp{false};
+  };
+
+  struct Route
+  {
+    uint32_t first;
+    uint32_t last;
+    size_t backend;
+    uint32_t localFirst;  //!< Local channel of the first channel on the backend
+  };
+
+  struct Outgoing
+  {
+    udp::endpoint endpoint;
+    std::string payload;
+  };
+
+  void startReceive();
+  void handleReceive(const asio::error_code &error, std::size_t sz);
+  void handle(std::size_t sz);
+  void handleStatus();
+  void forwardToChannel(uint32_t channel, std::size_t sz);
+  void forwardAudio(std::size_t sz);
+  void forwardSequence();
+  [[nodiscard]] const Route *find(uint32_t channel) const;
+  std::string &queue(const udp::endpoint &endpoint);
+  void queueRaw(const udp::endpoint &endpoint, std::size_t sz);
+  void queueToAll(std::size_t sz);
+  void flush();
+  void requestStatus();
+
+ private:
+  asio::io_context &m_ioCtx;
+  udp::socket m_socket;
+  udp::endpoint m_remoteEndpoint;
+  asio::steady_timer m_statusTimer;
+  std::array<char, bufferSize> m_recvBuffer{};
+  Packet m_packet;              //!< Reused for every datagram
+  std::vector<Packet> m_split;  //!< Reused, packets split up by backend
+  std::vector<Backend> m_backends;
+  std::vector<Route> m_routes;
+  std::vector<Outgoing> m_outbox;  //!< Reused, only the first m_numOutgoing are queued
+  size_t m_numOutgoing{0};
+  int m_statusRequests{0};
+};
+}  // namespace beak::net
@@ -0,0 +1,277 @@
+#include "rtCheck.h"
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <plog/Log.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+// the allocator of glibc, used by the replacements below
+extern "C"
+{
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void __libc_free(void *ptr);
+}
+
+namespace beak::rtcheck
+{
+namespace
+{
+constexpr int skippedFrames = 2;  //!< Frames of the checker itself, on top of every stack trace
+constexpr int keyFrames = 8;      //!< Frames below the checker that identify a call site
+
+/**
+ * @brief A call site that broke real-time safety on the audio thread.
+ *
+ */
+struct Violation
+{
+  std::atomic<bool> ready{false};  //!< Set once the violation is completely written
+  const char *function{nullptr};   //!< The function that was called
+  size_t key{0};                   //!< Hash of the innermost frames
+  std::atomic<int> count{0};       //!< Times the call site was hit, updated without ordering
+  int numFrames{0};
+  std::array<void *, maxFrames> frames{};
+};
+
+std::array<Violation, maxViolations> violations;
+std::atomic<int> numRecorded{0};
+std::atomic<int> numTotal{0};
+
+thread_local int t_audioDepth{0};   //!< Nesting of audio thread scopes
+thread_local bool t_inHook{false};  //!< Calls made by the checker itself are not checked
+
+// the first backtrace loads the unwinder, which allocates, so do it before any audio runs
+[[maybe_unused]] const bool backtracePreloaded = []
+{
+  void *frame = nullptr;
+  return backtrace(&frame, 1) >= 0;
+}();
+
+/**
+ * @brief Records a violation, a call site is only recorded once.
+ *
+ * Does not allocate. Call sites beyond maxViolations are only counted.
+ *
+ * @param function The function that was called
+ */
+[[gnu::noinline]] void record(const char *function)
+{
+  ++numTotal;
+  std::array<void *, maxFrames> frames{};
+  const int numFrames = backtrace(frames.data(), maxFrames);
+  size_t key = 0;
+  for (int i = skippedFrames; i < std::min(numFrames, skippedFrames + keyFrames); ++i)
+  {
+    key = key * 31 + reinterpret_cast<size_t>(frames[static_cast<size_t>(i)]);
+  }
+
+  const int recorded = std::min(numRecorded.load(), maxViolations);
+  for (int i = 0; i < recorded; ++i)
+  {
+    Violation &violation = violations[static_cast<size_t>(i)];
+    if (violation.ready.load(std::memory_order_acquire) && violation.key == key)
+    {
+      violation.count.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  const int index = numRecorded.fetch_add(1);
+  if (index >= maxViolations)
+  {
+    return;
+  }
+  Violation &violation = violations[static_cast<size_t>(index)];
+  violation.function = function;
+  violation.key = key;
+  violation.count.store(1, std::memory_order_relaxed);
+  violation.numFrames = numFrames;
+  violation.frames = frames;
+  violation.ready.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Records a violation if the calling thread is an audio thread.
+ *
+ * @param function The function that was called
+ */
+[[gnu::noinline]] void check(const char *function)
+{
+  if (t_audioDepth == 0 || t_inHook)
+  {
+    return;
+  }
+  t_inHook = true;
+  record(function);
+  t_inHook = false;
+}
+
+/**
+ * @brief Looks up the function the replacement stands in for.
+ *
+ * @tparam Function Type of the function
+ * @param name      Name of the function
+ * @return Function The next definition after this executable, usually the one of the libc
+ */
+template <typename Function>
+Function next(const char *name)
+{
+  return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+}
+}  // namespace
+
+/**
+ * @brief Construct a new Scoped Audio Thread:: Scoped Audio Thread object
+ *
+ */
+ScopedAudioThread::ScopedAudioThread() { ++t_audioDepth; }
+
+/**
+ * @brief Destroy the Scoped Audio Thread:: Scoped Audio Thread object
+ *
+ */
+ScopedAudioThread::~ScopedAudioThread() { --t_audioDepth; }
+
+/**
+ * @brief Number of violations so far, every hit of a call site counts.
+ *
+ * @return int Number of violations
+ */
+int numViolations() { return numTotal.load(); }
+
+/**
+ * @brief Logs every recorded call site with its stack trace.
+ *
+ * @return int Number of violations, every hit of a call site counts
+ */
+int report()
+{
+  const int total = numTotal.load();
+  if (total == 0)
+  {
+    PLOGI << "rt check: no real-time violations on the audio thread";
+    return 0;
+  }
+  const int recorded = std::min(numRecorded.load(), maxViolations);
+  PLOGE << "rt check: " << total << " real-time violations on the audio thread at " << recorded
+        << (recorded == maxViolations ? " or more" : "") << " call sites";
+  for (int i = 0; i < recorded; ++i)
+  {
+    const Violation &violation = violations[static_cast<size_t>(i)];
+    if (!violation.ready.load(std::memory_order_acquire))
+    {
+      continue;
+    }
+    PLOGE << "rt check: " << violation.function << " called "
+          << violation.count.load(std::memory_order_relaxed) << " times from";
+    backtrace_symbols_fd(violation.frames.data() + skippedFrames,
+                         std::max(violation.numFrames - skippedFrames, 0), STDERR_FILENO);
+  }
+  return total;
+}
+}  // namespace beak::rtcheck
+
+/* ------------------------------ replacements ------------------------------ */
+// the executable defines these, so they take precedence over the libc for the whole process
+extern "C"
+{
+  void *malloc(size_t size) noexcept
+  {
+    beak::rtcheck::check("malloc");
+    return __libc_malloc(size);
+  }
+
+  void *calloc(size_t count, size_t size) noexcept
+  {
+    beak::rtcheck::check("calloc");
+    return __libc_calloc(count, size);
+  }
+
+  void *realloc(void *ptr, size_t size) noexcept
+  {
+    beak::rtcheck::check("realloc");
+    return __libc_realloc(ptr, size);
+  }
+
+  int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept
+  {
+    using Function = int (*)(void **, size_t, size_t);
+    static const auto real = beak::rtcheck::next<Function>("posix_memalign");
+    beak::rtcheck::check("posix_memalign");
+    return real(ptr, alignment, size);
+  }
+
+  void *aligned_alloc(size_t alignment, size_t size) noexcept
+  {
+    using Function = void *(*)(size_t, size_t);
+    static const auto real = beak::rtcheck::next<Function>("aligned_alloc");
+    beak::rtcheck::check("aligned_alloc");
+    return real(alignment, size);
+  }
+
+  void free(void *ptr) noexcept
+  {
+    if (ptr != nullptr)
+    {
+      beak::rtcheck::check("free");
+    }
+    __libc_free(ptr);
+  }
+
+  int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept
+  {
+    using Function = int (*)(pthread_mutex_t *);
+    static const auto real = beak::rtcheck::next<Function>("pthread_mutex_lock");
+    beak::rtcheck::check("pthread_mutex_lock");
+    return real(mutex);
+  }
+
+  ssize_t read(int fd, void *buf, size_t count)
+  {
+    using Function = ssize_t (*)(int, void *, size_t);
+    static const auto real = beak::rtcheck::next<Function>("read");
+    beak::rtcheck::check("read");
+    return real(fd, buf, count);
+  }
+
+  ssize_t write(int fd, const void *buf, size_t count)
+  {
+    using Function = ssize_t (*)(int, const void *, size_t);
+    static const auto real = beak::rtcheck::next<Function>("write");
+    beak::rtcheck::check("write");
+    return real(fd, buf, count);
+  }
+
+  int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+  {
+    using Function = int (*)(struct pollfd *, nfds_t, int);
+    static const auto real = beak::rtcheck::next<Function>("poll");
+    beak::rtcheck::check("poll");
+    return real(fds, nfds, timeout);
+  }
+
+  int nanosleep(const struct timespec *duration, struct timespec *remaining)
+  {
+    using Function = int (*)(const struct timespec *, struct timespec *);
+    static const auto real = beak::rtcheck::next<Function>("nanosleep");
+    beak::rtcheck::check("nanosleep");
+    return real(duration, remaining);
+  }
+
+  int usleep(useconds_t usec)
+  {
+    using Function = int (*)(useconds_t);
+    static const auto real = beak::rtcheck::next<Function>("usleep");
+    beak::rtcheck::check("usleep");
+    return real(usec);
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+/**
+ * @brief Real-time safety checker, only built with the BEAK_RT_CHECK option.
+ *
+ * Code that runs on the audio thread is marked with BEAK_RT_AUDIO_SCOPE. While a thread is inside
+ * such a scope, memory allocation, mutex locks and blocking system calls are recorded as violations
+ * with a stack trace. Without the option the scope expands to nothing.
+ */
+#ifdef BEAK_RT_CHECK
+#define BEAK_RT_AUDIO_SCOPE const beak::rtcheck::ScopedAudioThread beakRtAudioScope
+#else
+#define BEAK_RT_AUDIO_SCOPE
+#endif
+
+#ifdef BEAK_RT_CHECK
+namespace beak::rtcheck
+{
+constexpr int maxViolations = 64;  //!< Distinct call sites that are recorded
+constexpr int maxFrames = 24;      //!< Depth of the recorded stack traces
+
+/**
+ * @brief Marks the calling thread as audio thread for its lifetime, scopes may be nested.
+ *
+ */
+class ScopedAudioThread
+{
+ public:
+  ScopedAudioThread();
+  ~ScopedAudioThread();
+  ScopedAudioThread(const ScopedAudioThread &) = delete;
+  ScopedAudioThread &operator=(const ScopedAudioThread &) = delete;
+};
+
+int numViolations();
+int report();
+}  // namespace beak::rtcheck
+#endif
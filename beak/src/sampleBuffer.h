@@ -0,0 +1,8 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace beak
+{
+using SampleBuffer = juce::AudioBuffer<float>;  //!< Decoded mono sample at the device sample rate
+}  // namespace beak
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace beak
+{
+/**
+ * @brief What the cache knows about a sample, applied when the sample is played.
+ *
+ */
+struct SampleMetadata
+{
+  float gain{1.0f};             //!< Linear gain that normalises the loudness
+  juce::int64 attackOffset{0};  //!< First frame above the silence threshold, playback starts here
+};
+}  // namespace beak
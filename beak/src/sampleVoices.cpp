@@ -0,0 +1,143 @@
+#include "sampleVoices.h"
+
+#include <algorithm>
+
+namespace beak
+{
+/**
+ * @brief Plays a sample with the next block.
+ *
+ * If all voices are busy, the one that has played the longest is replaced.
+ *
+ * @param sample    The sample, mono at the sample rate of the device
+ * @param offset    Sample of the next block the sample starts on
+ * @param gain      Linear gain
+ * @param priority  Voices of lower priority are shed first
+ */
+void SampleVoices::schedule(const std::shared_ptr<const SampleBuffer> &sample, int offset,
+                            float gain, int priority)
+{
+  auto *target = &m_voices.front();
+  for (auto &voice : m_voices)
+  {
+    if (!voice.sample)
+    {
+      target = &voice;
+      break;
+    }
+    if (voice.position > target->position)
+    {
+      target = &voice;
+    }
+  }
+  target->sample = sample;
+  target->position = 0;
+  target->delay = offset;
+  target->gain = gain;
+  target->priority = priority;
+  target->fading = false;
+}
+
+/**
+ * @brief Adds the samples that are playing to the buffer.
+ *
+ * Shed voices are faded out over the block, the ones that have not started yet are dropped.
+ *
+ * @param buffer      Buffer to add to
+ * @param numChannels Number of channels of the buffer to add the samples to
+ */
+void SampleVoices::render(juce::AudioBuffer<float> &buffer, int numChannels)
+{
+  numChannels = std::min(numChannels, buffer.getNumChannels());
+  for (auto &voice : m_voices)
+  {
+    if (!voice.sample)
+    {
+      continue;
+    }
+    if (voice.fading && voice.delay > 0)
+    {
+      voice.sample.reset();
+      continue;
+    }
+    const int start = std::min(voice.delay, buffer.getNumSamples());
+    const int numSamples = std::min(buffer.getNumSamples() - start,
+                                    voice.sample->getNumSamples() - voice.position);
+    const float endGain = voice.fading ? 0.0f : voice.gain;
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+      buffer.addFromWithRamp(channel, start, voice.sample->getReadPointer(0, voice.position),
+                             numSamples, voice.gain, endGain);
+    }
+    voice.delay -= start;
+    voice.position += numSamples;
+    if (voice.position >= voice.sample->getNumSamples() || voice.fading)
+    {
+      voice.sample.reset();
+    }
+  }
+}
+
+/**
+ * @brief Fades out voices until no more than the given number are playing.
+ *
+ * Voices of the lowest priority go first, the quietest of them before the louder ones.
+ *
+ * @param maxVoices Voices that may keep playing
+ * @return int      Number of voices that are faded out
+ */
+int SampleVoices::shed(int maxVoices)
+{
+  int numActive = static_cast<int>(std::count_if(m_voices.begin(), m_voices.end(),
+                                                 [](const Voice &voice)
+                                                 { return voice.sample && !voice.fading; }));
+  int numShed = 0;
+  for (; numActive > maxVoices; --numActive, ++numShed)
+  {
+    Voice *victim = nullptr;
+    for (auto &voice : m_voices)
+    {
+      if (!voice.sample || voice.fading)
+      {
+        continue;
+      }
+      if (victim == nullptr || voice.priority < victim->priority ||
+          (voice.priority == victim->priority && voice.gain < victim->gain))
+      {
+        victim = &voice;
+      }
+    }
+    victim->fading = true;
+  }
+  return numShed;
+}
+
+/**
+ * @brief Stops all voices immediately.
+ *
+ */
+void SampleVoices::stopAll()
+{
+  for (auto &voice : m_voices)
+  {
+    voice.sample.reset();
+  }
+}
+
+/**
+ * @brief Checks if no voice is playing.
+ *
+ * @return true   All voices are free
+ */
+bool SampleVoices::isIdle() const
+{
+  for (const auto &voice : m_voices)
+  {
+    if (voice.sample)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace beak
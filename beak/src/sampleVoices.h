@@ -0,0 +1,45 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+#include <array>
+#include <memory>
+
+#include "sampleBuffer.h"
+
+namespace beak
+{
+/**
+ * @brief Fixed set of voices that play decoded samples from memory.
+ *
+ * Only used from the audio thread. The samples must be kept alive elsewhere, so a voice that
+ * finishes never frees memory.
+ */
+class SampleVoices
+{
+ public:
+  static constexpr int maxVoices{16};  //!< Samples that can play at the same time
+
+ public:
+  void schedule(const std::shared_ptr<const SampleBuffer> &sample, int offset, float gain,
+                int priority = 0);
+  void render(juce::AudioBuffer<float> &buffer, int numChannels);
+  int shed(int maxVoices);
+  void stopAll();
+  bool isIdle() const;
+
+ private:
+  struct Voice
+  {
+    std::shared_ptr<const SampleBuffer> sample;
+    int position{0};
+    int delay{0};  //!< Samples of the next block before the sample starts
+    float gain{1.0f};
+    int priority{0};
+    bool fading{false};  //!< Shed, fades out within the next block
+  };
+
+ private:
+  std::array<Voice, maxVoices> m_voices;
+};
+}  // namespace beak
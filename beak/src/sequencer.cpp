@@ -0,0 +1,269 @@
+#include "sequencer.h"
+
+#include <algorithm>
+
+#include "processor.h"
+#include "synthProcessor.h"
+
+namespace beak
+{
+/**
+ * @brief Prepares the sequencer for playback.
+ *
+ * @param sampleRate The sample rate of the device
+ */
+void Sequencer::prepare(double sampleRate) { m_sampleRate = sampleRate; }
+
+/**
+ * @brief Sets the processors of the channels, must be called before the audio callback runs.
+ *
+ * @param synths    Synth processors, index 0 is channel 1
+ * @param samplers  Sampler processors, index 0 is channel 1
+ */
+void Sequencer::setTargets(const std::vector<SynthProcessor *> &synths,
+                           const std::vector<SamplerProcessor *> &samplers)
+{
+  m_synths = synths;
+  m_samplers = samplers;
+}
+
+/**
+ * @brief Replaces the sequence.
+ *
+ * A playing sequencer continues at its current position in the new sequence. Sequences that are
+ * not used anymore are released here.
+ *
+ * @param sequence  The sequence to play
+ * @return true     The sequence has been queued, false if the queue is full
+ */
+bool Sequencer::setSequence(std::shared_ptr<const Sequence> sequence)
+{
+  // release the sequences and samples only we hold on to, sample voices may still play samples of
+  // a replaced sequence
+  std::erase_if(m_pool, [](const auto &pooled) { return pooled.use_count() == 1; });
+  std::erase_if(m_samplePool, [](const auto &pooled) { return pooled.use_count() == 1; });
+  m_pool.push_back(sequence);
+  for (const auto &event : sequence->events)
+  {
+    if (event.sample &&
+        std::find(m_samplePool.begin(), m_samplePool.end(), event.sample) == m_samplePool.end())
+    {
+      m_samplePool.push_back(event.sample);
+    }
+  }
+
+  Command command;
+  command.type = Command::Type::SetSequence;
+  command.sequence = std::move(sequence);
+  return pushCommand(std::move(command));
+}
+
+/**
+ * @brief Starts playback from the beginning of the sequence.
+ *
+ * @return true   The command has been queued, false if the queue is full
+ */
+bool Sequencer::start()
+{
+  Command command;
+  command.type = Command::Type::Start;
+  return pushCommand(std::move(command));
+}
+
+/**
+ * @brief Stops playback, notes that are playing are released after their duration.
+ *
+ * @return true   The command has been queued, false if the queue is full
+ */
+bool Sequencer::stop()
+{
+  Command command;
+  command.type = Command::Type::Stop;
+  return pushCommand(std::move(command));
+}
+
+/**
+ * @brief Changes the tempo, takes effect with the next block without moving the position.
+ *
+ * @param bpm     Beats per minute
+ * @return true   The command has been queued, false if the queue is full
+ */
+bool Sequencer::setTempo(double bpm)
+{
+  if (bpm <= 0.0)
+  {
+    return false;
+  }
+  Command command;
+  command.type = Command::Type::SetTempo;
+  command.bpm = bpm;
+  return pushCommand(std::move(command));
+}
+
+/**
+ * @brief Passes a command to the audio thread.
+ *
+ * @param command The command
+ * @return true   The command has been queued, false if the queue is full
+ */
+bool Sequencer::pushCommand(Command command)
+{
+  const auto scope = m_commandFifo.write(1);
+  if (scope.blockSize1 + scope.blockSize2 == 0)
+  {
+    return false;
+  }
+  scope.forEach([this, &command](int index) { m_commands[index] = std::move(command); });
+  return true;
+}
+
+/**
+ * @brief Applies the queued commands on the audio thread.
+ *
+ */
+void Sequencer::handleCommands()
+{
+  const auto scope = m_commandFifo.read(m_commandFifo.getNumReady());
+  scope.forEach(
+      [this](int index)
+      {
+        auto &command = m_commands[index];
+        switch (command.type)
+        {
+          case Command::Type::SetSequence:
+            // the previous sequence is still held by the pool, so this does not free it
+            m_sequence = std::move(command.sequence);
+            m_bpm = m_sequence->bpm;
+            seek(m_sequence->loop ? m_tick : std::min(m_tick, m_sequence->length));
+            break;
+          case Command::Type::Start:
+            m_playing = m_sequence != nullptr;
+            seek(0.0);
+            break;
+          case Command::Type::Stop:
+            m_playing = false;
+            break;
+          case Command::Type::SetTempo:
+            m_bpm = command.bpm;
+            break;
+        }
+      });
+}
+
+/**
+ * @brief Moves the position, the next event is the first one at or after the tick.
+ *
+ * @param tick The new position
+ */
+void Sequencer::seek(double tick)
+{
+  m_tick = tick;
+  if (!m_sequence)
+  {
+    m_nextEvent = 0;
+    return;
+  }
+  if (m_sequence->loop && m_tick >= m_sequence->length)
+  {
+    m_tick = m_sequence->loopStart;
+  }
+  const auto &events = m_sequence->events;
+  const auto next =
+      std::lower_bound(events.begin(), events.end(), m_tick,
+                       [](const SequenceEvent &event, double value) { return event.tick < value; });
+  m_nextEvent = static_cast<size_t>(std::distance(events.begin(), next));
+}
+
+/**
+ * @brief Number of samples per tick at the current tempo.
+ *
+ * @return double Samples per tick
+ */
+double Sequencer::samplesPerTick() const
+{
+  return m_sampleRate * 60.0 / (m_bpm * m_sequence->ticksPerBeat);
+}
+
+/**
+ * @brief Schedules all events of the next block on the audio thread.
+ *
+ * Must be called before the processors of the channels render the block.
+ *
+ * @param numSamples Number of samples of the block
+ */
+void Sequencer::process(int numSamples)
+{
+  handleCommands();
+  if (!m_playing || !m_sequence)
+  {
+    return;
+  }
+
+  const auto &sequence = *m_sequence;
+  const double tickSamples = samplesPerTick();
+  double blockStart = 0.0;  // samples of the block before the current tick
+  while (true)
+  {
+    const double blockEndTick = m_tick + (numSamples - blockStart) / tickSamples;
+    const double segmentEnd = std::min(blockEndTick, sequence.length);
+    for (; m_nextEvent < sequence.events.size(); ++m_nextEvent)
+    {
+      const auto &event = sequence.events[m_nextEvent];
+      if (event.tick >= segmentEnd)
+      {
+        break;
+      }
+      const int offset = static_cast<int>(blockStart + (event.tick - m_tick) * tickSamples);
+      dispatch(event, std::clamp(offset, 0, numSamples - 1));
+    }
+    if (blockEndTick < sequence.length)
+    {
+      m_tick = blockEndTick;
+      return;
+    }
+
+    // the end of the sequence is inside this block
+    blockStart += (sequence.length - m_tick) * tickSamples;
+    if (!sequence.loop)
+    {
+      m_playing = false;
+      return;
+    }
+    if (sequence.length <= sequence.loopStart)
+    {
+      // empty loop
+      m_playing = false;
+      return;
+    }
+    seek(sequence.loopStart);
+    if (blockStart >= numSamples)
+    {
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Schedules one event into the processor of its channel.
+ *
+ * @param event   The event
+ * @param offset  The sample of the block it starts on
+ */
+void Sequencer::dispatch(const SequenceEvent &event, int offset)
+{
+  const auto index = static_cast<size_t>(event.channel - 1);
+  if (event.sample)
+  {
+    if (index < m_samplers.size())
+    {
+      m_samplers[index]->scheduleSample(event.sample, offset, event.velocity);
+    }
+    return;
+  }
+  if (index < m_synths.size())
+  {
+    const auto duration = static_cast<int>(event.durationTicks * samplesPerTick());
+    m_synths[index]->scheduleNote(event.note, event.velocity, offset, duration);
+  }
+}
+}  // namespace beak
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "sampleBuffer.h"
+
+namespace beak
+{
+class SamplerProcessor;
+class SynthProcessor;
+
+/**
+ * @brief One step of a sequence, either a synth note or a sample.
+ *
+ */
+struct SequenceEvent
+{
+  double tick{0.0};
+  int channel{1};
+  int note{0};
+  float velocity{1.0f};
+  double durationTicks{0.0};
+  std::shared_ptr<const SampleBuffer> sample;  //!< Plays the sample instead of a note if set
+};
+
+/**
+ * @brief A pattern of notes and samples on several channels, timed in ticks.
+ *
+ */
+struct Sequence
+{
+  double bpm{120.0};
+  double ticksPerBeat{4.0};
+  double length{0.0};     //!< Playback stops or loops at this tick
+  double loopStart{0.0};  //!< Tick to jump back to at the end
+  bool loop{false};
+  std::vector<SequenceEvent> events;  //!< Sorted by tick
+};
+
+/**
+ * @brief Plays a sequence sample-accurately from the audio callback.
+ *
+ * Sequences and commands are passed from the network thread through a lock-free queue. The audio
+ * thread schedules the events of every block directly into the channel processors, at the sample
+ * they fall on. Sequences and samples are only released on the network thread, the audio thread
+ * never frees memory.
+ */
+class Sequencer
+{
+ public:
+  static constexpr int commandQueueSize{64};
+
+ public:
+  void prepare(double sampleRate);
+  void setTargets(const std::vector<SynthProcessor *> &synths,
+                  const std::vector<SamplerProcessor *> &samplers);
+
+  // network thread
+  [[nodiscard]] bool setSequence(std::shared_ptr<const Sequence> sequence);
+  [[nodiscard]] bool start();
+  [[nodiscard]] bool stop();
+  [[nodiscard]] bool setTempo(double bpm);
+
+  // audio thread
+  void process(int numSamples);
+
+ private:
+  struct Command
+  {
+    enum class Type
+    {
+      SetSequence,
+      Start,
+      Stop,
+      SetTempo
+    };
+    Type type{Type::Stop};
+    double bpm{0.0};
+    std::shared_ptr<const Sequence> sequence;
+  };
+
+  bool pushCommand(Command command);
+  void handleCommands();
+  void seek(double tick);
+  void dispatch(const SequenceEvent &event, int offset);
+  double samplesPerTick() const;
+
+ private:
+  double m_sampleRate{44100.0};
+  std::vector<SynthProcessor *> m_synths;
+  std::vector<SamplerProcessor *> m_samplers;
+
+  juce::AbstractFifo m_commandFifo{commandQueueSize};
+  std::array<Command, commandQueueSize> m_commands;
+  // keep sequences and samples alive, so they are only released on the network thread
+  std::vector<std::shared_ptr<const Sequence>> m_pool;
+  std::vector<std::shared_ptr<const SampleBuffer>> m_samplePool;
+
+  // audio thread
+  std::shared_ptr<const Sequence> m_sequence;
+  double m_bpm{120.0};
+  double m_tick{0.0};
+  size_t m_nextEvent{0};
+  bool m_playing{false};
+};
+}  // namespace beak
@@ -49,7 +49,11 @@ void Server::handleReceive(const asio::error_code &error, std::size_t sz)
 void Server::handleSend(std::shared_ptr<std::string> msg, const asio::error_code &error,
                         std::size_t /*bytes_transferred*/)
 {
-  PLOGD << "Sending '" << *msg << "', error: " << (error ? error.message() : "none");
+  // status replies are sent every second, only failures are worth a line
+  if (error)
+  {
+    PLOGW << "Sending " << msg->size() << " bytes failed: " << error.message();
+  }
 }
 
 void Server::send(std::shared_ptr<std::string> msg, std::size_t /*sz*/)
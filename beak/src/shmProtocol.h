@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace beak::shm
+{
+/**
+ * Shared-memory transport for senders on the same host.
+ *
+ * A client connects to the unix socket of beak and receives two file descriptors with the reply:
+ * a memfd holding one Ring, and an eventfd that is the doorbell of beak. The client maps the ring,
+ * checks magic and version, and is its only producer. Events are fixed-size records, writing one
+ * takes no system call unless beak is asleep and has to be woken. The ring lives as long as the
+ * connection is open.
+ */
+constexpr uint32_t magic = 0x4245414b;  //!< "BEAK"
+constexpr uint32_t version = 1;
+constexpr uint32_t ringCapacity = 1024;  //!< Events in the ring, a power of two
+constexpr size_t maxUriLength = 216;     //!< Including the terminating zero
+
+enum class EventType : uint32_t
+{
+  None = 0,
+  PlaySound = 1,  //!< uri, channel, priority
+  StopSound = 2,  //!< channel
+  NoteOn = 3,     //!< channel, note, velocity, durationMs, priority, patchId
+  NoteOff = 4,    //!< channel, note
+  Ping = 5,       //!< Not played, measures the transport alone
+};
+
+/**
+ * @brief One event, the layout is shared with the clients.
+ *
+ */
+struct Event
+{
+  EventType type{EventType::None};
+  uint32_t channel{0};
+  uint32_t note{0};
+  float velocity{0.0f};
+  float durationMs{0.0f};
+  int32_t priority{0};
+  uint32_t patchId{0};  //!< Registered patch of a note, 0 keeps the config of the channel
+  uint32_t reserved{0};
+  uint64_t sentNs{0};  //!< CLOCK_MONOTONIC when sent, 0 if unknown
+  char uri[maxUriLength]{};
+};
+static_assert(sizeof(Event) == 256, "the event layout is shared with the clients");
+
+/**
+ * @brief Single producer, single consumer ring in shared memory.
+ *
+ * head is only written by the client, tail only by beak. Both count events since the start and
+ * wrap at the capacity. beak sets consumerSleeping before it waits for the doorbell.
+ */
+struct Ring
+{
+  uint32_t magic{0};
+  uint32_t version{0};
+  uint32_t capacity{0};
+  uint32_t eventSize{0};
+  alignas(64) std::atomic<uint64_t> head{0};
+  alignas(64) std::atomic<uint64_t> tail{0};
+  alignas(64) std::atomic<uint32_t> consumerSleeping{1};
+  std::atomic<uint64_t> dropped{0};  //!< Events the client could not write, the ring was full
+  alignas(64) Event events[ringCapacity];
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "atomics must work across processes");
+static_assert((ringCapacity & (ringCapacity - 1)) == 0, "the capacity must be a power of two");
+
+/**
+ * @brief Writes one event, for the client.
+ *
+ * @param ring          The mapped ring
+ * @param event         The event
+ * @param ringDoorbell  Set to true if beak is asleep, the client then writes 1 to the eventfd
+ * @return true         The event was written, false if the ring was full
+ */
+inline bool push(Ring &ring, const Event &event, bool &ringDoorbell)
+{
+  const uint64_t head = ring.head.load(std::memory_order_relaxed);
+  if (head - ring.tail.load(std::memory_order_acquire) >= ringCapacity)
+  {
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    ringDoorbell = false;
+    return false;
+  }
+  std::memcpy(&ring.events[head % ringCapacity], &event, sizeof(Event));
+  ring.head.store(head + 1, std::memory_order_seq_cst);
+  ringDoorbell = ring.consumerSleeping.exchange(0, std::memory_order_seq_cst) != 0;
+  return true;
+}
+}  // namespace beak::shm
@@ -0,0 +1,380 @@
+#include "shmTransport.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <plog/Log.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+namespace beak::net
+{
+constexpr int listenBacklog = 4;
+
+/**
+ * @brief Nanoseconds of the monotonic clock, the clock the clients stamp their events with.
+ *
+ * @return uint64_t The time
+ */
+static uint64_t monotonicNs()
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+/**
+ * @brief A connected client and the ring it writes to.
+ *
+ */
+struct ShmTransport::Client
+{
+  explicit Client(asio::local::stream_protocol::socket connection) :
+    socket(std::move(connection)), doorbell(socket.get_executor())
+  {
+  }
+
+  ~Client()
+  {
+#ifdef __linux__
+    if (ring != nullptr)
+    {
+      ring->~Ring();
+      munmap(ring, sizeof(shm::Ring));
+    }
+    if (memfd >= 0)
+    {
+      ::close(memfd);
+    }
+#endif
+  }
+
+  asio::local::stream_protocol::socket socket;
+  asio::posix::stream_descriptor doorbell;  //!< eventfd the client writes to when beak sleeps
+  shm::Ring *ring{nullptr};
+  int memfd{-1};
+  std::array<char, 1> hangupBuffer{};
+  uint64_t reportedDropped{0};
+};
+
+/**
+ * @brief Construct a new Shm Transport:: Shm Transport object
+ *
+ * @param ioCtx       The io context the rings are drained on
+ * @param socketPath  Path of the unix socket clients connect to
+ */
+ShmTransport::ShmTransport(asio::io_context &ioCtx, const std::string &socketPath) :
+  m_ioCtx(ioCtx), m_socketPath(socketPath)
+{
+}
+
+/**
+ * @brief Destroy the Shm Transport:: Shm Transport object, disconnects all clients.
+ *
+ */
+ShmTransport::~ShmTransport()
+{
+  m_clients.clear();
+  if (m_acceptor)
+  {
+    m_acceptor->close();
+#ifdef __linux__
+    ::unlink(m_socketPath.c_str());
+#endif
+  }
+}
+
+/**
+ * @brief Listens on the unix socket for clients.
+ *
+ * @return Error  Custom error to signal a failure
+ */
+Error ShmTransport::start()
+{
+#ifdef __linux__
+  // a socket left behind by a previous run would fail the bind
+  ::unlink(m_socketPath.c_str());
+  asio::error_code error;
+  m_acceptor = std::make_unique<asio::local::stream_protocol::acceptor>(m_ioCtx);
+  m_acceptor->open(asio::local::stream_protocol(), error);
+  if (!error)
+  {
+    m_acceptor->bind(asio::local::stream_protocol::endpoint(m_socketPath), error);
+  }
+  if (!error)
+  {
+    m_acceptor->listen(listenBacklog, error);
+  }
+  if (error)
+  {
+    m_acceptor.reset();
+    return Error("shared-memory socket " + m_socketPath + ": " + error.message());
+  }
+  m_lastReportNs = monotonicNs();
+  startAccept();
+  PLOGI << "shared-memory transport listening on " << m_socketPath;
+  return Error();
+#else
+  return Error("the shared-memory transport is only supported on linux");
+#endif
+}
+
+/**
+ * @brief Registers the callback for a type of event.
+ *
+ * @param type  The type of event
+ * @param fn    The callback, called on the thread of the io context
+ */
+void ShmTransport::registerCallback(shm::EventType type, shmEventCallbackFn fn)
+{
+  m_callBackFns[type] = fn;
+}
+
+/**
+ * @brief Accepts the next client.
+ *
+ */
+void ShmTransport::startAccept()
+{
+  m_acceptor->async_accept(
+      [this](const asio::error_code &error, asio::local::stream_protocol::socket socket)
+      {
+        if (error == asio::error::operation_aborted)
+        {
+          return;
+        }
+        if (!error)
+        {
+          if (m_clients.size() >= maxClients)
+          {
+            PLOGW << "shared-memory client refused, " << maxClients << " are connected";
+          }
+          else
+          {
+            auto client = std::make_unique<Client>(std::move(socket));
+            if (auto err = open(*client))
+            {
+              PLOGE << err.what();
+            }
+            else
+            {
+              Client &connected = *client;
+              m_clients.push_back(std::move(client));
+              PLOGI << "shared-memory client connected";
+              waitForDoorbell(connected);
+              waitForHangup(connected);
+            }
+          }
+        }
+        startAccept();
+      });
+}
+
+/**
+ * @brief Creates the ring and the doorbell of a client and sends both to it.
+ *
+ * @param client  The client
+ * @return Error  Custom error to signal a failure
+ */
+Error ShmTransport::open(Client &client)
+{
+#ifdef __linux__
+  client.memfd = memfd_create("beak-events", MFD_CLOEXEC);
+  if (client.memfd < 0 || ftruncate(client.memfd, sizeof(shm::Ring)) != 0)
+  {
+    return Error(std::string("creating the shared-memory ring failed: ") + std::strerror(errno));
+  }
+  void *memory =
+      mmap(nullptr, sizeof(shm::Ring), PROT_READ | PROT_WRITE, MAP_SHARED, client.memfd, 0);
+  if (memory == MAP_FAILED)
+  {
+    return Error(std::string("mapping the shared-memory ring failed: ") + std::strerror(errno));
+  }
+  client.ring = new (memory) shm::Ring();
+  client.ring->magic = shm::magic;
+  client.ring->version = shm::version;
+  client.ring->capacity = shm::ringCapacity;
+  client.ring->eventSize = sizeof(shm::Event);
+
+  const int eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (eventFd < 0)
+  {
+    return Error(std::string("creating the doorbell failed: ") + std::strerror(errno));
+  }
+  client.doorbell.assign(eventFd);
+
+  // both descriptors travel with a reply of one byte
+  const std::array<int, 2> fds{client.memfd, eventFd};
+  char reply = 0;
+  iovec iov{&reply, sizeof(reply)};
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(fds))> control{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+  if (sendmsg(client.socket.native_handle(), &msg, MSG_NOSIGNAL) < 0)
+  {
+    return Error(std::string("sending the shared-memory ring failed: ") + std::strerror(errno));
+  }
+  return Error();
+#else
+  (void)client;
+  return Error("the shared-memory transport is only supported on linux");
+#endif
+}
+
+/**
+ * @brief Drains the ring whenever the client rings the doorbell.
+ *
+ * @param client  The client
+ */
+void ShmTransport::waitForDoorbell(Client &client)
+{
+  client.doorbell.async_wait(asio::posix::stream_descriptor::wait_read,
+                             [this, &client](const asio::error_code &error)
+                             {
+                               // aborted when the client has been closed
+                               if (error)
+                               {
+                                 return;
+                               }
+#ifdef __linux__
+                               eventfd_t value = 0;
+                               eventfd_read(client.doorbell.native_handle(), &value);
+#endif
+                               client.ring->consumerSleeping.store(0, std::memory_order_relaxed);
+                               drain(client);
+                               waitForDoorbell(client);
+                             });
+}
+
+/**
+ * @brief Closes the client when it disconnects, clients never send on the socket.
+ *
+ * @param client  The client
+ */
+void ShmTransport::waitForHangup(Client &client)
+{
+  client.socket.async_read_some(asio::buffer(client.hangupBuffer),
+                                [this, &client](const asio::error_code &error, std::size_t)
+                                {
+                                  if (error == asio::error::operation_aborted)
+                                  {
+                                    return;
+                                  }
+                                  close(client);
+                                });
+}
+
+/**
+ * @brief Dispatches all events of the ring, then tells the client to ring the doorbell.
+ *
+ * The flag is set before the ring is checked a last time, so an event written in between is
+ * never missed.
+ *
+ * @param client  The client
+ */
+void ShmTransport::drain(Client &client)
+{
+  shm::Ring &ring = *client.ring;
+  uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+  while (true)
+  {
+    const uint64_t head = ring.head.load(std::memory_order_acquire);
+    if (head == tail)
+    {
+      ring.consumerSleeping.store(1, std::memory_order_seq_cst);
+      if (ring.head.load(std::memory_order_seq_cst) == tail)
+      {
+        break;
+      }
+      ring.consumerSleeping.store(0, std::memory_order_relaxed);
+      continue;
+    }
+    // copied, so the client may reuse the slot while the event is played
+    shm::Event event = ring.events[tail % shm::ringCapacity];
+    event.uri[shm::maxUriLength - 1] = '\0';
+    ring.tail.store(++tail, std::memory_order_release);
+    dispatch(event);
+  }
+
+  if (const uint64_t dropped = ring.dropped.load(std::memory_order_relaxed);
+      dropped != client.reportedDropped)
+  {
+    PLOGW << "shared-memory client dropped " << dropped - client.reportedDropped
+          << " events, the ring was full";
+    client.reportedDropped = dropped;
+  }
+  reportStats();
+}
+
+/**
+ * @brief Measures the transport latency of an event and calls its callback.
+ *
+ * @param event The event
+ */
+void ShmTransport::dispatch(const shm::Event &event)
+{
+  if (event.sentNs != 0)
+  {
+    const uint64_t now = monotonicNs();
+    const uint64_t latency = now > event.sentNs ? now - event.sentNs : 0;
+    ++m_numEvents;
+    m_latencySumNs += latency;
+    m_latencyMaxNs = std::max(m_latencyMaxNs, latency);
+  }
+  const auto fn = m_callBackFns.find(event.type);
+  if (fn != m_callBackFns.end() && fn->second)
+  {
+    fn->second(event);
+  }
+}
+
+/**
+ * @brief Disconnects a client and releases its ring.
+ *
+ * @param client  The client
+ */
+void ShmTransport::close(Client &client)
+{
+  // events written before the client went away are still played
+  drain(client);
+  m_clients.remove_if([&client](const std::unique_ptr<Client> &candidate)
+                      { return candidate.get() == &client; });
+  PLOGI << "shared-memory client disconnected";
+}
+
+/**
+ * @brief Logs the transport latency of the last interval.
+ *
+ */
+void ShmTransport::reportStats()
+{
+  const uint64_t now = monotonicNs();
+  if (now - m_lastReportNs < static_cast<uint64_t>(statsIntervalMs) * 1000000 || m_numEvents == 0)
+  {
+    return;
+  }
+  PLOGD << "shared-memory transport: " << m_numEvents << " events, latency mean "
+        << m_latencySumNs / m_numEvents / 1000 << " us, max " << m_latencyMaxNs / 1000 << " us";
+  m_numEvents = 0;
+  m_latencySumNs = 0;
+  m_latencyMaxNs = 0;
+  m_lastReportNs = now;
+}
+}  // namespace beak::net
@@ -0,0 +1,66 @@
+#pragma once
+#include <asio.hpp>
+#include <juce_core/juce_core.h>
+
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+
+#include "error.h"
+#include "shmProtocol.h"
+
+namespace beak::net
+{
+typedef std::function<void(const shm::Event &)> shmEventCallbackFn;
+
+/**
+ * @brief Shared-memory transport for senders on the same host, next to the UDP server.
+ *
+ * Every client that connects to the unix socket gets a ring of its own, so each ring has a single
+ * producer. The rings are drained on the thread of the io context, the same one the UDP server
+ * runs its callbacks on. Events carry no protobuf, the callbacks get the fixed records. The
+ * latency of the transport is measured with the send time of the events and logged periodically.
+ * Only supported on linux.
+ */
+class ShmTransport
+{
+ public:
+  static constexpr int maxClients{8};
+  static constexpr int statsIntervalMs{10000};  //!< Interval of the latency report
+
+ public:
+  ShmTransport(asio::io_context &ioCtx, const std::string &socketPath);
+  ~ShmTransport();
+  ShmTransport(const ShmTransport &) = delete;
+  ShmTransport &operator=(const ShmTransport &) = delete;
+
+  [[nodiscard]] Error start();
+  void registerCallback(shm::EventType type, shmEventCallbackFn fn);
+
+ private:
+  struct Client;
+
+  void startAccept();
+  [[nodiscard]] Error open(Client &client);
+  void waitForDoorbell(Client &client);
+  void waitForHangup(Client &client);
+  void drain(Client &client);
+  void dispatch(const shm::Event &event);
+  void close(Client &client);
+  void reportStats();
+
+ private:
+  asio::io_context &m_ioCtx;
+  std::string m_socketPath;
+  std::unique_ptr<asio::local::stream_protocol::acceptor> m_acceptor;
+  std::list<std::unique_ptr<Client>> m_clients;
+  std::map<shm::EventType, shmEventCallbackFn> m_callBackFns;
+
+  // transport latency since the last report
+  uint64_t m_numEvents{0};
+  uint64_t m_latencySumNs{0};
+  uint64_t m_latencyMaxNs{0};
+  uint64_t m_lastReportNs{0};
+};
+}  // namespace beak::net
@@ -2,6 +2,7 @@
 
 #include <plog/Log.h>
 
+#include "streamDevice.h"
 #include "synthProcessor.h"
 
 namespace beak::sim
@@ -9,17 +10,58 @@ namespace beak::sim
 /**
  * @brief Construct a new Simulation Engine:: Simulation Engine object
  *
- * @param virtualOutputs  Number of virtual outputs, that will be mapped to stereo.
+ * @param virtualOutputs  Number of virtual outputs, that will be mapped to the layout.
+ * @param layout          Speaker layout of the physical outputs
+ * @param streamTarget    host:port to stream the outputs to as PCM chunks over UDP, uses the sound
+ *                        card if empty
  */
-SimulationEngine::SimulationEngine(int virtualOutputs) : m_virtualOutputs(virtualOutputs)
+SimulationEngine::SimulationEngine(int virtualOutputs, DownmixLayout layout,
+                                   const juce::String &streamTarget) :
+  m_virtualOutputs(virtualOutputs), m_layout(layout), m_streamTarget(streamTarget)
 {
   PLOGI << "Running simulation engine with " << m_virtualOutputs << " virtual outputs";
 }
 
+/**
+ * @brief Reimplemented to open the stream device instead of a sound card, if streaming.
+ *
+ * @param config  Configuration struct
+ * @return Error  Custom error type to signal an error
+ */
+Error SimulationEngine::configureDeviceManager(Config const &config)
+{
+  if (m_streamTarget.isEmpty())
+  {
+    return Engine::configureDeviceManager(config);
+  }
+
+  const juce::String host = m_streamTarget.upToLastOccurrenceOf(":", false, false);
+  const int port = m_streamTarget.fromLastOccurrenceOf(":", false, false).getIntValue();
+  if (port <= 0 || port > 65535)
+  {
+    return Error("invalid stream target " + m_streamTarget + ", expected host:port");
+  }
+  m_deviceManager.addAudioDeviceType(std::make_unique<StreamDeviceType>(
+      host.isEmpty() ? "127.0.0.1" : host, static_cast<uint16_t>(port)));
+  m_deviceManager.setCurrentAudioDeviceType(StreamDeviceType::typeName, true);
+
+  juce::AudioDeviceManager::AudioDeviceSetup setup;
+  setup.outputDeviceName = StreamDevice::deviceName;
+  setup.sampleRate = config.sampleRate();
+  auto err = m_deviceManager.initialise(0, config.outputs(), nullptr, false,
+                                        StreamDevice::deviceName, &setup);
+  if (err.isNotEmpty())
+  {
+    return Error("opening stream device: " + err);
+  }
+  return Error();
+}
+
 /**
  * @brief Reimplemented to configure the graph.
  *
- * Adds a panner node to every virtual input to map to the physical stereo output.
+ * All virtual outputs, with their reverb returns and fan outs, are summed into one downmix node
+ * that maps them to the speakers of the physical output.
  *
  * @param config
  * @return Error
@@ -51,24 +93,40 @@ Error SimulationEngine::configureGraph(Config const &config)
   {
     return Error("could not add output node");
   }
+  m_reverbNode = m_mainProcessor->addNode(std::make_unique<ReverbProcessor>(m_virtualOutputs));
+  if (!m_reverbNode)
+  {
+    return Error("could not add reverb node");
+  }
+  m_fanOutNode = m_mainProcessor->addNode(std::make_unique<FanOutProcessor>(m_virtualOutputs));
+  if (!m_fanOutNode)
+  {
+    return Error("could not add fan out node");
+  }
+  m_downmixNode =
+      m_mainProcessor->addNode(std::make_unique<DownmixProcessor>(m_virtualOutputs, m_layout));
+  if (!m_downmixNode)
+  {
+    return Error("could not add downmix node");
+  }
   for (int i = 0; i < m_virtualOutputs; ++i)
   {
     auto playerNode = m_mainProcessor->addNode(std::make_unique<SamplerProcessor>());
     auto synthNode = m_mainProcessor->addNode(std::make_unique<SynthProcessor>());
-    auto pannerNode =
-        m_mainProcessor->addNode(std::make_unique<PanningProcessor>(i, m_virtualOutputs));
-    m_mainProcessor->addConnection({{playerNode->nodeID, 0}, {pannerNode->nodeID, 0}});
-    m_mainProcessor->addConnection({{playerNode->nodeID, 0}, {pannerNode->nodeID, 1}});
-    m_mainProcessor->addConnection({{synthNode->nodeID, 0}, {pannerNode->nodeID, 0}});
-    m_mainProcessor->addConnection({{synthNode->nodeID, 0}, {pannerNode->nodeID, 1}});
-
-    m_mainProcessor->addConnection({{pannerNode->nodeID, 0}, {m_audioOutputNode->nodeID, 0}});
-    m_mainProcessor->addConnection({{pannerNode->nodeID, 1}, {m_audioOutputNode->nodeID, 1}});
+    m_mainProcessor->addConnection({{playerNode->nodeID, 0}, {m_downmixNode->nodeID, i}});
+    m_mainProcessor->addConnection({{synthNode->nodeID, 0}, {m_downmixNode->nodeID, i}});
+    m_mainProcessor->addConnection({{synthNode->nodeID, 1}, {m_reverbNode->nodeID, i}});
+    m_mainProcessor->addConnection({{m_reverbNode->nodeID, i}, {m_downmixNode->nodeID, i}});
+    m_mainProcessor->addConnection({{m_fanOutNode->nodeID, i}, {m_downmixNode->nodeID, i}});
     m_playerNodes.push_back(playerNode);
     m_synthNodes.push_back(synthNode);
   }
+  for (int i = 0; i < config.outputs(); ++i)
+  {
+    m_mainProcessor->addConnection({{m_downmixNode->nodeID, i}, {m_audioOutputNode->nodeID, i}});
+  }
   m_player->setProcessor(m_mainProcessor.get());
-  m_deviceManager.addAudioCallback(m_player.get());
+  startAudioCallback();
   m_mainProcessor->getCallbackLock().exit();
 
   return Error();
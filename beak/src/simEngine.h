@@ -7,14 +7,19 @@ using Node = juce::AudioProcessorGraph::Node;
 class SimulationEngine : public Engine
 {
  public:
-  SimulationEngine(int virtualOutputs);
+  SimulationEngine(int virtualOutputs, DownmixLayout layout = DownmixLayout::Stereo,
+                   const juce::String &streamTarget = {});
 
   [[nodiscard]] Error configureGraph(Config const &config) override;
 
+ private:
+  [[nodiscard]] Error configureDeviceManager(Config const &config) override;
+
  private:
   int m_virtualOutputs;
-  juce::HashMap<Node::Ptr, Node::Ptr> m_playerNodeToPanners;
-  juce::HashMap<Node::Ptr, Node::Ptr> m_synthNodeToPanners;
+  DownmixLayout m_layout;
+  juce::String m_streamTarget;  //!< host:port to stream to instead of a sound card
+  Node::Ptr m_downmixNode;
 };
 
 }  // namespace beak::sim
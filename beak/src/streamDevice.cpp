@@ -0,0 +1,337 @@
+#include "streamDevice.h"
+
+#include <plog/Log.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace beak::sim
+{
+constexpr int senderPollMs = 2;  //!< Interval in which the sender looks for new chunks
+
+/**
+ * @brief Construct a new Stream Device:: Stream Device object
+ *
+ * @param typeName  Name of the device type
+ * @param host      Host to send the chunks to
+ * @param port      UDP port to send the chunks to
+ */
+StreamDevice::StreamDevice(const juce::String &typeName, const juce::String &host, uint16_t port) :
+  juce::AudioIODevice(deviceName, typeName),
+  juce::Thread("beak stream"),
+  m_host(host),
+  m_port(port),
+  m_socket(m_ioCtx),
+  m_sender(*this)
+{
+}
+
+/**
+ * @brief Destroy the Stream Device:: Stream Device object
+ *
+ */
+StreamDevice::~StreamDevice() { close(); }
+
+juce::StringArray StreamDevice::getOutputChannelNames()
+{
+  juce::StringArray names;
+  for (int i = 0; i < maxChannels; ++i)
+  {
+    names.add("Output " + juce::String(i + 1));
+  }
+  return names;
+}
+
+juce::StringArray StreamDevice::getInputChannelNames() { return {}; }
+
+juce::Array<double> StreamDevice::getAvailableSampleRates() { return {44100.0, 48000.0}; }
+
+juce::Array<int> StreamDevice::getAvailableBufferSizes() { return {128, 256, 512, 1024}; }
+
+int StreamDevice::getDefaultBufferSize() { return defaultBufferSize; }
+
+/**
+ * @brief Reimplemented to prepare the buffers and the socket.
+ *
+ * @param outputChannels    Channels to stream
+ * @param sampleRate        The sample rate, the first available one if 0
+ * @param bufferSizeSamples Frames per chunk, the default size if 0
+ * @return juce::String     Error message, empty on success
+ */
+juce::String StreamDevice::open(const juce::BigInteger &, const juce::BigInteger &outputChannels,
+                                double sampleRate, int bufferSizeSamples)
+{
+  close();
+  m_sampleRate = sampleRate > 0.0 ? sampleRate : getAvailableSampleRates()[0];
+  m_bufferSize = bufferSizeSamples > 0 ? bufferSizeSamples : defaultBufferSize;
+  m_numChannels = juce::jlimit(1, maxChannels, outputChannels.getHighestBit() + 1);
+  m_output.setSize(m_numChannels, m_bufferSize);
+
+  m_chunkBytes = sizeof(StreamChunkHeader) +
+                 static_cast<size_t>(m_numChannels * m_bufferSize) * sizeof(int16_t);
+  m_chunks.assign(m_chunkBytes * ringSize, 0);
+  m_ring.reset();
+
+  asio::error_code ec;
+  asio::ip::udp::resolver resolver(m_ioCtx);
+  const auto endpoints =
+      resolver.resolve(asio::ip::udp::v4(), m_host.toStdString(), std::to_string(m_port), ec);
+  if (!ec && !endpoints.empty())
+  {
+    m_endpoint = endpoints.begin()->endpoint();
+    m_socket.open(asio::ip::udp::v4(), ec);
+  }
+  if (ec || endpoints.empty())
+  {
+    m_lastError = "could not open stream to " + m_host + ":" + juce::String(m_port);
+    return m_lastError;
+  }
+  m_isOpen = true;
+  PLOGI << "streaming " << m_numChannels << " channels to " << m_host << ":" << m_port << " in "
+        << m_bufferSize << " frame chunks";
+  return {};
+}
+
+/**
+ * @brief Reimplemented to stop streaming and close the socket.
+ *
+ */
+void StreamDevice::close()
+{
+  stop();
+  if (m_socket.is_open())
+  {
+    asio::error_code ec;
+    m_socket.close(ec);
+  }
+  m_isOpen = false;
+}
+
+bool StreamDevice::isOpen() { return m_isOpen; }
+
+/**
+ * @brief Reimplemented to start the audio and the sender thread.
+ *
+ * @param callback The callback that renders the audio
+ */
+void StreamDevice::start(juce::AudioIODeviceCallback *callback)
+{
+  if (!m_isOpen || callback == nullptr || m_isPlaying)
+  {
+    return;
+  }
+  m_callback = callback;
+  m_callback->audioDeviceAboutToStart(this);
+  m_isPlaying = true;
+  m_sender.startThread();
+  startThread(juce::Thread::Priority::highest);
+}
+
+/**
+ * @brief Reimplemented to stop the audio and the sender thread.
+ *
+ */
+void StreamDevice::stop()
+{
+  if (!m_isPlaying)
+  {
+    return;
+  }
+  stopThread(1000);
+  m_sender.stopThread(1000);
+  m_isPlaying = false;
+  m_callback->audioDeviceStopped();
+  m_callback = nullptr;
+  if (const int dropped = m_droppedChunks.exchange(0); dropped > 0)
+  {
+    PLOGW << "stream dropped " << dropped << " chunks";
+  }
+}
+
+bool StreamDevice::isPlaying() { return m_isPlaying; }
+
+juce::String StreamDevice::getLastError() { return m_lastError; }
+
+int StreamDevice::getCurrentBufferSizeSamples() { return m_bufferSize; }
+
+double StreamDevice::getCurrentSampleRate() { return m_sampleRate; }
+
+int StreamDevice::getCurrentBitDepth() { return 16; }
+
+juce::BigInteger StreamDevice::getActiveOutputChannels() const
+{
+  juce::BigInteger channels;
+  channels.setRange(0, m_numChannels, true);
+  return channels;
+}
+
+juce::BigInteger StreamDevice::getActiveInputChannels() const { return {}; }
+
+int StreamDevice::getOutputLatencyInSamples() { return m_bufferSize; }
+
+int StreamDevice::getInputLatencyInSamples() { return 0; }
+
+int StreamDevice::getXRunCount() const noexcept { return m_xruns.load(); }
+
+/**
+ * @brief Runs the audio callback once per block, paced by the wall clock.
+ *
+ * Blocks that are rendered too late count as xruns, the clock is resynchronised then.
+ */
+void StreamDevice::run()
+{
+  using namespace std::chrono;
+  const duration<double> blockDuration(m_bufferSize / m_sampleRate);
+  const juce::AudioIODeviceCallbackContext context{};
+
+  auto start = steady_clock::now();
+  auto startWall = system_clock::now();
+  uint64_t block = 0;
+  while (!threadShouldExit())
+  {
+    auto offset = duration_cast<steady_clock::duration>(blockDuration * block);
+    if (steady_clock::now() > start + offset + blockDuration)
+    {
+      ++m_xruns;
+      start = steady_clock::now();
+      startWall = system_clock::now();
+      block = 0;
+      offset = {};
+    }
+    std::this_thread::sleep_until(start + offset);
+
+    m_callback->audioDeviceIOCallbackWithContext(nullptr, 0, m_output.getArrayOfWritePointers(),
+                                                 m_numChannels, m_bufferSize, context);
+    const auto timestamp = duration_cast<microseconds>((startWall + offset).time_since_epoch());
+    encodeChunk(static_cast<uint64_t>(timestamp.count()));
+    ++block;
+  }
+}
+
+/**
+ * @brief Encodes the rendered block into the next chunk of the ring.
+ *
+ * @param timestampUs Wall clock time the block is due
+ */
+void StreamDevice::encodeChunk(uint64_t timestampUs)
+{
+  const uint32_t sequence = m_sequence++;
+  const auto scope = m_ring.write(1);
+  if (scope.blockSize1 + scope.blockSize2 == 0)
+  {
+    ++m_droppedChunks;
+    return;
+  }
+  scope.forEach(
+      [this, sequence, timestampUs](int index)
+      {
+        char *chunk = m_chunks.data() + static_cast<size_t>(index) * m_chunkBytes;
+        StreamChunkHeader header;
+        header.sequence = sequence;
+        header.timestampUs = timestampUs;
+        header.sampleRate = static_cast<uint32_t>(m_sampleRate);
+        header.numChannels = static_cast<uint16_t>(m_numChannels);
+        header.numFrames = static_cast<uint16_t>(m_bufferSize);
+        std::memcpy(chunk, &header, sizeof(header));
+
+        auto *samples = reinterpret_cast<int16_t *>(chunk + sizeof(header));
+        for (int channel = 0; channel < m_numChannels; ++channel)
+        {
+          const float *input = m_output.getReadPointer(channel);
+          for (int frame = 0; frame < m_bufferSize; ++frame)
+          {
+            const float value = juce::jlimit(-1.0f, 1.0f, input[frame]);
+            samples[frame * m_numChannels + channel] =
+                static_cast<int16_t>(juce::roundToInt(value * 32767.0f));
+          }
+        }
+      });
+}
+
+/**
+ * @brief Construct a new Stream Device:: Sender:: Sender object
+ *
+ * @param device The device whose chunks are sent
+ */
+StreamDevice::Sender::Sender(StreamDevice &device) :
+  juce::Thread("beak stream sender"), m_device(device)
+{
+}
+
+/**
+ * @brief Sends the chunks of the ring as soon as they are ready, one datagram per chunk.
+ *
+ */
+void StreamDevice::Sender::run()
+{
+  while (!threadShouldExit())
+  {
+    const int numReady = m_device.m_ring.getNumReady();
+    if (numReady == 0)
+    {
+      wait(senderPollMs);
+      continue;
+    }
+    const auto scope = m_device.m_ring.read(numReady);
+    scope.forEach(
+        [this](int index)
+        {
+          const char *chunk = m_device.m_chunks.data() + static_cast<size_t>(index) *
+                                                             m_device.m_chunkBytes;
+          asio::error_code ec;
+          m_device.m_socket.send_to(asio::buffer(chunk, m_device.m_chunkBytes),
+                                    m_device.m_endpoint, 0, ec);
+        });
+  }
+}
+
+/* ------------------------------- device type ------------------------------ */
+/**
+ * @brief Construct a new Stream Device Type:: Stream Device Type object
+ *
+ * @param host  Host to send the chunks to
+ * @param port  UDP port to send the chunks to
+ */
+StreamDeviceType::StreamDeviceType(const juce::String &host, uint16_t port) :
+  juce::AudioIODeviceType(typeName), m_host(host), m_port(port)
+{
+}
+
+void StreamDeviceType::scanForDevices() {}
+
+juce::StringArray StreamDeviceType::getDeviceNames(bool wantInputNames) const
+{
+  juce::StringArray names;
+  if (!wantInputNames)
+  {
+    names.add(StreamDevice::deviceName);
+  }
+  return names;
+}
+
+int StreamDeviceType::getDefaultDeviceIndex(bool) const { return 0; }
+
+int StreamDeviceType::getIndexOfDevice(juce::AudioIODevice *device, bool asInput) const
+{
+  return device != nullptr && !asInput ? 0 : -1;
+}
+
+bool StreamDeviceType::hasSeparateInputsAndOutputs() const { return false; }
+
+/**
+ * @brief Reimplemented to create the stream device.
+ *
+ * @param outputDeviceName      Name of the device, only the stream device is offered
+ * @return juce::AudioIODevice* The device, owned by the caller
+ */
+juce::AudioIODevice *StreamDeviceType::createDevice(const juce::String &outputDeviceName,
+                                                    const juce::String &)
+{
+  if (outputDeviceName.isNotEmpty() && outputDeviceName != StreamDevice::deviceName)
+  {
+    return nullptr;
+  }
+  return new StreamDevice(getTypeName(), m_host, m_port);
+}
+}  // namespace beak::sim
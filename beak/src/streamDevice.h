@@ -0,0 +1,138 @@
+#pragma once
+
+#include <juce_audio_devices/juce_audio_devices.h>
+
+#include <asio.hpp>
+#include <atomic>
+#include <bit>
+#include <vector>
+
+namespace beak::sim
+{
+/**
+ * @brief Header of every chunk sent by the stream device, followed by the samples.
+ *
+ * All fields are little endian, the header is copied as it is in memory. The samples are
+ * interleaved signed 16 bit PCM.
+ */
+struct StreamChunkHeader
+{
+  static constexpr uint32_t magic{0x43504b42};  //!< The bytes "BKPC" on the wire
+
+  uint32_t chunkMagic{magic};
+  uint32_t sequence{0};     //!< Counts up with every chunk, gaps are lost chunks
+  uint64_t timestampUs{0};  //!< Wall clock time the first sample is due, microseconds since epoch
+  uint32_t sampleRate{0};
+  uint16_t numChannels{0};
+  uint16_t numFrames{0};
+};
+static_assert(sizeof(StreamChunkHeader) == 24);
+static_assert(std::endian::native == std::endian::little, "the chunk header is little endian");
+
+/**
+ * @brief Audio device without a sound card, streams the output as PCM chunks over UDP.
+ *
+ * A thread of its own runs the audio callback in real time and encodes every block into one chunk
+ * of a ring. A second thread sends the chunks, so the audio callback never waits for the network.
+ * Chunks that do not fit into the ring are dropped.
+ */
+class StreamDevice : public juce::AudioIODevice, private juce::Thread
+{
+ public:
+  static constexpr const char *deviceName = "stream";
+  static constexpr int defaultBufferSize{256};  //!< About 6 ms per chunk at 44.1 kHz
+  static constexpr int maxChannels{8};
+  static constexpr int ringSize{32};  //!< Chunks that can wait for the sender
+
+ public:
+  StreamDevice(const juce::String &typeName, const juce::String &host, uint16_t port);
+  ~StreamDevice() override;
+
+  juce::StringArray getOutputChannelNames() override;
+  juce::StringArray getInputChannelNames() override;
+  juce::Array<double> getAvailableSampleRates() override;
+  juce::Array<int> getAvailableBufferSizes() override;
+  int getDefaultBufferSize() override;
+  juce::String open(const juce::BigInteger &inputChannels, const juce::BigInteger &outputChannels,
+                    double sampleRate, int bufferSizeSamples) override;
+  void close() override;
+  bool isOpen() override;
+  void start(juce::AudioIODeviceCallback *callback) override;
+  void stop() override;
+  bool isPlaying() override;
+  juce::String getLastError() override;
+  int getCurrentBufferSizeSamples() override;
+  double getCurrentSampleRate() override;
+  int getCurrentBitDepth() override;
+  juce::BigInteger getActiveOutputChannels() const override;
+  juce::BigInteger getActiveInputChannels() const override;
+  int getOutputLatencyInSamples() override;
+  int getInputLatencyInSamples() override;
+  int getXRunCount() const noexcept override;
+
+ private:
+  class Sender : public juce::Thread
+  {
+   public:
+    explicit Sender(StreamDevice &device);
+    void run() override;
+
+   private:
+    StreamDevice &m_device;
+  };
+
+  void run() override;
+  void encodeChunk(uint64_t timestampUs);
+
+ private:
+  juce::String m_host;
+  uint16_t m_port;
+  asio::io_context m_ioCtx;
+  asio::ip::udp::socket m_socket;
+  asio::ip::udp::endpoint m_endpoint;
+  Sender m_sender;
+
+  bool m_isOpen{false};
+  juce::String m_lastError;
+  double m_sampleRate{44100.0};
+  int m_bufferSize{defaultBufferSize};
+  int m_numChannels{2};
+  juce::AudioBuffer<float> m_output;
+
+  juce::AudioIODeviceCallback *m_callback{nullptr};
+  std::atomic<bool> m_isPlaying{false};
+  std::atomic<int> m_xruns{0};
+
+  // ring of encoded chunks between the audio and the sender thread
+  juce::AbstractFifo m_ring{ringSize};
+  size_t m_chunkBytes{0};
+  std::vector<char> m_chunks;
+  uint32_t m_sequence{0};
+  std::atomic<int> m_droppedChunks{0};
+};
+
+/**
+ * @brief Device type that offers the stream device, so the device manager can open it.
+ *
+ */
+class StreamDeviceType : public juce::AudioIODeviceType
+{
+ public:
+  static constexpr const char *typeName = "Stream";
+
+ public:
+  StreamDeviceType(const juce::String &host, uint16_t port);
+
+  void scanForDevices() override;
+  juce::StringArray getDeviceNames(bool wantInputNames = false) const override;
+  int getDefaultDeviceIndex(bool forInput) const override;
+  int getIndexOfDevice(juce::AudioIODevice *device, bool asInput) const override;
+  bool hasSeparateInputsAndOutputs() const override;
+  juce::AudioIODevice *createDevice(const juce::String &outputDeviceName,
+                                    const juce::String &inputDeviceName) override;
+
+ private:
+  juce::String m_host;
+  uint16_t m_port;
+};
+}  // namespace beak::sim
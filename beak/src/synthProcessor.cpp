@@ -1,5 +1,7 @@
 #include "synthProcessor.h"
 
+#include "rtCheck.h"
+
 namespace beak
 {
 
@@ -9,41 +11,15 @@ SynthProcessor::SynthProcessor() :
                     .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
   m_synth.addSound(new synth::Sound());
-  for (int i = 0; i < m_numVoices; i++)
-  {
-    m_synth.addVoice(new synth::Voice());
-  }
+  m_samplesUntilNoteOff.fill(-1);
+  m_midi.ensureSize(noteQueueSize * 2 * sizeof(juce::MidiMessage));
 }
 
-SynthProcessor::~SynthProcessor() { stopTimer(); }
-
 void SynthProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-  m_synth.setCurrentPlaybackSampleRate(sampleRate);
-
-  for (int i = 0; i < m_synth.getNumVoices(); i++)
-  {
-    if (synth::Voice* voice = dynamic_cast<synth::Voice*>(m_synth.getVoice(i)))
-    {
-      voice->prepareToPlay(sampleRate, samplesPerBlock, getTotalNumOutputChannels());
-    }
-  }
-
-  juce::dsp::ProcessSpec spec;
-  spec.maximumBlockSize = samplesPerBlock;
-  spec.sampleRate = sampleRate;
-  spec.numChannels = getTotalNumOutputChannels();
-
-  m_reverbParams.roomSize = 0.5f;
-  m_reverbParams.width = 1.0f;
-  m_reverbParams.damping = 0.5f;
-  m_reverbParams.freezeMode = 0.0f;
-  m_reverbParams.dryLevel = 1.0f;
-  m_reverbParams.wetLevel = 0.3f;
-
-  m_reverb.setParameters(m_reverbParams);
-
-  startTimer(m_timerIntervalMs);
+  m_synth.prepareToPlay(sampleRate, samplesPerBlock);
+  m_currentSendLevel = m_sendLevel.load();
+  m_sampleRate = sampleRate;
   m_isPrepared = true;
 }
 
@@ -53,8 +29,9 @@ void SynthProcessor::releaseResources()
   // spare memory, etc.
 }
 
-void SynthProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+void SynthProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
 {
+  BEAK_RT_AUDIO_SCOPE;
   jassert(m_isPrepared);
   juce::ScopedNoDenormals noDenormals;
   auto totalNumInputChannels = getTotalNumInputChannels();
@@ -63,75 +40,303 @@ void SynthProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBu
   for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
     buffer.clear(i, 0, buffer.getNumSamples());
 
-  updateVoices();
-  updateReverb();
-  m_synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
-  juce::dsp::AudioBlock<float> block{buffer};
-  m_reverb.process(juce::dsp::ProcessContextReplacing<float>(block));
+  // a config posted before a note or ramp is always taken together with it, so they are counted
+  // first, ramps posted before the config are dropped by their generation
+  const int numQueued = m_noteFifo.getNumReady();
+  const int numRamps = m_rampFifo.getNumReady();
+  applyConfig();
+  applyRamps(numRamps);
+  scheduleNotes(numQueued, buffer.getNumSamples());
+
+  auto& automation = m_synth.automation();
+  const float sendLevel =
+      automation.value(synth::Parameter::ReverbSend, m_sendLevel.load(), buffer.getNumSamples());
+
+  // nothing to render, hand the graph silence without running any DSP
+  if (m_midi.isEmpty() && m_synth.isIdle() && m_renderedVoices.isIdle())
+  {
+    buffer.clear();
+    m_currentSendLevel = sendLevel;
+    automation.advance(buffer.getNumSamples());
+    return;
+  }
+
+  m_synth.renderNextBlock(buffer, m_midi, 0, buffer.getNumSamples());
+  if (degradation() >= Degradation::ShedVoices)
+  {
+    m_overloadGuard->countShed(m_renderedVoices.shed(OverloadGuard::shedVoiceLimit));
+  }
+  m_renderedVoices.render(buffer, 1);
+
+  // the send to the reverb bus follows level changes and its automation with a ramp over one block
+  if (buffer.getNumChannels() > 1)
+  {
+    buffer.copyFromWithRamp(1, 0, buffer.getReadPointer(0), buffer.getNumSamples(),
+                            m_currentSendLevel, sendLevel);
+    m_currentSendLevel = sendLevel;
+  }
+  automation.advance(buffer.getNumSamples());
 }
 
-void SynthProcessor::updateVoices()
+/**
+ * @brief Applies the latest config on the audio thread, if there is a new one.
+ *
+ */
+void SynthProcessor::applyConfig()
 {
-  for (int i = 0; i < m_synth.getNumVoices(); ++i)
+  if (const Config* config = m_config.take())
   {
-    if (auto voice = dynamic_cast<synth::Voice*>(m_synth.getVoice(i)))
-    {
-      voice->getOscillator().setParams(m_oscillatorParams);
-      voice->getADSR().setParameters(m_adsrParams);
-      voice->getFilter().setParams(m_filterParams);
-      voice->getFilterADSR().setParameters(m_filterAdsrParams);
-    }
+    m_synth.setParams(config->osc, config->adsr, config->filter, config->filterAdsr);
+    m_synth.setPolyphony(config->polyphony);
+    m_appliedConfig = *config;
+    // a new config ends the ramps, the parameters start over from its values
+    m_synth.automation().reset();
+  }
+}
+
+/**
+ * @brief Starts the queued ramps on the audio thread, from the current value of their parameter.
+ *
+ * @param numRamps Number of queued ramps to take
+ */
+void SynthProcessor::applyRamps(int numRamps)
+{
+  const auto scope = m_rampFifo.read(numRamps);
+  scope.forEach(
+      [this](int index)
+      {
+        const auto& event = m_rampEvents[index];
+        // the config taken with this block was posted after the ramp and ends it
+        if (event.generation < m_appliedConfig.generation)
+        {
+          return;
+        }
+        float base = 0.0f;
+        switch (event.parameter)
+        {
+          case synth::Parameter::Cutoff:
+            base = m_appliedConfig.filter.cutoff;
+            break;
+          case synth::Parameter::Resonance:
+            base = m_appliedConfig.filter.resonance;
+            break;
+          case synth::Parameter::Gain:
+            base = m_appliedConfig.osc.gain;
+            break;
+          case synth::Parameter::ReverbSend:
+            base = m_sendLevel.load();
+            break;
+        }
+        m_synth.automation().start(event.parameter, base, event.target, event.durationMs,
+                                   event.easing);
+      });
+}
+
+/**
+ * @brief Configures the voices with the next block.
+ *
+ * Must only be called from one thread at a time. Only the latest config before a block is applied,
+ * notes queued after it are played with it.
+ *
+ * @param config The config
+ */
+void SynthProcessor::setConfig(const Config& config)
+{
+  Config posted = config;
+  posted.generation = m_postedConfigs.fetch_add(1, std::memory_order_relaxed) + 1;
+  m_isAutomated.store(false, std::memory_order_relaxed);
+  if (m_config.post(posted))
+  {
+    m_coalescedConfigs.fetch_add(1, std::memory_order_relaxed);
   }
 }
-void SynthProcessor::updateReverb() { m_reverb.setParameters(m_reverbParams); }
 
-void SynthProcessor::setVoiceParams(const synth::Oscillator::Parameters& oscParams,
-                                    const juce::ADSR::Parameters& adsrParams)
+/**
+ * @brief Sets how much of the channel is sent to the shared reverb.
+ *
+ * @param level Linear send level
+ */
+void SynthProcessor::setSendLevel(float level) { m_sendLevel = std::max(level, 0.0f); }
+
+/**
+ * @brief Ramps a parameter to a target, starting with the next block.
+ *
+ * Must only be called from one thread at a time. The parameter keeps the target until the next
+ * config of the channel.
+ *
+ * @param parameter   The parameter
+ * @param target      Value at the end of the ramp
+ * @param durationMs  Length of the ramp, 0 jumps to the target
+ * @param easing      Curve of the ramp
+ * @return true       The ramp has been queued, false if the queue is full
+ */
+bool SynthProcessor::ramp(synth::Parameter parameter, float target, float durationMs,
+                          synth::Easing easing)
 {
-  m_oscillatorParams = oscParams;
-  m_adsrParams = adsrParams;
+  if (parameter == synth::Parameter::ReverbSend)
+  {
+    target = std::max(target, 0.0f);
+  }
+  const RampEvent event{parameter, target, durationMs, easing,
+                        m_postedConfigs.load(std::memory_order_relaxed)};
+  const auto scope = m_rampFifo.write(1);
+  if (scope.blockSize1 + scope.blockSize2 == 0)
+  {
+    return false;
+  }
+  scope.forEach([this, &event](int index) { m_rampEvents[index] = event; });
+  // the send is applied to pre-rendered notes as well, the other parameters are not
+  if (parameter != synth::Parameter::ReverbSend)
+  {
+    m_isAutomated.store(true, std::memory_order_relaxed);
+  }
+  return true;
 }
 
-void SynthProcessor::setFilterParams(const synth::Filter::Parameters& params,
-                                     const juce::ADSR::Parameters& adsrParams)
+/**
+ * @brief Starts a note with the next block.
+ *
+ * Must only be called from one thread at a time.
+ *
+ * @param note        The note to play
+ * @param velocity    Velocity of the note from 0 to 1
+ * @param durationMs  Time until the note is released, exact to the sample
+ * @return true       The note has been queued, false if the queue is full
+ */
+bool SynthProcessor::noteOn(int note, float velocity, float durationMs)
 {
-  m_filterParams = params;
-  m_filterAdsrParams = adsrParams;
+  return pushNoteEvent({note, true, velocity, durationMs, nullptr});
 }
 
-void SynthProcessor::setReverbParams(const juce::Reverb::Parameters& params)
+/**
+ * @brief Releases a note with the next block.
+ *
+ * Must only be called from one thread at a time.
+ *
+ * @param note    The note to release
+ * @return true   The note off has been queued, false if the queue is full
+ */
+bool SynthProcessor::noteOff(int note)
 {
-  m_reverbParams = params;
+  return pushNoteEvent({note, false, 0.0f, 0.0f, nullptr});
 }
 
-void SynthProcessor::noteOn(int note, int duration = 0)
+/**
+ * @brief Plays a note that has been rendered ahead of time with the next block.
+ *
+ * Must only be called from one thread at a time. The caller has to keep the sample alive until it
+ * has finished playing, so it is never released on the audio thread.
+ *
+ * @param sample    The rendered note, mono at the sample rate of the device
+ * @param priority  Notes of lower priority are shed first under load
+ * @return true     The sample has been queued, false if the queue is full
+ */
+bool SynthProcessor::playRendered(std::shared_ptr<const SampleBuffer> sample, int priority)
 {
-  m_synth.noteOn(1, note, 1.0f);
-  m_noteOffs.set(note, duration);
+  return pushNoteEvent({0, true, 1.0f, 0.0f, std::move(sample), priority});
 }
 
-void SynthProcessor::noteOff(int note)
+/**
+ * @brief Schedules a note into the next block, must be called from the audio thread.
+ *
+ * Used by the sequencer before the block is rendered.
+ *
+ * @param note            The note to play
+ * @param velocity        Velocity of the note from 0 to 1
+ * @param offset          Sample of the next block the note starts on
+ * @param durationSamples Samples until the note is released
+ */
+void SynthProcessor::scheduleNote(int note, float velocity, int offset, int durationSamples)
 {
-  m_synth.noteOff(1, note, 1.0f, false);
-  m_noteOffs.remove(note);
+  if (note < 0 || note >= static_cast<int>(m_samplesUntilNoteOff.size()) ||
+      m_numScheduledNotes == static_cast<int>(m_scheduledNotes.size()))
+  {
+    return;
+  }
+  m_scheduledNotes[m_numScheduledNotes++] = {note, velocity, offset, durationSamples};
 }
 
-void SynthProcessor::timerCallback()
+/**
+ * @brief Passes a note event to the audio thread.
+ *
+ * @param event   The event
+ * @return true   The event has been queued, false if the queue is full
+ */
+bool SynthProcessor::pushNoteEvent(const NoteEvent& event)
 {
-  if (m_noteOffs.size() != 0)
+  if (event.note < 0 || event.note >= static_cast<int>(m_samplesUntilNoteOff.size()))
   {
-    for (auto it = m_noteOffs.begin(); it != m_noteOffs.end(); ++it)
-    {
-      const int note = it.getKey();
-      const int duration = it.getValue();
-      if (duration <= 0)
-      {
-        noteOff(note);
-      }
-      else
+    return false;
+  }
+  const auto scope = m_noteFifo.write(1);
+  if (scope.blockSize1 + scope.blockSize2 == 0)
+  {
+    return false;
+  }
+  scope.forEach([this, &event](int index) { m_noteEvents[index] = event; });
+  return true;
+}
+
+/**
+ * @brief Collects the note events of the next block on the audio thread.
+ *
+ * Queued notes start at the beginning of the block, scheduled notes at their offset. Pending note
+ * offs are placed at the exact sample their duration ends on.
+ *
+ * @param numQueued  Number of queued note events to take
+ * @param numSamples Number of samples of the block
+ */
+void SynthProcessor::scheduleNotes(int numQueued, int numSamples)
+{
+  m_midi.clear();
+
+  const auto scope = m_noteFifo.read(numQueued);
+  scope.forEach(
+      [this](int index)
       {
-        m_noteOffs.set(note, duration - m_timerIntervalMs);
-      }
+        const auto& event = m_noteEvents[index];
+        if (event.sample)
+        {
+          m_renderedVoices.schedule(event.sample, 0, 1.0f, event.priority);
+        }
+        else if (event.isNoteOn)
+        {
+          m_midi.addEvent(juce::MidiMessage::noteOn(1, event.note, event.velocity), 0);
+          m_samplesUntilNoteOff[event.note] = static_cast<int>(
+              std::lround(std::max(event.durationMs, 0.0f) * m_sampleRate / 1000.0));
+        }
+        else
+        {
+          m_midi.addEvent(juce::MidiMessage::noteOff(1, event.note), 0);
+          m_samplesUntilNoteOff[event.note] = -1;
+        }
+      });
+
+  for (int i = 0; i < m_numScheduledNotes; ++i)
+  {
+    const auto& scheduled = m_scheduledNotes[i];
+    m_midi.addEvent(juce::MidiMessage::noteOn(1, scheduled.note, scheduled.velocity),
+                    scheduled.offset);
+    m_samplesUntilNoteOff[scheduled.note] =
+        scheduled.offset + std::max(scheduled.durationSamples, 0);
+  }
+  m_numScheduledNotes = 0;
+
+  for (int note = 0; note < static_cast<int>(m_samplesUntilNoteOff.size()); ++note)
+  {
+    auto& samplesLeft = m_samplesUntilNoteOff[note];
+    if (samplesLeft < 0)
+    {
+      continue;
+    }
+    if (samplesLeft < numSamples)
+    {
+      m_midi.addEvent(juce::MidiMessage::noteOff(1, note), samplesLeft);
+      samplesLeft = -1;
+    }
+    else
+    {
+      samplesLeft -= numSamples;
     }
   }
 }
@@ -1,19 +1,51 @@
 #pragma once
 
+#include <array>
+
 #include "filter.h"
+#include "mailbox.h"
 #include "processor.h"
+#include "sampleVoices.h"
 #include "synthSound.h"
-#include "synthVoice.h"
+#include "synthesiser.h"
 
 namespace beak
 {
 
-class SynthProcessor : public ProcessorBase, private juce::Timer
+/**
+ * @brief Synthesiser of one channel.
+ *
+ * The first output channel carries the dry signal, the second one the send to the shared reverb.
+ * Notes are passed to the audio thread through a lock-free queue, note durations are counted down
+ * there in samples. Notes that have been rendered ahead of time are played back as samples next to
+ * the synthesiser. Configurations go through a mailbox instead, the audio thread applies the latest
+ * one once per block and those it never saw are counted as coalesced. Parameter ramps have a queue
+ * of their own, they start with the next block and are interpolated at control rate.
+ */
+class SynthProcessor : public ProcessorBase
 {
+ public:
+  static constexpr float defaultSendLevel{0.3f};
+  static constexpr int noteQueueSize{256};  //!< Note events that can be pending between two blocks
+  static constexpr int rampQueueSize{64};   //!< Ramps that can be pending between two blocks
+
+  /**
+   * @brief Configuration of the voices, applied as a whole.
+   *
+   */
+  struct Config
+  {
+    synth::Oscillator::Parameters osc;
+    juce::ADSR::Parameters adsr;
+    synth::Filter::Parameters filter;
+    juce::ADSR::Parameters filterAdsr;
+    int polyphony{synth::Synthesiser::defaultPolyphony};
+    uint64_t generation{0};  //!< Counted by setConfig, ramps posted before it are dropped
+  };
+
  public:
   //==============================================================================
   SynthProcessor();
-  ~SynthProcessor() override;
 
   //==============================================================================
   void prepareToPlay(double sampleRate, int samplesPerBlock) override;
@@ -22,31 +54,69 @@ class SynthProcessor : public ProcessorBase, private juce::Timer
   void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
 
  public:
-  void setVoiceParams(const synth::Oscillator::Parameters& oscParams,
-                      const juce::ADSR::Parameters& adsrParams);
-  void setFilterParams(const synth::Filter::Parameters& filterParams,
-                       const juce::ADSR::Parameters& adsr);
-  void setReverbParams(const juce::Reverb::Parameters& reverbParams);
-  void noteOn(int note, int duration);
-  void noteOff(int note);
-  void timerCallback() override;
+  void setConfig(const Config& config);
+  void setSendLevel(float level);
+  [[nodiscard]] bool ramp(synth::Parameter parameter, float target, float durationMs,
+                          synth::Easing easing);
+  uint64_t coalescedConfigs() const { return m_coalescedConfigs.load(std::memory_order_relaxed); }
+  bool isAutomated() const { return m_isAutomated.load(std::memory_order_relaxed); }
+  [[nodiscard]] bool noteOn(int note, float velocity, float durationMs);
+  [[nodiscard]] bool noteOff(int note);
+  [[nodiscard]] bool playRendered(std::shared_ptr<const SampleBuffer> sample, int priority = 0);
+  void scheduleNote(int note, float velocity, int offset, int durationSamples);
 
  private:
-  void updateVoices();
-  void updateFilter();
-  void updateReverb();
+  struct NoteEvent
+  {
+    int note;
+    bool isNoteOn;
+    float velocity;
+    float durationMs;
+    std::shared_ptr<const SampleBuffer> sample;  //!< Plays the pre-rendered note instead if set
+    int priority{0};                             //!< Of the pre-rendered note
+  };
+
+  struct RampEvent
+  {
+    synth::Parameter parameter;
+    float target;
+    float durationMs;
+    synth::Easing easing;
+    uint64_t generation;  //!< Of the last config posted before the ramp
+  };
+
+  struct ScheduledNote
+  {
+    int note;
+    float velocity;
+    int offset;
+    int durationSamples;
+  };
+
+  bool pushNoteEvent(const NoteEvent& event);
+  void scheduleNotes(int numQueued, int numSamples);
+  void applyConfig();
+  void applyRamps(int numRamps);
 
  private:
-  static constexpr int m_numVoices{1};
-  juce::Synthesiser m_synth;
-  synth::Oscillator::Parameters m_oscillatorParams;
-  juce::ADSR::Parameters m_adsrParams;
-  synth::Filter::Parameters m_filterParams;
-  juce::ADSR::Parameters m_filterAdsrParams;
-  juce::dsp::Reverb m_reverb;
-  juce::Reverb::Parameters m_reverbParams;
-  juce::HashMap<int, int, juce::DefaultHashFunctions, juce::CriticalSection> m_noteOffs;
-  static constexpr int m_timerIntervalMs{20};
+  synth::Synthesiser m_synth;
+  Mailbox<Config> m_config;
+  Config m_appliedConfig;  //!< Taken by the audio thread, ramps start from its values
+  std::atomic<uint64_t> m_coalescedConfigs{0};  //!< Replaced before the audio thread took them
+  std::atomic<uint64_t> m_postedConfigs{0};     //!< Generation of the last posted config
+  std::atomic<bool> m_isAutomated{false};  //!< Sound ramped since the last posted config
+  std::atomic<float> m_sendLevel{defaultSendLevel};
+  float m_currentSendLevel{defaultSendLevel};
+  juce::AbstractFifo m_noteFifo{noteQueueSize};
+  std::array<NoteEvent, noteQueueSize> m_noteEvents{};
+  juce::AbstractFifo m_rampFifo{rampQueueSize};
+  std::array<RampEvent, rampQueueSize> m_rampEvents{};
+  std::array<int, 128> m_samplesUntilNoteOff{};  //!< Per note, negative if no note off is pending
+  juce::MidiBuffer m_midi;                       //!< Events of the current block
+  std::array<ScheduledNote, noteQueueSize> m_scheduledNotes{};
+  int m_numScheduledNotes{0};     //!< Scheduled from the audio thread for the next block
+  SampleVoices m_renderedVoices;  //!< Pre-rendered notes, kept alive by the render cache
+  double m_sampleRate{44100.0};
   bool m_isPrepared{false};
 
   //==============================================================================
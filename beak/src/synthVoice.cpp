@@ -1,107 +1,375 @@
 #include "synthVoice.h"
 
-#include <plog/Log.h>
-
 namespace beak::synth
 {
+constexpr float voiceLevel = 0.07f;  //!< Linear gain of a voice at full velocity
 
-bool Voice::canPlaySound(juce::SynthesiserSound* sound)
+/* ------------------------------- voice group ------------------------------ */
+
+/**
+ * @brief Prepares all lanes for playback.
+ *
+ * The envelopes only produce one value per control interval, so they run at a fraction of the
+ * sample rate.
+ *
+ * @param sampleRate      The sample rate to use
+ * @param samplesPerBlock The expected number of samples per block
+ */
+void VoiceGroup::prepareToPlay(double sampleRate, int /*samplesPerBlock*/)
 {
-  return dynamic_cast<juce::SynthesiserSound*>(sound) != nullptr;
+  m_sampleRate = sampleRate;
+  for (int lane = 0; lane < numLanes; ++lane)
+  {
+    m_osc[lane].prepareToPlay(sampleRate);
+    m_osc[lane].setParams(m_oscParams);
+    m_adsr[lane].setSampleRate(sampleRate / Filter::controlInterval);
+    m_filterAdsr[lane].setSampleRate(sampleRate / Filter::controlInterval);
+  }
+  reset();
 }
 
-void Voice::startNote(int midiNoteNumber, float /*velocity*/, juce::SynthesiserSound* /*sound*/,
-                      int /*currentPitchWheelPosition*/)
+/**
+ * @brief Sets the parameters of all lanes.
+ *
+ * The oscillators are only reinitialised if their parameters changed.
+ *
+ * @param oscParams         Oscillator parameters
+ * @param adsrParams        Amplitude envelope parameters
+ * @param filterParams      Filter parameters
+ * @param filterAdsrParams  Filter envelope parameters
+ */
+void VoiceGroup::setParams(const Oscillator::Parameters& oscParams,
+                           const juce::ADSR::Parameters& adsrParams,
+                           const Filter::Parameters& filterParams,
+                           const juce::ADSR::Parameters& filterAdsrParams)
 {
-  m_osc.setFreq(midiNoteNumber);
-  m_adsr.noteOn();
-  m_filterAdsr.noteOn();
+  const bool oscChanged = oscParams != m_oscParams;
+  m_oscParams = oscParams;
+  m_filterParams = filterParams;
+  for (int lane = 0; lane < numLanes; ++lane)
+  {
+    if (oscChanged)
+    {
+      m_osc[lane].setParams(oscParams);
+    }
+    m_adsr[lane].setParameters(adsrParams);
+    m_filterAdsr[lane].setParameters(filterAdsrParams);
+  }
 }
 
-void Voice::stopNote(float /*velocity*/, bool /*allowTailOff*/)
+/**
+ * @brief Starts a note on one lane.
+ *
+ * A lane that is still sounding ramps from its current level, a silent lane starts with fresh
+ * filter state.
+ *
+ * @param lane            The lane to start
+ * @param midiNoteNumber  The note to play
+ * @param velocity        Velocity of the note from 0 to 1
+ */
+void VoiceGroup::startLane(int lane, int midiNoteNumber, float velocity)
 {
-  m_adsr.noteOff();
-  m_filterAdsr.noteOff();
+  m_osc[lane].setFreq(midiNoteNumber);
+  m_level[lane] = voiceLevel * velocity;
+  m_restart[lane] = !m_active[lane] && m_amp[lane] == 0.0f && m_ampTarget[lane] == 0.0f;
+  m_active[lane] = true;
+  m_needsControl[lane] = true;
+  m_adsr[lane].noteOn();
+  m_filterAdsr[lane].noteOn();
+}
 
-  if (!m_adsr.isActive())
+/**
+ * @brief Stops the note of one lane.
+ *
+ * @param lane          The lane to stop
+ * @param allowTailOff  Release the envelopes if true, fade out within one control interval if false
+ */
+void VoiceGroup::stopLane(int lane, bool allowTailOff)
+{
+  if (allowTailOff)
   {
-    clearCurrentNote();
+    m_adsr[lane].noteOff();
+    m_filterAdsr[lane].noteOff();
+    return;
   }
+  m_adsr[lane].reset();
+  m_filterAdsr[lane].reset();
+  m_active[lane] = false;
+  m_needsControl[lane] = true;
 }
 
-void Voice::prepareToPlay(double sampleRate, int samplesPerBlock, int outputChannels)
+/**
+ * @brief Checks if no lane produces any output.
+ *
+ * @return true   All lanes are silent
+ */
+bool VoiceGroup::isIdle() const
 {
-  reset();
-
-  m_adsr.setSampleRate(sampleRate);
-  m_filterAdsr.setSampleRate(sampleRate);
+  for (int lane = 0; lane < numLanes; ++lane)
+  {
+    if (m_active[lane] || m_amp[lane] != 0.0f || m_ampTarget[lane] != 0.0f)
+    {
+      return false;
+    }
+  }
+  return true;
+}
 
-  juce::dsp::ProcessSpec spec;
-  spec.maximumBlockSize = samplesPerBlock;
-  spec.sampleRate = sampleRate;
-  spec.numChannels = outputChannels;
+/**
+ * @brief Adds the output of all lanes to a mono buffer.
+ *
+ * @param output              The buffer to add to
+ * @param numSamples          Number of samples to render
+ * @param samplesUntilControl Samples left until the next control point of the synthesiser
+ * @param automation          Ramps of the parameters of the synthesiser
+ * @param blockOffset         Position of the output in the current block of the automation
+ */
+void VoiceGroup::render(float* output, int numSamples, int samplesUntilControl,
+                        const Automation& automation, int blockOffset)
+{
+  int clock = samplesUntilControl;
+  if (clock > 0)
+  {
+    evaluateAutomation(automation, blockOffset + clock);
+    // lanes that changed since the last control point ramp to their new values until the next one
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+      if (m_needsControl[lane])
+      {
+        updateControl(lane, clock, false);
+      }
+    }
+  }
 
-  m_osc.prepareToPlay(sampleRate, samplesPerBlock, outputChannels);
-  m_osc.setType(synth::Oscillator::Type::Saw);
-  m_filter.prepareToPlay(sampleRate, samplesPerBlock, outputChannels);
+  int pos = 0;
+  while (pos < numSamples)
+  {
+    if (clock == 0)
+    {
+      evaluateAutomation(automation, blockOffset + pos + Filter::controlInterval);
+      for (int lane = 0; lane < numLanes; ++lane)
+      {
+        updateControl(lane, Filter::controlInterval, true);
+      }
+      clock = Filter::controlInterval;
+    }
+    const int chunk = std::min(numSamples - pos, clock);
+    renderChunk(output + pos, chunk);
+    pos += chunk;
+    clock -= chunk;
+  }
+}
 
-  m_gain.prepare(spec);
-  m_gain.setGainLinear(0.07f);
+/**
+ * @brief Clears the state of all lanes.
+ *
+ */
+void VoiceGroup::reset()
+{
+  for (int lane = 0; lane < numLanes; ++lane)
+  {
+    m_adsr[lane].reset();
+    m_filterAdsr[lane].reset();
+  }
+  m_active.fill(false);
+  m_needsControl.fill(false);
+  m_restart.fill(false);
+  for (auto* values : {&m_amp, &m_ampTarget, &m_ampStep, &m_g, &m_gStep, &m_r2, &m_r2Step, &m_h,
+                       &m_hStep, &m_s1, &m_s2})
+  {
+    values->fill(0.0f);
+  }
+}
 
-  m_isPrepared = true;
+/**
+ * @brief Looks up the automated parameters for the ramps up to a control point.
+ *
+ * @param automation  Ramps of the parameters of the synthesiser
+ * @param offset      Position of the control point in the current block
+ */
+void VoiceGroup::evaluateAutomation(const Automation& automation, int offset)
+{
+  m_controlFilter = m_filterParams;
+  m_controlFilter.cutoff = automation.value(Parameter::Cutoff, m_filterParams.cutoff, offset);
+  m_controlFilter.resonance =
+      automation.value(Parameter::Resonance, m_filterParams.resonance, offset);
+  const float gainDb = automation.value(Parameter::Gain, m_oscParams.gain, offset);
+  m_controlGain = gainDb == m_oscParams.gain
+                      ? 1.0f
+                      : juce::Decibels::decibelsToGain(gainDb - m_oscParams.gain);
 }
 
-void Voice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
+/**
+ * @brief Evaluates the envelopes of one lane and sets up the ramps to the new values.
+ *
+ * @param lane            The lane to update
+ * @param rampLength      Number of samples until the next control point
+ * @param atControlPoint  True if the previous ramps have been completed
+ */
+void VoiceGroup::updateControl(int lane, int rampLength, bool atControlPoint)
 {
-  jassert(m_isPrepared);
+  m_needsControl[lane] = false;
+  if (atControlPoint)
+  {
+    // avoid accumulating rounding errors, so a released lane reaches exactly zero
+    m_amp[lane] = m_ampTarget[lane];
+  }
 
-  if (!isVoiceActive())
+  const float env = m_adsr[lane].getNextSample();
+  const float filterEnv = m_filterAdsr[lane].getNextSample();
+  if (!m_adsr[lane].isActive())
   {
-    return;
+    m_active[lane] = false;
   }
-  m_synthBuffer.setSize(1, numSamples, false, false, true);
+  m_ampTarget[lane] = m_active[lane] ? env * m_level[lane] * m_controlGain : 0.0f;
 
-  // we discard the applied envelope, since we don't need it, we are just interested in the next
-  // value
-  m_filterAdsr.applyEnvelopeToBuffer(m_synthBuffer, 0, m_synthBuffer.getNumSamples());
-  m_filter.setModulator(m_filterAdsr.getNextSample());
-  m_synthBuffer.clear();
+  const float scale = 1.0f / static_cast<float>(rampLength);
+  m_ampStep[lane] = (m_ampTarget[lane] - m_amp[lane]) * scale;
 
+  if (m_ampTarget[lane] == 0.0f && m_amp[lane] == 0.0f)
   {
-    // scoped pointer to buffer
-    auto* buffer = m_synthBuffer.getWritePointer(0, 0);
+    // silent lane, keep the filter as it is
+    m_gStep[lane] = m_r2Step[lane] = m_hStep[lane] = 0.0f;
+    return;
+  }
 
-    for (int s = 0; s < m_synthBuffer.getNumSamples(); ++s)
+  const auto target = Filter::computeCoefficients(m_sampleRate, m_controlFilter, filterEnv);
+  if (m_restart[lane])
+  {
+    m_restart[lane] = false;
+    m_g[lane] = target.g;
+    m_r2[lane] = target.r2;
+    m_h[lane] = target.h;
+    m_gStep[lane] = m_r2Step[lane] = m_hStep[lane] = 0.0f;
+    m_s1[lane] = m_s2[lane] = 0.0f;
+    return;
+  }
+  m_gStep[lane] = (target.g - m_g[lane]) * scale;
+  m_r2Step[lane] = (target.r2 - m_r2[lane]) * scale;
+  m_hStep[lane] = (target.h - m_h[lane]) * scale;
+}
+
+/**
+ * @brief Renders all lanes up to the next control point.
+ *
+ * The oscillators of the sounding lanes render the chunk interleaved into a scratch buffer first,
+ * then envelope, gain and filter run on all lanes at once in one loop.
+ *
+ * @param output      The mono buffer to add to
+ * @param numSamples  Number of samples to render, at most one control interval
+ */
+void VoiceGroup::renderChunk(float* output, int numSamples)
+{
+  jassert(numSamples <= Filter::controlInterval);
+  for (int lane = 0; lane < numLanes; ++lane)
+  {
+    if (m_active[lane] || m_amp[lane] != 0.0f || m_ampTarget[lane] != 0.0f)
+    {
+      m_osc[lane].renderNextBlock(m_input.data() + lane, numSamples, numLanes);
+    }
+    else
     {
-      buffer[s] = m_osc.processNextSample(buffer[s]);
+      for (int s = 0; s < numSamples; ++s)
+      {
+        m_input[s * numLanes + lane] = 0.0f;
+      }
     }
   }
 
-  juce::dsp::AudioBlock<float> audioBlock{m_synthBuffer};
-  m_gain.process(juce::dsp::ProcessContextReplacing<float>(audioBlock));
-  m_adsr.applyEnvelopeToBuffer(m_synthBuffer, 0, m_synthBuffer.getNumSamples());
+  auto amp = Lane::fromRawArray(m_amp.data());
+  auto g = Lane::fromRawArray(m_g.data());
+  auto r2 = Lane::fromRawArray(m_r2.data());
+  auto h = Lane::fromRawArray(m_h.data());
+  auto s1 = Lane::fromRawArray(m_s1.data());
+  auto s2 = Lane::fromRawArray(m_s2.data());
+  const auto ampStep = Lane::fromRawArray(m_ampStep.data());
+  const auto gStep = Lane::fromRawArray(m_gStep.data());
+  const auto r2Step = Lane::fromRawArray(m_r2Step.data());
+  const auto hStep = Lane::fromRawArray(m_hStep.data());
+  const auto type = m_filterParams.type;
 
+  for (int s = 0; s < numSamples; ++s)
   {
-    // scoped pointer to buffer
-    auto* buffer = m_synthBuffer.getWritePointer(0, 0);
-    for (int s = 0; s < m_synthBuffer.getNumSamples(); ++s)
+    amp += ampStep;
+    g += gStep;
+    r2 += r2Step;
+    h += hStep;
+
+    const auto x = Lane::fromRawArray(m_input.data() + s * numLanes) * amp;
+    const auto yHP = h * (x - s1 * (g + r2) - s2);
+    const auto yBP = yHP * g + s1;
+    s1 = yHP * g + yBP;
+    const auto yLP = yBP * g + s2;
+    s2 = yBP * g + yLP;
+
+    switch (type)
     {
-      buffer[s] = m_filter.processNextSample(0, m_synthBuffer.getSample(0, s));
+      case Filter::Type::Bandpass:
+        output[s] += yBP.sum();
+        break;
+      case Filter::Type::Highpass:
+        output[s] += yHP.sum();
+        break;
+      case Filter::Type::Lowpass:
+      default:
+        output[s] += yLP.sum();
+        break;
     }
   }
 
-  outputBuffer.addFrom(0, startSample, m_synthBuffer, 0, 0, numSamples);
+  amp.copyToRawArray(m_amp.data());
+  g.copyToRawArray(m_g.data());
+  r2.copyToRawArray(m_r2.data());
+  h.copyToRawArray(m_h.data());
+  s1.copyToRawArray(m_s1.data());
+  s2.copyToRawArray(m_s2.data());
+}
 
-  if (!m_adsr.isActive())
-  {
-    clearCurrentNote();
-  }
+/* ---------------------------------- voice --------------------------------- */
+
+/**
+ * @brief Construct a new Voice:: Voice object
+ *
+ * @param group The group that renders this voice
+ * @param lane  The lane of the group this voice uses
+ */
+Voice::Voice(VoiceGroup& group, int lane) : m_group(group), m_lane(lane) {}
+
+bool Voice::canPlaySound(juce::SynthesiserSound* sound)
+{
+  return dynamic_cast<juce::SynthesiserSound*>(sound) != nullptr;
 }
 
-void Voice::reset()
+void Voice::startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound* /*sound*/,
+                      int /*currentPitchWheelPosition*/)
 {
-  m_gain.reset();
-  m_adsr.reset();
+  m_group.startLane(m_lane, midiNoteNumber, velocity);
 }
 
+void Voice::stopNote(float /*velocity*/, bool allowTailOff)
+{
+  m_group.stopLane(m_lane, allowTailOff);
+  finishIfIdle();
+}
+
+/**
+ * @brief Does nothing, the voice is rendered with its group in Synthesiser::renderVoices.
+ *
+ */
+void Voice::renderNextBlock(juce::AudioBuffer<float>& /*outputBuffer*/, int /*startSample*/,
+                            int /*numSamples*/)
+{
+}
+
+/**
+ * @brief Frees the voice once its lane has finished playing.
+ *
+ */
+void Voice::finishIfIdle()
+{
+  if (getCurrentlyPlayingNote() >= 0 && !m_group.isLaneActive(m_lane))
+  {
+    clearCurrentNote();
+  }
+}
 }  // namespace beak::synth
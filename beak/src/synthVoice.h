@@ -2,15 +2,90 @@
 
 #include <juce_dsp/juce_dsp.h>
 
+#include <array>
+
+#include "automation.h"
 #include "filter.h"
 #include "oscillator.h"
 #include "synthSound.h"
 
 namespace beak::synth
 {
+/**
+ * @brief A group of voices rendered side by side in the lanes of a SIMD register.
+ *
+ * Every lane holds one voice. Oscillators and envelopes are advanced per lane, the oscillators
+ * rendering a whole chunk at a time. Envelope, gain and filter run on all lanes at once in one
+ * fused loop over the samples. Envelopes, filter coefficients and automated parameters are updated
+ * every `Filter::controlInterval` samples and ramped in between.
+ */
+class VoiceGroup
+{
+ public:
+  using Lane = juce::dsp::SIMDRegister<float>;
+  static constexpr int numLanes = static_cast<int>(Lane::SIMDNumElements);
+
+ public:
+  void prepareToPlay(double sampleRate, int samplesPerBlock);
+  void setParams(const Oscillator::Parameters& oscParams, const juce::ADSR::Parameters& adsrParams,
+                 const Filter::Parameters& filterParams,
+                 const juce::ADSR::Parameters& filterAdsrParams);
+  void startLane(int lane, int midiNoteNumber, float velocity);
+  void stopLane(int lane, bool allowTailOff);
+  bool isLaneActive(int lane) const { return m_active[lane]; }
+  bool isIdle() const;
+  void render(float* output, int numSamples, int samplesUntilControl,
+              const Automation& automation, int blockOffset);
+  void reset();
+
+ private:
+  void evaluateAutomation(const Automation& automation, int offset);
+  void updateControl(int lane, int rampLength, bool atControlPoint);
+  void renderChunk(float* output, int numSamples);
+
+ private:
+  template <typename T>
+  using LaneArray = std::array<T, numLanes>;
+  static constexpr std::size_t laneAlignment = Lane::SIMDRegisterSize;
+
+  double m_sampleRate{44100.0};
+  Oscillator::Parameters m_oscParams;
+  Filter::Parameters m_filterParams;
+  Filter::Parameters m_controlFilter;  //!< Filter params with automation, of the next control point
+  float m_controlGain{1.0f};           //!< Gain automation relative to the oscillator gain
+  LaneArray<Oscillator> m_osc;
+  LaneArray<juce::ADSR> m_adsr;
+  LaneArray<juce::ADSR> m_filterAdsr;
+  LaneArray<float> m_level{};
+  LaneArray<bool> m_active{};
+  LaneArray<bool> m_needsControl{};
+  LaneArray<bool> m_restart{};
+
+  alignas(laneAlignment) LaneArray<float> m_amp{};
+  alignas(laneAlignment) LaneArray<float> m_ampTarget{};
+  alignas(laneAlignment) LaneArray<float> m_ampStep{};
+  alignas(laneAlignment) LaneArray<float> m_g{};
+  alignas(laneAlignment) LaneArray<float> m_gStep{};
+  alignas(laneAlignment) LaneArray<float> m_r2{};
+  alignas(laneAlignment) LaneArray<float> m_r2Step{};
+  alignas(laneAlignment) LaneArray<float> m_h{};
+  alignas(laneAlignment) LaneArray<float> m_hStep{};
+  alignas(laneAlignment) LaneArray<float> m_s1{};
+  alignas(laneAlignment) LaneArray<float> m_s2{};
+  //! Oscillator output of one control interval, interleaved by lane
+  alignas(laneAlignment) std::array<float, Filter::controlInterval * numLanes> m_input{};
+};
+
+/**
+ * @brief A voice of the synthesiser, a handle to one lane of a VoiceGroup.
+ *
+ * The voice is rendered together with the other voices of its group by synth::Synthesiser.
+ */
 class Voice : public juce::SynthesiserVoice
 {
  public:
+  Voice(VoiceGroup& group, int lane);
+
   bool canPlaySound(juce::SynthesiserSound* sound) override;
   void startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound* sound,
                  int currentPitchWheelPosition) override;
@@ -20,27 +95,14 @@ class Voice : public juce::SynthesiserVoice
   {
   }
   void pitchWheelMoved([[maybe_unused]] int newPitchWheelValue) override {}
-  void prepareToPlay(double sampleRate, int samplesPerBlock, int outputChannels);
   void renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample,
                        int numSamples) override;
 
-  bool isVoiceActive() const override { return m_adsr.isActive(); }
-
-  Oscillator& getOscillator() { return m_osc; }
-  juce::ADSR& getADSR() { return m_adsr; }
-  juce::ADSR& getFilterADSR() { return m_filterAdsr; }
-  Filter& getFilter() { return m_filter; }
-
-  void reset();
+  bool isVoiceActive() const override { return m_group.isLaneActive(m_lane); }
+  void finishIfIdle();
 
  private:
-  Oscillator m_osc;
-  Filter m_filter;
-  juce::ADSR m_adsr;
-  juce::ADSR m_filterAdsr;
-  juce::AudioBuffer<float> m_synthBuffer;
-
-  juce::dsp::Gain<float> m_gain;
-  bool m_isPrepared{false};
+  VoiceGroup& m_group;
+  int m_lane;
 };
 }  // namespace beak::synth
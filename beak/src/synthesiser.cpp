@@ -0,0 +1,159 @@
+#include "synthesiser.h"
+
+namespace beak::synth
+{
+/**
+ * @brief Construct a new Synthesiser:: Synthesiser object
+ *
+ * Allocates all voices, filling one VoiceGroup after the other.
+ */
+Synthesiser::Synthesiser()
+{
+  constexpr int numGroups = (maxVoices + VoiceGroup::numLanes - 1) / VoiceGroup::numLanes;
+  for (int i = 0; i < numGroups; ++i)
+  {
+    m_groups.push_back(std::make_unique<VoiceGroup>());
+  }
+  for (int i = 0; i < maxVoices; ++i)
+  {
+    auto* voice = new Voice(*m_groups.at(i / VoiceGroup::numLanes), i % VoiceGroup::numLanes);
+    m_voices.push_back(voice);
+    addVoice(voice);
+  }
+}
+
+/**
+ * @brief Prepares all voice groups for playback.
+ *
+ * @param sampleRate      The sample rate to use
+ * @param samplesPerBlock The expected number of samples per block
+ */
+void Synthesiser::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+  setCurrentPlaybackSampleRate(sampleRate);
+  for (auto& group : m_groups)
+  {
+    group->prepareToPlay(sampleRate, samplesPerBlock);
+  }
+  m_automation.prepareToPlay(sampleRate);
+  m_samplesUntilControl = 0;
+}
+
+/**
+ * @brief Sets the parameters of all voices.
+ *
+ * @param oscParams         Oscillator parameters
+ * @param adsrParams        Amplitude envelope parameters
+ * @param filterParams      Filter parameters
+ * @param filterAdsrParams  Filter envelope parameters
+ */
+void Synthesiser::setParams(const Oscillator::Parameters& oscParams,
+                            const juce::ADSR::Parameters& adsrParams,
+                            const Filter::Parameters& filterParams,
+                            const juce::ADSR::Parameters& filterAdsrParams)
+{
+  for (auto& group : m_groups)
+  {
+    group->setParams(oscParams, adsrParams, filterParams, filterAdsrParams);
+  }
+}
+
+/**
+ * @brief Sets the number of voices that can play at the same time.
+ *
+ * @param numVoices Number of voices, the default polyphony is used for values below one
+ */
+void Synthesiser::setPolyphony(int numVoices)
+{
+  m_polyphony = numVoices < 1 ? defaultPolyphony : std::min(numVoices, maxVoices);
+}
+
+/**
+ * @brief Checks if no voice produces any output, including release tails.
+ *
+ * @return true   The synthesiser is silent
+ */
+bool Synthesiser::isIdle() const
+{
+  for (const auto& group : m_groups)
+  {
+    if (!group->isIdle())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Reimplemented to render whole voice groups instead of single voices.
+ *
+ * Groups without any sounding lane are skipped.
+ *
+ * @param outputAudio The buffer to add to, only the first channel is used
+ * @param startSample The first sample to render
+ * @param numSamples  Number of samples to render
+ */
+void Synthesiser::renderVoices(juce::AudioBuffer<float>& outputAudio, int startSample,
+                               int numSamples)
+{
+  auto* output = outputAudio.getWritePointer(0, startSample);
+  for (auto& group : m_groups)
+  {
+    if (!group->isIdle())
+    {
+      group->render(output, numSamples, m_samplesUntilControl, m_automation, startSample);
+    }
+  }
+
+  // advance the shared control clock of all groups
+  if (numSamples < m_samplesUntilControl)
+  {
+    m_samplesUntilControl -= numSamples;
+  }
+  else
+  {
+    const int elapsed = (numSamples - m_samplesUntilControl) % Filter::controlInterval;
+    m_samplesUntilControl = (Filter::controlInterval - elapsed) % Filter::controlInterval;
+  }
+
+  for (auto* voice : m_voices)
+  {
+    voice->finishIfIdle();
+  }
+}
+
+/**
+ * @brief Reimplemented to only use as many voices as the polyphony allows.
+ *
+ * If all of them are busy, the oldest one is stolen.
+ *
+ * @param soundToPlay           The sound to play
+ * @param stealIfNoneAvailable  Steal a voice if none is free
+ * @return juce::SynthesiserVoice* The voice to use or nullptr
+ */
+juce::SynthesiserVoice* Synthesiser::findFreeVoice(juce::SynthesiserSound* soundToPlay,
+                                                   int /*midiChannel*/, int /*midiNoteNumber*/,
+                                                   bool stealIfNoneAvailable) const
+{
+  const int numVoices = std::min(m_polyphony.load(), voices.size());
+  juce::SynthesiserVoice* oldest = nullptr;
+  for (int i = 0; i < numVoices; ++i)
+  {
+    auto* voice = voices.getUnchecked(i);
+    if (!voice->canPlaySound(soundToPlay))
+    {
+      continue;
+    }
+    if (!voice->isVoiceActive())
+    {
+      return voice;
+    }
+    if (oldest == nullptr || voice->wasStartedBefore(*oldest))
+    {
+      oldest = voice;
+    }
+  }
+  return stealIfNoneAvailable ? oldest : nullptr;
+}
+}  // namespace beak::synth
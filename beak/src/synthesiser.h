@@ -0,0 +1,57 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "automation.h"
+#include "synthVoice.h"
+
+namespace beak::synth
+{
+/**
+ * @brief Polyphonic synthesiser that renders its voices in SIMD lanes.
+ *
+ * All voices are allocated up front and grouped into VoiceGroups. The polyphony only limits how
+ * many of them are used, so it can be changed while playing without allocating. Parameter ramps
+ * of the automation are evaluated by the groups at their control points.
+ */
+class Synthesiser : public juce::Synthesiser
+{
+ public:
+  static constexpr int maxVoices{16};
+  static constexpr int defaultPolyphony{1};
+
+ public:
+  Synthesiser();
+
+  void prepareToPlay(double sampleRate, int samplesPerBlock);
+  void setParams(const Oscillator::Parameters& oscParams, const juce::ADSR::Parameters& adsrParams,
+                 const Filter::Parameters& filterParams,
+                 const juce::ADSR::Parameters& filterAdsrParams);
+  void setPolyphony(int numVoices);
+  int getPolyphony() const { return m_polyphony.load(); }
+  Automation& automation() { return m_automation; }
+  bool isIdle() const;
+
+ protected:
+  using juce::Synthesiser::renderVoices;
+  void renderVoices(juce::AudioBuffer<float>& outputAudio, int startSample,
+                    int numSamples) override;
+  juce::SynthesiserVoice* findFreeVoice(juce::SynthesiserSound* soundToPlay, int midiChannel,
+                                        int midiNoteNumber,
+                                        bool stealIfNoneAvailable) const override;
+
+ private:
+  std::vector<std::unique_ptr<VoiceGroup>> m_groups;
+  std::vector<Voice*> m_voices;
+  std::atomic<int> m_polyphony{defaultPolyphony};
+  Automation m_automation;
+  int m_samplesUntilControl{0};
+
+  //==============================================================================
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Synthesiser)
+};
+}  // namespace beak::synth
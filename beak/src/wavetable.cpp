@@ -0,0 +1,120 @@
+#include "wavetable.h"
+
+#include <juce_core/juce_core.h>
+
+#include <cmath>
+
+namespace beak::synth
+{
+/**
+ * @brief Returns the shared wavetable of a waveform.
+ *
+ * All tables are built on the first call, which should happen before playback starts.
+ *
+ * @param waveform          The waveform
+ * @return const Wavetable& The band-limited wavetable
+ */
+const Wavetable& Wavetable::get(Waveform waveform)
+{
+  static const Wavetable sine([](int n) { return n == 1 ? 1.0f : 0.0f; });
+  static const Wavetable saw(
+      [](int n)
+      {
+        const float sign = n % 2 == 0 ? -1.0f : 1.0f;
+        return sign * 2.0f / (juce::MathConstants<float>::pi * static_cast<float>(n));
+      });
+  static const Wavetable square(
+      [](int n)
+      {
+        return n % 2 == 0 ? 0.0f
+                          : 4.0f / (juce::MathConstants<float>::pi * static_cast<float>(n));
+      });
+  static const Wavetable triangle(
+      [](int n)
+      {
+        if (n % 2 == 0)
+        {
+          return 0.0f;
+        }
+        const float sign = (n / 2) % 2 == 0 ? 1.0f : -1.0f;
+        const float piN = juce::MathConstants<float>::pi * static_cast<float>(n);
+        return sign * 8.0f / (piN * piN);
+      });
+
+  switch (waveform)
+  {
+    case Waveform::Sine:
+      return sine;
+    case Waveform::Saw:
+      return saw;
+    case Waveform::Square:
+      return square;
+    case Waveform::Triangle:
+      return triangle;
+    default:
+      // You shouldn't be here!
+      jassertfalse;
+      return sine;
+  }
+}
+
+/**
+ * @brief Builds all mip levels by additive synthesis.
+ *
+ * Starts with the level holding only the fundamental and adds the missing harmonics for every
+ * level below. The partials are read from one sine table, so no trigonometric function is
+ * evaluated per harmonic.
+ *
+ * @param harmonicAmplitude Amplitude of the n-th harmonic
+ */
+Wavetable::Wavetable(const std::function<float(int)>& harmonicAmplitude) :
+  m_data(static_cast<size_t>(numLevels * (tableSize + 1)))
+{
+  std::vector<float> sine(tableSize);
+  for (int i = 0; i < tableSize; ++i)
+  {
+    sine[i] = static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * i / tableSize));
+  }
+
+  std::vector<float> cycle(tableSize, 0.0f);
+  int harmonics = 0;
+  for (int level = numLevels - 1; level >= 0; --level)
+  {
+    const int levelHarmonics = maxHarmonics >> level;
+    for (int n = harmonics + 1; n <= levelHarmonics; ++n)
+    {
+      const float amplitude = harmonicAmplitude(n);
+      if (amplitude == 0.0f)
+      {
+        continue;
+      }
+      for (int i = 0; i < tableSize; ++i)
+      {
+        cycle[i] += amplitude * sine[(n * i) & (tableSize - 1)];
+      }
+    }
+    harmonics = levelHarmonics;
+
+    auto* table = m_data.data() + level * (tableSize + 1);
+    std::copy(cycle.begin(), cycle.end(), table);
+    table[tableSize] = cycle[0];
+  }
+}
+
+/**
+ * @brief Returns the level with the most harmonics that do not alias at a phase increment.
+ *
+ * @param increment     Phase increment per sample, in cycles
+ * @return const float* The table of the level, with tableSize + 1 samples
+ */
+const float* Wavetable::getTable(float increment) const
+{
+  int level = 0;
+  while (level < numLevels - 1 &&
+         static_cast<float>(maxHarmonics >> level) * increment > 0.5f)
+  {
+    ++level;
+  }
+  return m_data.data() + level * (tableSize + 1);
+}
+}  // namespace beak::synth
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+namespace beak::synth
+{
+enum class Waveform
+{
+  Sine,
+  Saw,
+  Square,
+  Triangle
+};
+
+/**
+ * @brief Band-limited, mip-mapped single cycle wavetable.
+ *
+ * Every mip level holds half the harmonics of the level below, so for any frequency there is a
+ * table without partials above the Nyquist frequency. The tables are computed once by additive
+ * synthesis and shared by all oscillators.
+ */
+class Wavetable
+{
+ public:
+  static constexpr int tableSize{2048};              //!< Samples per cycle, a power of two
+  static constexpr int maxHarmonics{tableSize / 2};  //!< Harmonics of the lowest level
+  static constexpr int numLevels{11};                //!< Levels from maxHarmonics down to one
+
+  static const Wavetable& get(Waveform waveform);
+
+  const float* getTable(float increment) const;
+
+ private:
+  explicit Wavetable(const std::function<float(int)>& harmonicAmplitude);
+
+ private:
+  std::vector<float> m_data;  //!< All levels, each with one guard sample for interpolation
+};
+}  // namespace beak::synth
@@ -6,6 +6,7 @@ defmodule Joystick.Protobuf.SynthWaveform do
   field :SINE, 0
   field :SAW, 1
   field :SQUARE, 2
+  field :TRIANGLE, 3
 end
 
 defmodule Joystick.Protobuf.SynthFilterType do
@@ -26,6 +27,28 @@ defmodule Joystick.Protobuf.SynthEventType do
   field :CONFIG, 0
   field :NOTE_ON, 1
   field :NOTE_OFF, 2
+  field :REGISTER_PATCH, 3
+end
+
+defmodule Joystick.Protobuf.SynthParameter do
+  @moduledoc false
+
+  use Protobuf, enum: true, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :SYNTH_CUTOFF, 0
+  field :SYNTH_RESONANCE, 1
+  field :SYNTH_GAIN, 2
+  field :SYNTH_REVERB_SEND, 3
+end
+
+defmodule Joystick.Protobuf.SequenceCommand do
+  @moduledoc false
+
+  use Protobuf, enum: true, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :SEQUENCE_START, 0
+  field :SEQUENCE_STOP, 1
+  field :SEQUENCE_SET_TEMPO, 2
 end
 
 defmodule Joystick.Protobuf.InputType do
@@ -98,6 +121,25 @@ defmodule Joystick.Protobuf.Packet do
   field :rgb_frame, 4, type: Joystick.Protobuf.RGBFrame, json_name: "rgbFrame", oneof: 0
   field :audio_frame, 5, type: Joystick.Protobuf.AudioFrame, json_name: "audioFrame", oneof: 0
   field :synth_frame, 10, type: Joystick.Protobuf.SynthFrame, json_name: "synthFrame", oneof: 0
+  field :synth_ramp, 20, type: Joystick.Protobuf.SynthRamp, json_name: "synthRamp", oneof: 0
+
+  field :synth_sequence, 16,
+    type: Joystick.Protobuf.SynthSequence,
+    json_name: "synthSequence",
+    oneof: 0
+
+  field :sequence_control, 17,
+    type: Joystick.Protobuf.SequenceControl,
+    json_name: "sequenceControl",
+    oneof: 0
+
+  field :recorder_control, 18,
+    type: Joystick.Protobuf.RecorderControl,
+    json_name: "recorderControl",
+    oneof: 0
+
+  field :beak_status, 19, type: Joystick.Protobuf.BeakStatus, json_name: "beakStatus", oneof: 0
+
   field :input_event, 6, type: Joystick.Protobuf.InputEvent, json_name: "inputEvent", oneof: 0
 
   field :input_light_event, 15,
@@ -169,6 +211,20 @@ defmodule Joystick.Protobuf.RGBWFrame do
   field :easing_interval, 2, type: :uint32, json_name: "easingInterval"
 end
 
+defmodule Joystick.Protobuf.AudioFanOut do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :channels, 1, repeated: true, type: :uint32
+  field :gains, 2, repeated: true, type: :float
+  field :positional, 3, type: :bool
+  field :position, 4, type: :float
+  field :spread, 5, type: :float
+  field :end_position, 6, type: :float, json_name: "endPosition"
+  field :move_ms, 7, type: :uint32, json_name: "moveMs"
+end
+
 defmodule Joystick.Protobuf.AudioFrame do
   @moduledoc false
 
@@ -177,6 +233,8 @@ defmodule Joystick.Protobuf.AudioFrame do
   field :uri, 1, type: :string
   field :channel, 2, type: :uint32
   field :stop, 3, type: :bool
+  field :fan_out, 4, type: Joystick.Protobuf.AudioFanOut, json_name: "fanOut"
+  field :priority, 5, type: :int32
 end
 
 defmodule Joystick.Protobuf.SynthAdsrConfig do
@@ -200,6 +258,7 @@ defmodule Joystick.Protobuf.SynthReverbConfig do
   field :damping, 3, type: :float
   field :freeze_mode, 4, type: :float, json_name: "freezeMode"
   field :wet_level, 5, type: :float, json_name: "wetLevel"
+  field :spread, 6, type: :float
 end
 
 defmodule Joystick.Protobuf.SynthConfig do
@@ -223,6 +282,16 @@ defmodule Joystick.Protobuf.SynthConfig do
   field :cutoff, 6, type: :float
   field :resonance, 7, type: :float
   field :reverb_config, 8, type: Joystick.Protobuf.SynthReverbConfig, json_name: "reverbConfig"
+  field :polyphony, 9, type: :uint32
+end
+
+defmodule Joystick.Protobuf.SynthPatchOverrides do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :cutoff, 1, type: :float
+  field :resonance, 2, type: :float
 end
 
 defmodule Joystick.Protobuf.SynthFrame do
@@ -236,6 +305,87 @@ defmodule Joystick.Protobuf.SynthFrame do
   field :velocity, 4, type: :float
   field :duration_ms, 5, type: :float, json_name: "durationMs"
   field :config, 6, type: Joystick.Protobuf.SynthConfig
+  field :patch_id, 7, type: :uint32, json_name: "patchId"
+  field :overrides, 8, type: Joystick.Protobuf.SynthPatchOverrides
+  field :priority, 9, type: :int32
+end
+
+defmodule Joystick.Protobuf.SynthRamp do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :channel, 1, type: :uint32
+  field :parameter, 2, type: Joystick.Protobuf.SynthParameter, enum: true
+  field :target, 3, type: :float
+  field :duration_ms, 4, type: :float, json_name: "durationMs"
+  field :easing, 5, type: Joystick.Protobuf.EasingMode, enum: true
+end
+
+defmodule Joystick.Protobuf.SequenceStep do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :tick, 1, type: :uint32
+  field :duration_ticks, 2, type: :uint32, json_name: "durationTicks"
+  field :note, 3, type: :uint32
+  field :velocity, 4, type: :float
+  field :uri, 5, type: :string
+end
+
+defmodule Joystick.Protobuf.SequenceTrack do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :channel, 1, type: :uint32
+  field :patch_id, 2, type: :uint32, json_name: "patchId"
+  field :steps, 3, repeated: true, type: Joystick.Protobuf.SequenceStep
+end
+
+defmodule Joystick.Protobuf.SynthSequence do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :bpm, 1, type: :float
+  field :ticks_per_beat, 2, type: :uint32, json_name: "ticksPerBeat"
+  field :length_ticks, 3, type: :uint32, json_name: "lengthTicks"
+  field :loop, 4, type: :bool
+  field :loop_start_ticks, 5, type: :uint32, json_name: "loopStartTicks"
+  field :tracks, 6, repeated: true, type: Joystick.Protobuf.SequenceTrack
+end
+
+defmodule Joystick.Protobuf.SequenceControl do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :command, 1, type: Joystick.Protobuf.SequenceCommand, enum: true
+  field :bpm, 2, type: :float
+end
+
+defmodule Joystick.Protobuf.RecorderControl do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :save_seconds, 1, type: :float, json_name: "saveSeconds"
+end
+
+defmodule Joystick.Protobuf.BeakStatus do
+  @moduledoc false
+
+  use Protobuf, syntax: :proto3, protoc_gen_elixir_version: "0.12.0"
+
+  field :load, 1, type: :float
+  field :peak_load, 2, type: :float, json_name: "peakLoad"
+  field :degradation, 3, type: :uint32
+  field :overruns, 4, type: :uint32
+  field :shed_voices, 5, type: :uint32, json_name: "shedVoices"
+  field :refused_triggers, 6, type: :uint32, json_name: "refusedTriggers"
+  field :coalesced_configs, 7, type: :uint64, json_name: "coalescedConfigs"
 end
 
 defmodule Joystick.Protobuf.InputLightEvent do